@@ -0,0 +1,174 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// Throughput of the core array (coreArray.h): runs the same program as many
+// independent jobs on the ARRAY_CORES cores, giving a new job to a core as soon
+// as it is done, and prints the cycles per job.
+//
+// g++ -O2 -I<vitis>/include -DARRAY_CORES=8 arrayRunner.cpp coreArray.cpp core.cpp riscvISA.cpp elfFile.cpp
+// arrayRunner -f program.elf [-j jobs] [-m maxCycles]
+//
+// The code is shared by all the jobs. Each core has a private window of the data
+// memory: the data sections are copied in it before every job, and the stack is at
+// its top. The exit code is the one of the jobs, -1 when they do not agree.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "coreArray.h"
+#include "elfFile.h"
+
+#define MEMORY_WORDS (1 << 24)
+#define WINDOW_SIZE  ((MEMORY_WORDS << 2) / ARRAY_CORES) // bytes of data memory of each core
+
+static ap_uint<32> imData[MEMORY_WORDS];
+static ap_uint<32> dmData[MEMORY_WORDS];
+
+static void storeByte(ap_uint<32> memory[MEMORY_WORDS], const unsigned int address, const unsigned char value)
+{
+  const int offset                               = (address & 0x3) << 3;
+  memory[address >> 2].range(offset + 7, offset) = value;
+}
+
+// Sections without content (.bss) are cleared, as the previous job wrote in them
+static void loadWindow(const ElfFile& elf, const unsigned int base)
+{
+  for (const ElfSection& section : elf.sectionTable) {
+    if (!(section.flags & ELF_SHF_ALLOC))
+      continue;
+    const unsigned char* code = elf.getSectionCode(section);
+    for (unsigned int oneByte = 0; oneByte < section.size; oneByte++)
+      storeByte(dmData, base + section.address + oneByte, code == NULL ? 0 : code[oneByte]);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const char* elfPath     = NULL;
+  unsigned long maxCycles = -1;
+  int numberJobs          = 4 * ARRAY_CORES;
+
+  for (int oneArg = 1; oneArg < argc; oneArg++) {
+    if (!strcmp(argv[oneArg], "-f") && oneArg + 1 < argc)
+      elfPath = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-j") && oneArg + 1 < argc)
+      numberJobs = atoi(argv[++oneArg]);
+    else if (!strcmp(argv[oneArg], "-m") && oneArg + 1 < argc)
+      maxCycles = strtoul(argv[++oneArg], NULL, 0);
+    else {
+      fprintf(stderr, "Usage: %s -f program.elf [-j jobs] [-m maxCycles]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (elfPath == NULL) {
+    fprintf(stderr, "Usage: %s -f program.elf [-j jobs] [-m maxCycles]\n", argv[0]);
+    return -1;
+  }
+
+  ElfFile elf(elfPath);
+  for (const ElfSection& section : elf.sectionTable) {
+    if (!(section.flags & ELF_SHF_ALLOC))
+      continue;
+    // The stack takes the top of the window
+    if (((unsigned long)section.address + section.size) > WINDOW_SIZE - 4096) {
+      fprintf(stderr, "Section %s does not fit in the data window of a core (%d bytes)\n", section.name.c_str(),
+              WINDOW_SIZE);
+      return -1;
+    }
+    const unsigned char* code = elf.getSectionCode(section);
+    if (code != NULL)
+      for (unsigned int oneByte = 0; oneByte < section.size; oneByte++)
+        storeByte(imData, section.address + oneByte, code[oneByte]);
+  }
+
+  MEMORY_INTERFACE<4> imInterface(imData);
+  MEMORY_INTERFACE<4> dmInterface(dmData);
+  static MemoryArbiter<4, ARRAY_CORES> imArbiter(&imInterface);
+  static MemoryArbiter<4, ARRAY_CORES> dmArbiter(&dmInterface);
+  static CoreArray array;
+  initCoreArray(array, &imArbiter, &dmArbiter);
+#if ICACHE_SETS
+  static CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE> imCaches[ARRAY_CORES];
+#endif
+#if DCACHE_SETS
+  static CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE> dmCaches[ARRAY_CORES];
+#endif
+  for (int oneCore = 0; oneCore < ARRAY_CORES; oneCore++) {
+#if ICACHE_SETS
+    imCaches[oneCore].nextLevel = &imArbiter.ports[oneCore];
+    array.cores[oneCore].im     = &imCaches[oneCore];
+#endif
+#if DCACHE_SETS
+    dmCaches[oneCore].nextLevel = &dmArbiter.ports[oneCore];
+    array.cores[oneCore].dm     = &dmCaches[oneCore];
+#endif
+  }
+
+  CoreJob jobs[ARRAY_CORES];
+  bool busy[ARRAY_CORES];
+  unsigned long coreJobs[ARRAY_CORES], coreCycles[ARRAY_CORES], coreInstret[ARRAY_CORES];
+  for (int oneCore = 0; oneCore < ARRAY_CORES; oneCore++) {
+    jobs[oneCore].start  = false;
+    jobs[oneCore].done   = false;
+    busy[oneCore]        = false;
+    coreJobs[oneCore]    = 0;
+    coreCycles[oneCore]  = 0;
+    coreInstret[oneCore] = 0;
+  }
+
+  int dispatched = 0, finished = 0;
+  long exitCode  = 0;
+  bool firstExit = true;
+  while (finished < numberJobs && array.cycle < maxCycles) {
+    for (int oneCore = 0; oneCore < ARRAY_CORES; oneCore++) {
+      if (busy[oneCore] && jobs[oneCore].done) {
+        busy[oneCore] = false;
+        finished++;
+        coreJobs[oneCore]++;
+        coreCycles[oneCore] += jobs[oneCore].cycles;
+        coreInstret[oneCore] += jobs[oneCore].instret;
+        const long jobExit = (int)jobs[oneCore].exitCode;
+        exitCode           = (firstExit || jobExit == exitCode) ? jobExit : -1;
+        firstExit          = false;
+      }
+      if (!busy[oneCore] && dispatched < numberJobs) {
+        const unsigned int base = oneCore * WINDOW_SIZE;
+        loadWindow(elf, base);
+        jobs[oneCore].pc       = elf.entry;
+        jobs[oneCore].sp       = WINDOW_SIZE - 16;
+        jobs[oneCore].dataBase = base;
+        jobs[oneCore].start    = true;
+        busy[oneCore]          = true;
+        dispatched++;
+      }
+    }
+    while (!doArrayCycle(array, jobs) && array.cycle < maxCycles)
+      ;
+  }
+
+  printf("%d jobs on %d cores in %lu cycles, %.1f cycles/job\n", finished, ARRAY_CORES, array.cycle,
+         finished ? (double)array.cycle / finished : 0.0);
+  for (int oneCore = 0; oneCore < ARRAY_CORES; oneCore++) {
+    printf("core %d: %lu jobs, %lu cycles, %lu instructions, IPC %.3f, im wait %lu, dm wait %lu\n", oneCore,
+           coreJobs[oneCore], coreCycles[oneCore], coreInstret[oneCore],
+           coreCycles[oneCore] ? (double)coreInstret[oneCore] / coreCycles[oneCore] : 0.0,
+           imArbiter.numberWaitCycles[oneCore], dmArbiter.numberWaitCycles[oneCore]);
+  }
+  if (finished < numberJobs) {
+    fprintf(stderr, "Stopped after %lu cycles, %d jobs out of %d finished\n", array.cycle, finished, numberJobs);
+    return -1;
+  }
+  return exitCode;
+}
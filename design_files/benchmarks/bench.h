@@ -0,0 +1,84 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+// Benchmarks run on the simulator without a C library (see start.S and lib.c).
+// Each one checks its own result: main returns 0 when it is the expected one.
+// Built for the host with -DBENCH_HOST, they print the result instead, which is
+// how the expected values were obtained.
+
+#include <stddef.h>
+
+#ifdef BENCH_HOST
+#include <stdio.h>
+#include <string.h>
+#define BENCH_CHECK(result, expected) (printf("%s: 0x%08x\n", __FILE__, (unsigned int)(result)), (result) != (expected))
+#else
+void* memcpy(void* destination, const void* source, size_t size);
+void* memset(void* destination, int value, size_t size);
+#define BENCH_CHECK(result, expected) ((result) != (expected))
+#endif
+
+// Same sequence on the host and on the core
+static inline unsigned int benchRandom(unsigned int* state)
+{
+  *state = *state * 1103515245u + 12345u;
+  return *state >> 8;
+}
+
+// Harts of the simulator (see threadSyscalls in core.cpp), the host has a single one.
+// A started hart runs function(argument) on the stack which ends at stackTop,
+// then stops.
+#ifdef BENCH_HOST
+static inline int benchNbCores(void)
+{
+  return 1;
+}
+
+static inline int benchThreadStart(int hart, void (*function)(int), void* stackTop, int argument)
+{
+  (void)hart, (void)function, (void)stackTop, (void)argument;
+  return -1;
+}
+#else
+void _threadStart(void);
+
+static inline int benchNbCores(void)
+{
+  register int a0 __asm__("a0");
+  register int a7 __asm__("a7") = 0x4321; // SYS_nbcore
+  __asm__ volatile("ecall" : "=r"(a0) : "r"(a7) : "memory");
+  return a0;
+}
+
+static inline int benchThreadStart(int hart, void (*function)(int), void* stackTop, int argument)
+{
+  // _threadStart (start.S) finds the function on the top of its stack
+  void (**top)(int) = (void (**)(int))((char*)stackTop - 16);
+  *top              = function;
+
+  register int a0 __asm__("a0") = hart;
+  register int a1 __asm__("a1") = (int)_threadStart;
+  register int a2 __asm__("a2") = (int)top;
+  register int a3 __asm__("a3") = argument;
+  register int a7 __asm__("a7") = 0x1234; // SYS_threadstart
+  __asm__ volatile("ecall" : "+r"(a0) : "r"(a1), "r"(a2), "r"(a3), "r"(a7) : "memory");
+  return a0;
+}
+#endif
+
+#endif // __BENCH_H__
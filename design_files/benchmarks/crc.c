@@ -0,0 +1,44 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+// Table-driven CRC-32 (reflected polynomial 0xEDB88320) of a random buffer.
+
+#include "bench.h"
+
+#define SIZE     8192
+#define PASSES   4
+#define EXPECTED 0x2c60ec9d
+
+static unsigned int table[256];
+static unsigned char buffer[SIZE];
+
+int main()
+{
+  for (unsigned int byte = 0; byte < 256; byte++) {
+    unsigned int crc = byte;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320u : 0);
+    table[byte] = crc;
+  }
+
+  unsigned int seed = 7;
+  for (int i = 0; i < SIZE; i++)
+    buffer[i] = benchRandom(&seed);
+
+  // Each pass starts from the crc of the previous one
+  unsigned int crc = 0xffffffffu;
+  for (int pass = 0; pass < PASSES; pass++)
+    for (int i = 0; i < SIZE; i++)
+      crc = table[(crc ^ buffer[i]) & 0xff] ^ (crc >> 8);
+
+  return BENCH_CHECK(~crc, EXPECTED);
+}
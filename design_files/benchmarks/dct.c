@@ -0,0 +1,146 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+// Fixed-point 8x8 DCT of dct-test.c, applied back and forth on a block.
+// Built with -DDCT8_ACCELERATOR, the 8-point DCT runs on the Dct8Accelerator of
+// the core instead (simulator built with CUSTOM_ACCELERATOR=1), with the same
+// results: run.py builds it as dct_acc.
+
+#include "bench.h"
+
+// Products wrap around as on the core, without undefined behavior on the host
+#define MULFIXED(a, b) ((int)((unsigned int)(a) * (unsigned int)(b)) >> 15)
+
+#define FXP_C1 32138
+#define FXP_C2 30274
+#define FXP_C3 27245
+#define FXP_C4 23170
+#define FXP_C5 18205
+#define FXP_C6 12540
+#define FXP_C7 6393
+
+#define ITERATIONS 256
+#define EXPECTED   0x679c8bd0
+
+#if defined(DCT8_ACCELERATOR) && !defined(BENCH_HOST)
+// Instructions of customAccelerator.h, in custom-0
+#define DCT8_PUT(index, a, b) asm volatile(".insn r 0x0b, 0, %0, x0, %1, %2" : : "i"(index), "r"(a), "r"(b))
+#define DCT8_RUN()            asm volatile(".insn r 0x0b, 1, 0, x0, x0, x0")
+#define DCT8_GET(index, value) asm volatile(".insn r 0x0b, 2, %1, %0, x0, x0" : "=r"(value) : "i"(index))
+
+static void fast_fixed_dct8(int in[8], int out[8])
+{
+  int out0, out1, out2, out3, out4, out5, out6, out7;
+
+  DCT8_PUT(0, in[0], in[1]);
+  DCT8_PUT(1, in[2], in[3]);
+  DCT8_PUT(2, in[4], in[5]);
+  DCT8_PUT(3, in[6], in[7]);
+  DCT8_RUN();
+  DCT8_GET(0, out0);
+  DCT8_GET(1, out1);
+  DCT8_GET(2, out2);
+  DCT8_GET(3, out3);
+  DCT8_GET(4, out4);
+  DCT8_GET(5, out5);
+  DCT8_GET(6, out6);
+  DCT8_GET(7, out7);
+  out[0] = out0;
+  out[1] = out1;
+  out[2] = out2;
+  out[3] = out3;
+  out[4] = out4;
+  out[5] = out5;
+  out[6] = out6;
+  out[7] = out7;
+}
+#else
+static void fast_fixed_dct8(int in[8], int out[8])
+{
+  int i;
+  int tmp[8];
+  int tmp2[8];
+
+  for (i = 0; i < 4; i++)
+    tmp[i] = in[i] + in[7 - i];
+  for (i = 4; i < 8; i++)
+    tmp[i] = -in[i] + in[7 - i];
+
+  tmp2[0] = tmp[0] + tmp[3];
+  tmp2[1] = tmp[1] + tmp[2];
+  tmp2[2] = tmp[1] - tmp[2];
+  tmp2[3] = tmp[0] - tmp[3];
+  tmp2[4] = tmp[4];
+  tmp2[5] = MULFIXED(FXP_C4, tmp[6] - tmp[5]);
+  tmp2[6] = MULFIXED(FXP_C4, tmp[5] + tmp[5]);
+  tmp2[7] = tmp[7];
+
+  tmp[0] = MULFIXED(FXP_C4, tmp2[0] + tmp2[1]);
+  tmp[1] = MULFIXED(FXP_C4, tmp2[0] - tmp2[1]);
+  tmp[2] = MULFIXED(FXP_C6, tmp2[2]) + MULFIXED(FXP_C2, tmp2[3]);
+  tmp[3] = MULFIXED(FXP_C6, tmp2[3]) - MULFIXED(FXP_C2, tmp2[2]);
+  tmp[4] = tmp2[4] + tmp2[5];
+  tmp[5] = tmp2[4] - tmp2[5];
+  tmp[6] = tmp2[7] - tmp2[6];
+  tmp[7] = tmp2[6] + tmp2[7];
+
+  out[0] = tmp[0] >> 1;
+  out[4] = tmp[1] >> 1;
+  out[2] = tmp[2] >> 1;
+  out[6] = tmp[3] >> 1;
+  out[1] = (MULFIXED(FXP_C7, tmp[4]) + MULFIXED(FXP_C1, tmp[7])) >> 1;
+  out[5] = (MULFIXED(FXP_C3, tmp[5]) + MULFIXED(FXP_C5, tmp[6])) >> 1;
+  out[3] = (MULFIXED(FXP_C3, tmp[6]) - MULFIXED(FXP_C5, tmp[5])) >> 1;
+  out[7] = (MULFIXED(FXP_C7, tmp[7]) - MULFIXED(FXP_C1, tmp[4])) >> 1;
+}
+#endif
+
+static void fast_fixed_dct8x8(short pixel[8][8], short data[8][8])
+{
+  int ping[8][8];
+  int pong[8][8];
+  int u, v;
+
+  for (u = 0; u < 8; u++)
+    for (v = 0; v < 8; v++)
+      ping[u][v] = (int)pixel[u][v];
+  for (u = 0; u < 8; u++)
+    fast_fixed_dct8(&ping[u][0], &pong[u][0]);
+  for (u = 0; u < 8; u++)
+    for (v = 0; v < 8; v++)
+      ping[u][v] = pong[v][u];
+  for (u = 0; u < 8; u++)
+    fast_fixed_dct8(&ping[u][0], &pong[u][0]);
+  for (u = 0; u < 8; u++)
+    for (v = 0; v < 8; v++)
+      data[u][v] = (short)pong[v][u];
+}
+
+int main()
+{
+  static short insample[8][8] = {{139, 144, 149, 153, 155, 155, 155, 155}, {144, 151, 153, 156, 159, 156, 156, 156},
+                                 {150, 155, 160, 163, 158, 156, 156, 156}, {159, 161, 162, 160, 160, 159, 159, 159},
+                                 {159, 160, 161, 162, 162, 155, 155, 155}, {161, 161, 161, 161, 160, 157, 157, 157},
+                                 {162, 162, 161, 163, 162, 157, 157, 157}, {162, 162, 161, 161, 163, 158, 158, 158}};
+  short output[8][8];
+  unsigned int checksum = 0;
+
+  for (int oneIteration = 0; oneIteration < ITERATIONS; oneIteration++) {
+    fast_fixed_dct8x8(insample, output);
+    fast_fixed_dct8x8(output, insample);
+  }
+  for (int i = 0; i < 8; i++)
+    for (int j = 0; j < 8; j++)
+      checksum = (checksum << 5 | checksum >> 27) ^ (unsigned short)output[i][j];
+
+  return BENCH_CHECK(checksum, EXPECTED);
+}
@@ -0,0 +1,116 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+// Integer code in the style of Dhrystone: records linked by pointers, string
+// copies and comparisons, enumerations, switches and small function calls.
+
+#include "bench.h"
+
+#define ITERATIONS 2000
+#define EXPECTED   0xcd363257
+
+enum Color { RED, GREEN, BLUE, YELLOW };
+
+struct Record {
+  struct Record* next;
+  enum Color color;
+  int value;
+  int counter;
+  char name[32];
+};
+
+static struct Record records[2];
+static int globalArray[64];
+static char globalChar;
+
+static void copyString(char* destination, const char* source)
+{
+  while ((*destination++ = *source++) != 0)
+    ;
+}
+
+static int compareStrings(const char* first, const char* second)
+{
+  while (*first != 0 && *first == *second) {
+    first++;
+    second++;
+  }
+  return *(const unsigned char*)first - *(const unsigned char*)second;
+}
+
+static enum Color nextColor(const enum Color color, const int value)
+{
+  switch (color) {
+    case RED:
+      return value > 10 ? GREEN : BLUE;
+    case GREEN:
+      return YELLOW;
+    case BLUE:
+      return (value & 1) ? RED : YELLOW;
+    default:
+      return RED;
+  }
+}
+
+static int procedure1(struct Record* record, const int index)
+{
+  struct Record* other = record->next;
+  *other               = *record;
+  other->value         = record->value + index;
+  other->color         = nextColor(record->color, other->value);
+  if (other->color == YELLOW)
+    other->counter++;
+  else
+    record->counter += other->value & 7;
+  return other->value;
+}
+
+static int procedure2(int value, const char character)
+{
+  int result = value;
+  for (int i = 0; i < 4; i++) {
+    if (character == 'A' + i)
+      result += i * 3;
+    else
+      result -= 1;
+  }
+  return result;
+}
+
+int main()
+{
+  static const char stringOne[]   = "DHRYSTONE STYLE PROGRAM, 1'ST STRING";
+  static const char stringTwo[]   = "DHRYSTONE STYLE PROGRAM, 2'ND STRING";
+  char localString[40];
+  unsigned int checksum = 0;
+
+  records[0].next  = &records[1];
+  records[1].next  = &records[0];
+  records[0].color = RED;
+  records[0].value = 5;
+  copyString(records[0].name, "FIRST RECORD");
+
+  for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+    globalChar = 'A' + (iteration & 3);
+    copyString(localString, (iteration & 1) ? stringOne : stringTwo);
+    const int comparison = compareStrings(localString, stringOne);
+
+    struct Record* record = &records[iteration & 1];
+    const int value       = procedure1(record, iteration & 15);
+    const int value2      = procedure2(value, globalChar);
+
+    globalArray[iteration & 63] += value2 + comparison;
+    checksum = checksum * 33 + (unsigned int)(value2 ^ globalArray[(iteration * 7) & 63]) + record->counter;
+  }
+
+  return BENCH_CHECK(checksum, EXPECTED);
+}
@@ -0,0 +1,57 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// memcpy and memset, called by the benchmarks and by the code generated by
+// the compiler. Word copies are used when both pointers are aligned.
+
+#include "bench.h"
+
+void* memcpy(void* destination, const void* source, size_t size)
+{
+  unsigned char* out      = (unsigned char*)destination;
+  const unsigned char* in = (const unsigned char*)source;
+
+  if ((((size_t)out | (size_t)in) & 3) == 0) {
+    for (; size >= 16; size -= 16, out += 16, in += 16) {
+      ((unsigned int*)out)[0] = ((const unsigned int*)in)[0];
+      ((unsigned int*)out)[1] = ((const unsigned int*)in)[1];
+      ((unsigned int*)out)[2] = ((const unsigned int*)in)[2];
+      ((unsigned int*)out)[3] = ((const unsigned int*)in)[3];
+    }
+    for (; size >= 4; size -= 4, out += 4, in += 4)
+      *(unsigned int*)out = *(const unsigned int*)in;
+  }
+  while (size--)
+    *out++ = *in++;
+  return destination;
+}
+
+void* memset(void* destination, int value, size_t size)
+{
+  unsigned char* out = (unsigned char*)destination;
+
+  for (; size != 0 && ((size_t)out & 3); size--)
+    *out++ = value;
+  if (size >= 4) {
+    unsigned int word = value & 0xff;
+    word |= word << 8;
+    word |= word << 16;
+    for (; size >= 4; size -= 4, out += 4)
+      *(unsigned int*)out = word;
+  }
+  while (size--)
+    *out++ = value;
+  return destination;
+}
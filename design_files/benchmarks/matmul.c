@@ -0,0 +1,50 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+// Product of two integer matrices, with a transposed copy of the second one
+// so that both operands are read along their rows.
+
+#include "bench.h"
+
+#define N          40
+#define EXPECTED   0x0736a106
+
+static int a[N][N], b[N][N], bTransposed[N][N], c[N][N];
+
+int main()
+{
+  unsigned int seed = 1;
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++) {
+      a[i][j] = (int)(benchRandom(&seed) & 0xff) - 128;
+      b[i][j] = (int)(benchRandom(&seed) & 0xff) - 128;
+    }
+
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++)
+      bTransposed[j][i] = b[i][j];
+
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++) {
+      int sum = 0;
+      for (int k = 0; k < N; k++)
+        sum += a[i][k] * bTransposed[j][k];
+      c[i][j] = sum;
+    }
+
+  unsigned int checksum = 0;
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++)
+      checksum = checksum * 31 + (unsigned int)c[i][j];
+
+  return BENCH_CHECK(checksum, EXPECTED);
+}
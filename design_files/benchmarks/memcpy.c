@@ -0,0 +1,46 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+// memcpy and memset of lib.c on buffers of several sizes and alignments.
+
+#include "bench.h"
+
+#define SIZE     16384
+#define PASSES   4
+#define EXPECTED 0xcf73015c
+
+static unsigned char source[SIZE + 8];
+static unsigned char destination[SIZE + 8];
+
+int main()
+{
+  unsigned int seed = 3;
+  for (int i = 0; i < SIZE + 8; i++)
+    source[i] = benchRandom(&seed);
+
+  unsigned int checksum = 0;
+  for (int pass = 0; pass < PASSES; pass++) {
+    // Aligned block copies, then small unaligned copies, then fills
+    memcpy(destination, source, SIZE);
+    for (int offset = 0; offset + 64 < SIZE; offset += 97)
+      memcpy(destination + offset + (pass & 3), source + offset + 1, 13 + (offset & 31));
+    for (int i = 0; i < SIZE; i += 1024)
+      checksum = checksum * 31 + destination[i + pass];
+
+    memset(destination, pass, SIZE / 2);
+    memset(destination + SIZE / 2 + 1, 0xa5, SIZE / 2 - 3);
+    for (int i = 0; i < SIZE; i += 1021)
+      checksum = checksum * 31 + destination[i];
+  }
+
+  return BENCH_CHECK(checksum, EXPECTED);
+}
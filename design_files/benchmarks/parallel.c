@@ -0,0 +1,70 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// Histogram on all the harts (simulator built with -DNB_CORES=N): each hart
+// counts a block of the data in its own histogram, then adds it to the shared
+// one with atomic operations. The last hart to finish is awaited through an
+// atomic counter. The result does not depend on the number of harts.
+
+#include "bench.h"
+
+#define SIZE       16384
+#define BINS       64
+#define MAX_HARTS  16
+#define STACK_SIZE 2048
+#define EXPECTED   0xe0dff21d
+
+static unsigned int data[SIZE];
+static unsigned int histogram[BINS];
+static int finished;
+static int nbHarts;
+static unsigned int stacks[MAX_HARTS][STACK_SIZE / 4];
+
+static void work(int hart)
+{
+  unsigned int local[BINS];
+  for (int bin = 0; bin < BINS; bin++)
+    local[bin] = 0;
+
+  const int first = (SIZE / nbHarts) * hart;
+  const int last  = (hart == nbHarts - 1) ? SIZE : first + SIZE / nbHarts;
+  for (int i = first; i < last; i++)
+    local[data[i] & (BINS - 1)]++;
+
+  for (int bin = 0; bin < BINS; bin++)
+    __atomic_fetch_add(&histogram[bin], local[bin], __ATOMIC_RELAXED);
+  __atomic_fetch_add(&finished, 1, __ATOMIC_RELEASE);
+}
+
+int main()
+{
+  unsigned int seed = 11;
+  for (int i = 0; i < SIZE; i++)
+    data[i] = benchRandom(&seed) ^ (benchRandom(&seed) >> 7);
+
+  nbHarts = benchNbCores();
+  if (nbHarts > MAX_HARTS)
+    nbHarts = MAX_HARTS;
+  for (int hart = 1; hart < nbHarts; hart++)
+    benchThreadStart(hart, work, stacks[hart] + STACK_SIZE / 4, hart);
+  work(0);
+  while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) != nbHarts)
+    ;
+
+  unsigned int result = 0;
+  for (int bin = 0; bin < BINS; bin++)
+    result = result * 31 + histogram[bin] * (bin + 1);
+  return BENCH_CHECK(result, EXPECTED);
+}
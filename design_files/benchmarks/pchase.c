@@ -0,0 +1,56 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+// Pointer chasing through a random cycle of nodes spread over 256 KB: every
+// load depends on the previous one and most of them miss in small caches.
+
+#include "bench.h"
+
+#define NODES    16384
+#define STEPS    100000
+#define EXPECTED 0x30a9da14
+
+struct Node {
+  struct Node* next;
+  unsigned int value;
+  unsigned int padding[2];
+};
+
+static struct Node nodes[NODES];
+static unsigned int order[NODES];
+
+int main()
+{
+  // Sattolo's algorithm gives a single cycle through all the nodes
+  unsigned int seed = 11;
+  for (unsigned int i = 0; i < NODES; i++)
+    order[i] = i;
+  for (unsigned int i = NODES - 1; i > 0; i--) {
+    const unsigned int j = benchRandom(&seed) % i;
+    const unsigned int swapped = order[i];
+    order[i]                   = order[j];
+    order[j]                   = swapped;
+  }
+  for (unsigned int i = 0; i < NODES; i++) {
+    nodes[order[i]].next  = &nodes[order[(i + 1) % NODES]];
+    nodes[order[i]].value = i;
+  }
+
+  const struct Node* node = &nodes[0];
+  unsigned int checksum   = 0;
+  for (int step = 0; step < STEPS; step++) {
+    checksum += node->value;
+    node = node->next;
+  }
+
+  return BENCH_CHECK(checksum ^ (unsigned int)(node - nodes), EXPECTED);
+}
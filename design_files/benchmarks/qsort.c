@@ -0,0 +1,92 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+// Quicksort (median of three, insertion sort for small partitions) of random integers.
+
+#include "bench.h"
+
+#define SIZE     4096
+#define EXPECTED 0x0c84efd4
+
+static int values[SIZE];
+
+static void insertionSort(int* first, int* last)
+{
+  for (int* current = first + 1; current <= last; current++) {
+    const int value = *current;
+    int* position   = current;
+    while (position > first && position[-1] > value) {
+      *position = position[-1];
+      position--;
+    }
+    *position = value;
+  }
+}
+
+static void swap(int* x, int* y)
+{
+  const int value = *x;
+  *x              = *y;
+  *y              = value;
+}
+
+static void quickSort(int* first, int* last)
+{
+  while (last - first > 16) {
+    int* middle = first + (last - first) / 2;
+    if (*middle < *first)
+      swap(middle, first);
+    if (*last < *first)
+      swap(last, first);
+    if (*last < *middle)
+      swap(last, middle);
+    const int pivot = *middle;
+
+    int* left  = first;
+    int* right = last;
+    while (left <= right) {
+      while (*left < pivot)
+        left++;
+      while (*right > pivot)
+        right--;
+      if (left <= right)
+        swap(left++, right--);
+    }
+
+    // Recursion on the smaller part bounds the stack depth
+    if (right - first < last - left) {
+      quickSort(first, right);
+      first = left;
+    } else {
+      quickSort(left, last);
+      last = right;
+    }
+  }
+  insertionSort(first, last);
+}
+
+int main()
+{
+  unsigned int seed = 42;
+  for (int i = 0; i < SIZE; i++)
+    values[i] = (int)benchRandom(&seed) - (1 << 23);
+
+  quickSort(values, values + SIZE - 1);
+
+  unsigned int checksum = 0;
+  for (int i = 0; i < SIZE; i++) {
+    if (i > 0 && values[i - 1] > values[i])
+      return 2;
+    checksum = checksum * 31 + (unsigned int)values[i];
+  }
+  return BENCH_CHECK(checksum, EXPECTED);
+}
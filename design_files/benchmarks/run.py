@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+# Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#       http://www.apache.org/licenses/LICENSE-2.0
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+
+"""Benchmark suite runner.
+
+Builds the RV32IA benchmarks of this directory with a RISC-V cross compiler, runs
+them on the simulator and reports, per benchmark, the cycles, the CPI, the cache
+miss rates (when the simulator was built with caches, see core.h) and the host
+simulation speed in simulated MIPS. Each benchmark checks its own result, a
+wrong result is reported as a failure.
+
+  run.py --build                               # bin/*.elf, with riscv64-unknown-elf-gcc
+  run.py --build --march rv32iac               # compressed code, for COMPRESSED_ISA=1
+  run.py --simulator ../simulator dct dct_acc  # DCT in software and on the accelerator
+  run.py --simulator ../simulator --json rev.json
+  run.py --simulator ../simulator --compare previous.json
+
+The JSON file records the revision, so that results can be tracked across
+revisions; --compare prints the change of CPI and speed against such a file.
+
+The RV32IA binaries of bin are prebuilt, and results.json holds their results on
+the default simulator, as a reference for --compare. A benchmark without its ELF
+file in the bin directory is reported as skipped; when all of them are skipped,
+the exit status is 77 (the usual status of a skipped test) instead of a success.
+"""
+
+import argparse
+import datetime
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+BENCHMARKS = ["dct", "matmul", "qsort", "crc", "dhrystone", "memcpy", "pchase", "parallel"]
+# Variants for the custom accelerator of the core (CUSTOM_ACCELERATOR=1), only run
+# when they are named: name -> (benchmark, flags)
+ACCELERATED = {"dct_acc": ("dct", ["-DDCT8_ACCELERATOR"])}
+EXIT_SKIPPED = 77
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# The core implements RV32IA (RV32IAC with COMPRESSED_ISA): multiplications and
+# divisions come from libgcc
+CFLAGS = ["-mabi=ilp32", "-O2", "-ffreestanding", "-fno-builtin",
+          "-fno-tree-loop-distribute-patterns", "-nostdlib", "-nostartfiles", "-static"]
+
+
+def build(args):
+    os.makedirs(args.bin_dir, exist_ok=True)
+    targets = [(benchmark, benchmark, []) for benchmark in BENCHMARKS]
+    targets += [(name, benchmark, flags) for name, (benchmark, flags) in ACCELERATED.items()]
+    for name, benchmark, flags in targets:
+        sources = [os.path.join(BENCH_DIR, source) for source in ("start.S", "lib.c", benchmark + ".c")]
+        command = [args.cc, "-march=" + args.march] + CFLAGS + flags + sources
+        command += ["-lgcc", "-o", os.path.join(args.bin_dir, name + ".elf")]
+        result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+        if result.returncode != 0:
+            sys.exit("Failed to build %s:\n%s" % (name, result.stdout))
+    print("Built %d benchmarks in %s" % (len(targets), args.bin_dir), file=sys.stderr)
+
+
+def miss_rate(pattern, text):
+    match = re.search(pattern, text)
+    if match is None:
+        return None
+    accesses, misses = int(match.group(1)), int(match.group(2))
+    return misses / accesses if accesses else 0.0
+
+
+def run(benchmark, args):
+    elf = os.path.join(args.bin_dir, benchmark + ".elf")
+    if not os.path.isfile(elf):
+        print("Skipping %s: %s is missing, build it with --build" % (benchmark, elf), file=sys.stderr)
+        return {"status": "skipped"}
+    command = [args.simulator, "-f", elf]
+    if args.max_cycles:
+        command += ["-m", str(args.max_cycles)]
+    start = time.perf_counter()
+    result = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+    seconds = time.perf_counter() - start
+
+    match = re.search(r"(\d+) cycles, (\d+) instructions", result.stderr)
+    if match is None:
+        return {"status": "crash"}
+    cycles, instructions = int(match.group(1)), int(match.group(2))
+    if "Cycle limit reached" in result.stderr:
+        status = "timeout"
+    else:
+        status = "pass" if result.returncode == 0 else "fail"
+    return {
+        "status": status,
+        "cycles": cycles,
+        "instructions": instructions,
+        "cpi": cycles / max(instructions, 1),
+        "icache_miss_rate": miss_rate(r"icache 0: (\d+) accesses, (\d+) misses", result.stderr),
+        "dcache_miss_rate": miss_rate(r"dcache 0: (\d+) accesses, (\d+) misses", result.stderr),
+        "host_seconds": seconds,
+        "mips": instructions / seconds / 1e6,
+        "cycles_per_second": cycles / seconds,
+    }
+
+
+def revision():
+    try:
+        return subprocess.run(["git", "-C", BENCH_DIR, "describe", "--always", "--dirty"], stdout=subprocess.PIPE,
+                              stderr=subprocess.DEVNULL, universal_newlines=True).stdout.strip()
+    except OSError:
+        return ""
+
+
+def percent(value):
+    return "%.2f" % (100 * value) if value is not None else "-"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("benchmarks", nargs="*", help="subset of %s" % ", ".join(BENCHMARKS + list(ACCELERATED)))
+    parser.add_argument("--build", action="store_true", help="compile the benchmarks")
+    parser.add_argument("--cc", default="riscv64-unknown-elf-gcc")
+    parser.add_argument("--march", default="rv32ia", help="rv32iac needs a simulator built with COMPRESSED_ISA=1")
+    parser.add_argument("--bin-dir", default=os.path.join(BENCH_DIR, "bin"))
+    parser.add_argument("--simulator", help="simulator binary (see simulator.cpp)")
+    parser.add_argument("--max-cycles", type=int, default=0)
+    parser.add_argument("--json", help="write the results to this file")
+    parser.add_argument("--compare", help="results of a previous run, as written by --json")
+    args = parser.parse_args()
+
+    for benchmark in args.benchmarks:
+        if benchmark not in BENCHMARKS and benchmark not in ACCELERATED:
+            parser.error("unknown benchmark %s" % benchmark)
+    if args.build:
+        build(args)
+    if args.simulator is None:
+        if not args.build:
+            parser.error("no simulator given")
+        return
+
+    # One benchmark at a time, so that the host speed is not disturbed
+    results = {benchmark: run(benchmark, args) for benchmark in (args.benchmarks or BENCHMARKS)}
+
+    header = ["benchmark", "status", "cycles", "instructions", "CPI", "I$ miss%", "D$ miss%", "host s", "MIPS"]
+    rows = []
+    for benchmark, result in results.items():
+        if "cycles" not in result:
+            rows.append([benchmark, result["status"]] + [""] * (len(header) - 2))
+            continue
+        rows.append([benchmark, result["status"], str(result["cycles"]), str(result["instructions"]),
+                     "%.3f" % result["cpi"], percent(result["icache_miss_rate"]), percent(result["dcache_miss_rate"]),
+                     "%.3f" % result["host_seconds"], "%.2f" % result["mips"]])
+    widths = [max(len(line[column]) for line in [header] + rows) for column in range(len(header))]
+    for line in [header] + rows:
+        print("  ".join(cell.rjust(width) for cell, width in zip(line, widths)))
+
+    if args.compare:
+        with open(args.compare) as previous_file:
+            previous = json.load(previous_file)
+        print("\nChange against %s (revision %s)" % (args.compare, previous.get("revision", "?")))
+        for benchmark, result in results.items():
+            before = previous["benchmarks"].get(benchmark, {})
+            if "cpi" not in result or "cpi" not in before:
+                continue
+            print("  %-10s CPI %.3f -> %.3f (%+.2f%%)  MIPS %.2f -> %.2f (%+.2f%%)" % (
+                benchmark, before["cpi"], result["cpi"], 100 * (result["cpi"] / before["cpi"] - 1),
+                before["mips"], result["mips"], 100 * (result["mips"] / before["mips"] - 1)))
+
+    if args.json:
+        with open(args.json, "w") as json_file:
+            json.dump({"revision": revision(), "date": datetime.datetime.now().isoformat(timespec="seconds"),
+                       "simulator": args.simulator, "benchmarks": results}, json_file, indent=2)
+
+    if any(result["status"] not in ("pass", "skipped") for result in results.values()):
+        sys.exit(1)
+    if all(result["status"] == "skipped" for result in results.values()):
+        sys.exit(EXIT_SKIPPED)
+
+
+if __name__ == "__main__":
+    main()
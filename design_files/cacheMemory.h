@@ -21,14 +21,36 @@
 // #include "ac_int.h"
 #include "ap_int.h"
 
+#ifndef __HLS__
+#include <algorithm>
+#include <cstdio>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#endif
+
+/************************************************************************
+ * 	Write policies:
+ * 		- WRITE_BACK: store misses allocate the line, dirty lines are
+ * 		  written back on eviction
+ * 		- WRITE_THROUGH: every store is also sent to the next level
+ * 		  through the write buffer, store misses do not allocate
+ * 		- WRITE_AROUND: write back on hits, store misses do not allocate
+ * 		  and go to the next level through the write buffer
+ ************************************************************************/
+typedef enum { WRITE_BACK = 0, WRITE_THROUGH, WRITE_AROUND } cacheWritePolicy;
+
 /************************************************************************
  * 	Following values are templates:
  * 		- OFFSET_SIZE
  * 		- TAG_SIZE
  * 		- SET_SIZE
  * 		- ASSOCIATIVITY
+ * 		- VICTIM_SIZE (lines in the fully associative victim buffer)
+ * 		- WRITE_POLICY (one of cacheWritePolicy)
  ************************************************************************/
-template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE>
+template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE, int VICTIM_SIZE = 4, int WRITE_POLICY = WRITE_BACK>
 class CacheMemory : public MemoryInterface<INTERFACE_SIZE> {
 
   static const int LOG_SET_SIZE           = log2const<SET_SIZE>::value;
@@ -41,9 +63,14 @@ class CacheMemory : public MemoryInterface<INTERFACE_SIZE> {
   static const int STATE_CACHE_FIRST_LOAD = ((LINE_SIZE / INTERFACE_SIZE) + 2);
   static const int STATE_CACHE_LAST_LOAD  = 2;
   static const int LOG_INTERFACE_SIZE     = log2const<INTERFACE_SIZE>::value;
+  static const int LOG_VICTIM_SIZE        = log2const<VICTIM_SIZE>::value;
+  static const int NB_LINES               = SET_SIZE * ASSOCIATIVITY + VICTIM_SIZE;
+  static const int LOG_NB_LINES           = log2const<NB_LINES>::value;
+  static const int WRITE_BUFFER_SIZE      = 4;
+  static const int LOG_WRITE_BUFFER_SIZE  = 2;
 
 public:
-  IncompleteMemory<INTERFACE_SIZE>* nextLevel;
+  MemoryInterface<INTERFACE_SIZE>* nextLevel;
 
   ap_uint<TAG_SIZE + LINE_SIZE * 8> cacheMemory[SET_SIZE][ASSOCIATIVITY];
   ap_uint<40> age[SET_SIZE][ASSOCIATIVITY];
@@ -71,14 +98,59 @@ public:
   ap_uint<INTERFACE_SIZE * 8> dataOutStore;
   ap_uint<1> valDirty = 0;
 
+  // Request of the miss in flight, completed by a flush which comes in the middle
+  ap_uint<32> missAddr;
+  memMask missMask;
+  memOpType missOpType;
+  ap_uint<INTERFACE_SIZE * 8> missDataIn;
+
+  // Victim buffer: lines evicted from a set are kept here, so that a conflict
+  // miss can swap them back without a writeback and a refill.
+  ap_uint<LINE_SIZE * 8> victimData[VICTIM_SIZE];
+  ap_uint<32 - LOG_LINE_SIZE> victimAddr[VICTIM_SIZE]; // line address (addr >> LOG_LINE_SIZE)
+  ap_uint<1> victimValid[VICTIM_SIZE];
+  ap_uint<1> victimDirty[VICTIM_SIZE];
+  ap_uint<LOG_VICTIM_SIZE + 1> victimNext = 0; // round robin replacement in the victim buffer
+  ap_uint<32> evictAddr;                        // address of the line being written back
+
+  // Flush state machine: walks all lines (sets then victim buffer) and
+  // writes the dirty ones back, one interface word per cycle
+  bool flushing = false;
+  ap_uint<LOG_NB_LINES + 1> flushLine;
+  ap_uint<LOG_LINE_SIZE + 1> flushWord;
+
+  // Write buffer (WRITE_THROUGH and WRITE_AROUND): stores for the next level wait
+  // here until it is not used by a refill
+  ap_uint<32> writeBufferAddr[WRITE_BUFFER_SIZE];
+  ap_uint<INTERFACE_SIZE * 8> writeBufferData[WRITE_BUFFER_SIZE];
+  memMask writeBufferMask[WRITE_BUFFER_SIZE];
+  ap_uint<LOG_WRITE_BUFFER_SIZE> writeBufferHead = 0;
+  ap_uint<LOG_WRITE_BUFFER_SIZE + 1> writeBufferCount = 0;
+  bool bufferBlocked = false; // request has to wait for the write buffer
+  memMask nextLevelMask;
+
   bool nextLevelWaitOut;
 
   bool VERBOSE = false;
 
   // Stats
-  unsigned long numberAccess, numberMiss;
-
-  CacheMemory(IncompleteMemory<INTERFACE_SIZE>* nextLevel, bool v)
+  unsigned long numberAccess, numberMiss, numberVictimHit;
+  unsigned long numberRead, numberWrite, numberReadMiss, numberWriteMiss;
+  unsigned long numberWriteback; // dirty lines sent to the next level
+
+#ifndef __HLS__
+  // Detailed stats, simulation only. Misses are classified as compulsory (first
+  // access to the line), capacity (also a miss in a fully associative LRU cache
+  // with as many lines) or conflict (a hit in that shadow cache).
+  unsigned long setAccessCount[SET_SIZE], setMissCount[SET_SIZE];
+  unsigned long numberCompulsory, numberCapacity, numberConflict;
+  std::unordered_map<unsigned int, unsigned long> missPerPc;
+  std::list<unsigned int> shadowLru; // line addresses, most recently used first
+  std::unordered_map<unsigned int, std::list<unsigned int>::iterator> shadowLines;
+  std::unordered_set<unsigned int> seenLines;
+#endif
+
+  CacheMemory(MemoryInterface<INTERFACE_SIZE>* nextLevel = NULL, bool v = false)
   {
     this->nextLevel = nextLevel;
     for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
@@ -89,18 +161,76 @@ public:
         dirtyBit[oneSetElement][oneSet]    = 0;
       }
     }
+    for (int oneVictim = 0; oneVictim < VICTIM_SIZE; oneVictim++) {
+      victimData[oneVictim]  = 0;
+      victimAddr[oneVictim]  = 0;
+      victimValid[oneVictim] = 0;
+      victimDirty[oneVictim] = 0;
+    }
     VERBOSE          = v;
     numberAccess     = 0;
     numberMiss       = 0;
+    numberVictimHit  = 0;
+    numberRead       = 0;
+    numberWrite      = 0;
+    numberReadMiss   = 0;
+    numberWriteMiss  = 0;
+    numberWriteback  = 0;
+    victimNext       = 0;
+    flushing         = false;
+    flushLine        = 0;
+    flushWord        = 0;
+    writeBufferHead  = 0;
+    writeBufferCount = 0;
+    bufferBlocked    = false;
+    nextLevelMask    = LONG;
     nextLevelWaitOut = false;
     wasStore         = false;
     cacheState       = 0;
     nextLevelOpType  = NONE;
+    missAddr         = 0;
+    missMask         = WORD;
+    missOpType       = NONE;
+    missDataIn       = 0;
+
+#ifndef __HLS__
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
+      setAccessCount[oneSetElement] = 0;
+      setMissCount[oneSetElement]   = 0;
+    }
+    numberCompulsory = 0;
+    numberCapacity   = 0;
+    numberConflict   = 0;
+#endif
   }
 
   void process(ap_uint<32> addr, memMask mask, memOpType opType, ap_uint<INTERFACE_SIZE * 8> dataIn,
                ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
   {
+    // The ways of a set are read in the same cycle; lines and ages are read and
+    // written on separate ports. The flags and the victim buffer are registers.
+#pragma HLS ARRAY_PARTITION variable = cacheMemory dim = 2 complete
+#pragma HLS ARRAY_PARTITION variable = age dim = 2 complete
+#pragma HLS ARRAY_PARTITION variable = dataValid complete
+#pragma HLS ARRAY_PARTITION variable = dirtyBit complete
+#pragma HLS BIND_STORAGE variable = cacheMemory type = ram_s2p impl = bram
+#pragma HLS BIND_STORAGE variable = age type = ram_s2p impl = lutram
+#pragma HLS ARRAY_PARTITION variable = victimData complete
+#pragma HLS ARRAY_PARTITION variable = victimAddr complete
+#pragma HLS ARRAY_PARTITION variable = victimValid complete
+#pragma HLS ARRAY_PARTITION variable = victimDirty complete
+
+    // A flush or a drain that comes while an access is in flight (the requester went
+    // away, e.g. the core stopped on an exit) first ends that access: the refill goes
+    // on with the request of the miss, the line is written and the next level is done
+    const bool endAccess =
+        (opType == FLUSH || opType == FLUSH_INVALIDATE || opType == DRAIN) && (cacheState || wasStore || nextLevelWaitOut);
+    if (endAccess && cacheState) {
+      addr   = missAddr;
+      mask   = missMask;
+      opType = missOpType;
+      dataIn = missDataIn;
+    }
 
     // bit size is the log(setSize)
     // ap_uint<LOG_SET_SIZE> place = addr.slc<LOG_SET_SIZE>(LOG_LINE_SIZE);
@@ -111,8 +241,14 @@ public:
     // bitSize is log(lineSize), start address is 2(because of #bytes in a word)
     // ap_uint<LOG_LINE_SIZE> offset = addr.slc<LOG_LINE_SIZE - 2>(2);
     ap_uint<LOG_LINE_SIZE> offset = addr.range(LOG_LINE_SIZE - 1, 2);
+    this->miss                    = false;
     if (!nextLevelWaitOut) {
       cycle++;
+      bufferBlocked = false;
+      if (cacheState == 0 && !flushing) {
+        nextLevelOpType = NONE;
+        nextLevelMask   = LONG;
+      }
 
       if (wasStore || cacheState == 1) {
         cacheMemory[placeStore][setStore] = valStore;
@@ -122,8 +258,17 @@ public:
         dataOut                           = dataOutStore;
         wasStore                          = false;
         cacheState                        = 0;
-        waitOut                           = 0;
+        waitOut                           = endAccess;
         return;
+      } else if (opType == FLUSH || opType == FLUSH_INVALIDATE) {
+        // Buffered stores are sent before the dirty lines
+        if (writeBufferCount != 0 && !flushing)
+          bufferBlocked = true;
+        else
+          flushStep(opType == FLUSH_INVALIDATE);
+      } else if (opType == DRAIN) {
+        // Done once the write buffer is empty, it is emptied below
+        bufferBlocked = writeBufferCount != 0;
       } else if (opType != NONE) {
 
         ap_uint<LINE_SIZE * 8 + TAG_SIZE> val1 = cacheMemory[place][0];
@@ -147,8 +292,18 @@ public:
         ap_uint<1> dirty3 = dirtyBit[place][2];
         ap_uint<1> dirty4 = dirtyBit[place][3];
 
+        // Way replaced on a miss: the oldest one (invalid lines have age 0)
+        ap_uint<LOG_ASSOCIATIVITY> oldest = (age1 < age2 && age1 < age3 && age1 < age4)
+                                                ? 0
+                                                : ((age2 < age1 && age2 < age3 && age2 < age4)
+                                                       ? 1
+                                                       : ((age3 < age2 && age3 < age1 && age3 < age4) ? 2 : 3));
+        ap_uint<LINE_SIZE * 8 + TAG_SIZE> oldestVal =
+            (oldest == 0) ? val1 : ((oldest == 1) ? val2 : ((oldest == 2) ? val3 : val4));
+        ap_uint<1> oldestValid = (oldest == 0) ? valid1 : ((oldest == 1) ? valid2 : ((oldest == 2) ? valid3 : valid4));
+        ap_uint<1> oldestDirty = (oldest == 0) ? dirty1 : ((oldest == 1) ? dirty2 : ((oldest == 2) ? dirty3 : dirty4));
+
         if (cacheState == 0) {
-          numberAccess++;
 
         //   ap_uint<TAG_SIZE> tag1 = val1.template slc<TAG_SIZE>(0);
           ap_uint<TAG_SIZE> tag1 = val1.range(TAG_SIZE - 1, 0);
@@ -162,10 +317,30 @@ public:
           bool hit4 = (tag4 == tag) && valid4;
           bool hit  = hit1 | hit2 | hit3 | hit4;
 
+          // Lookup in the victim buffer, in parallel with the sets
+          ap_uint<32 - LOG_LINE_SIZE> lineAddr = addr.range(31, LOG_LINE_SIZE);
+          bool victimHit                       = false;
+          ap_uint<LOG_VICTIM_SIZE + 1> victimWay = 0;
+          ap_uint<1> victimLineDirty             = 0;
+          for (int oneVictim = 0; oneVictim < VICTIM_SIZE; oneVictim++) {
+            if (victimValid[oneVictim] && victimAddr[oneVictim] == lineAddr) {
+              victimHit       = true;
+              victimWay       = oneVictim;
+              victimLineDirty = victimDirty[oneVictim];
+            }
+          }
+
           ap_uint<LOG_ASSOCIATIVITY> set = 0;
           ap_uint<LINE_SIZE * 8> selectedValue;
           ap_uint<TAG_SIZE> tag;
 
+          if (!hit && victimHit) {
+            // The line comes back from the victim buffer into the oldest way
+            selectedValue = victimData[victimWay];
+            tag           = addr.range(LOG_LINE_SIZE + LOG_SET_SIZE + TAG_SIZE - 1, LOG_LINE_SIZE + LOG_SET_SIZE);
+            set           = oldest;
+          }
+
           if (hit1) {
             // selectedValue = val1.template slc<LINE_SIZE * 8>(TAG_SIZE);
             // slc<N>(start) is replaced by range(upper, lower)
@@ -198,7 +373,16 @@ public:
           ap_int<16> signedHalf;
           ap_int<32> signedWord;
 
-          if (hit) {
+          // Requests which push into the write buffer: stores (and atomics which hit) under
+          // write through, store misses under write around
+          const bool pushes =
+              (WRITE_POLICY == WRITE_THROUGH && (opType == STORE || (isAmo(opType) && (hit || victimHit)))) ||
+              (WRITE_POLICY == WRITE_AROUND && opType == STORE && !hit && !victimHit);
+
+          if (pushes && writeBufferCount == WRITE_BUFFER_SIZE) {
+            // No room for the store in the write buffer, retried on next cycle
+            bufferBlocked = true;
+          } else if (hit || victimHit) {
             ap_uint<LINE_SIZE * 8 + TAG_SIZE> localValStore = 0;
             // localValStore.set_slc(TAG_SIZE, selectedValue);
             // range(upper, lower) replaces set_slc.
@@ -250,9 +434,14 @@ public:
               placeStore = place;
               setStore   = set;
               valStore   = localValStore;
-              valDirty   = 1;
+              valDirty   = (WRITE_POLICY != WRITE_THROUGH);
               wasStore   = true;
 
+              // Write through: the whole updated word goes to the next level
+              if (WRITE_POLICY == WRITE_THROUGH)
+                pushWriteBuffer(addr & ~3, WORD,
+                                localValStore.range(TAG_SIZE + 4 * 8 * offset + 31, TAG_SIZE + 4 * 8 * offset));
+
             } else {
               switch (mask) {
                 case BYTE:
@@ -313,53 +502,104 @@ public:
 
               // printf("Hit read %x at %x\n", (unsigned int)dataOut.slc<32>(0), (unsigned int)addr);
             }
+
+            // Atomic operation: the word just read is replaced by the result, as for a store
+            if (isAmo(opType)) {
+              localValStore.range(TAG_SIZE + 4 * 8 * offset + 31, TAG_SIZE + 4 * 8 * offset) =
+                  amoResult(opType, dataOut.range(31, 0), dataIn.range(31, 0));
+
+              placeStore   = place;
+              setStore     = set;
+              valStore     = localValStore;
+              valDirty     = (WRITE_POLICY != WRITE_THROUGH);
+              dataOutStore = dataOut;
+              wasStore     = true;
+
+              if (WRITE_POLICY == WRITE_THROUGH)
+                pushWriteBuffer(addr & ~3, WORD,
+                                localValStore.range(TAG_SIZE + 4 * 8 * offset + 31, TAG_SIZE + 4 * 8 * offset));
+            }
             // age[place][set] = cycle;
 
+            if (!hit) {
+              // Swap: the line we replace takes the slot freed in the victim buffer.
+              // The set is written on next cycle, as for a store.
+              numberVictimHit++;
+              victimData[victimWay]  = oldestVal.range(TAG_SIZE + LINE_SIZE * 8 - 1, TAG_SIZE);
+              victimAddr[victimWay]  = (((ap_uint<32 - LOG_LINE_SIZE>)oldestVal.range(TAG_SIZE - 1, 0)) << LOG_SET_SIZE) | place;
+              victimValid[victimWay] = oldestValid;
+              victimDirty[victimWay] = oldestDirty;
+
+              if (opType != STORE && !isAmo(opType)) {
+                placeStore   = place;
+                setStore     = set;
+                valStore     = localValStore;
+                valDirty     = victimLineDirty;
+                dataOutStore = dataOut;
+                wasStore     = true;
+              }
+            }
+
+          } else if (opType == STORE && WRITE_POLICY != WRITE_BACK) {
+            // No write allocate: the store bypasses the cache
+            numberMiss++;
+            this->miss = true;
+            pushWriteBuffer(addr, mask, dataIn);
+          } else if (writeBufferCount != 0) {
+            // The refill has to see the buffered stores
+            bufferBlocked = true;
           } else {
             numberMiss++;
+            this->miss = true;
             cacheState = STATE_CACHE_MISS;
+            missAddr   = addr;
+            missMask   = mask;
+            missOpType = opType;
+            missDataIn = dataIn;
+          }
+
+          if (!bufferBlocked) {
+            numberAccess++;
+            recordAccess(addr, opType, !hit && !victimHit, opType != STORE || WRITE_POLICY == WRITE_BACK);
           }
         } else {
           // printf("Miss %d\n", (unsigned int)cacheState);
 
           if (cacheState == STATE_CACHE_MISS) {
             newVal  = tag;
-            setMiss = (age1 < age2 && age1 < age3 && age1 < age4)
-                          ? 0
-                          : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                 ? 1
-                                 : ((age3 < age2 && age3 < age1 && age3 < age4) ? 2 : 3));
-            oldVal = (age1 < age2 && age1 < age3 && age1 < age4)
-                         ? val1
-                         : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                ? val2
-                                : ((age3 < age2 && age3 < age1 && age3 < age4) ? val3 : val4));
-            isValid = (age1 < age2 && age1 < age3 && age1 < age4)
-                          ? valid1
-                          : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                 ? valid2
-                                 : ((age3 < age2 && age3 < age1 && age3 < age4) ? valid3 : valid4));
-            isDirty = (age1 < age2 && age1 < age3 && age1 < age4)
-                          ? dirty1
-                          : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                 ? dirty2
-                                 : ((age3 < age2 && age3 < age1 && age3 < age4) ? dirty3 : dirty4));
+            setMiss = oldest;
+
+            // The replaced line goes into the victim buffer, and the entry it
+            // overwrites is the one written back to the next level. An invalid
+            // way replaces nothing: the victim buffer is left as is.
+            isValid = false;
+            isDirty = false;
+            if (oldestValid) {
+              oldVal.range(TAG_SIZE + LINE_SIZE * 8 - 1, TAG_SIZE) = victimData[victimNext];
+              evictAddr = ((ap_uint<32>)victimAddr[victimNext]) << LOG_LINE_SIZE;
+              isValid   = victimValid[victimNext];
+              isDirty   = victimValid[victimNext] && victimDirty[victimNext];
+              if (isDirty)
+                numberWriteback++;
+
+              victimData[victimNext]  = oldestVal.range(TAG_SIZE + LINE_SIZE * 8 - 1, TAG_SIZE);
+              victimAddr[victimNext]  = (((ap_uint<32 - LOG_LINE_SIZE>)oldestVal.range(TAG_SIZE - 1, 0)) << LOG_SET_SIZE) | place;
+              victimValid[victimNext] = 1;
+              victimDirty[victimNext] = oldestDirty;
+              victimNext              = (victimNext == VICTIM_SIZE - 1) ? 0 : (int)(victimNext + 1);
+            }
+
             if(isDirty == 0){
              cacheState = STATE_CACHE_LAST_STORE - 1;
             }
             // printf("TAG is %x\n", oldVal.slc<TAG_SIZE>(0));
           }
 
-        //   ap_uint<32> oldAddress = (((int)oldVal.template slc<TAG_SIZE>(0)) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
-        //                                  (((int)place) << LOG_LINE_SIZE);
-          ap_uint<32> oldAddress = ((int)(oldVal.range(TAG_SIZE - 1, 0)) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
-                                   ((int)(place) << LOG_LINE_SIZE);
-
           // First we write back the four memory values in upper level
 
           if (cacheState >= STATE_CACHE_LAST_STORE) {
             // We store all values into next memory interface
-            nextLevelAddr   = oldAddress + (((int)(cacheState - STATE_CACHE_LAST_STORE)) << LOG_INTERFACE_SIZE);
+            nextLevelAddr   = evictAddr + (((int)(cacheState - STATE_CACHE_LAST_STORE)) << LOG_INTERFACE_SIZE);
             // nextLevelDataIn = oldVal.template slc<INTERFACE_SIZE * 8>(
             //     (cacheState - STATE_CACHE_LAST_STORE) * INTERFACE_SIZE * 8 + TAG_SIZE);
             nextLevelDataIn = oldVal.range(
@@ -511,14 +751,203 @@ public:
             }
             // printf("After Miss read %x at %x\n", (unsigned int)dataOut.slc<32>(0), (unsigned int)addr);
 
+            // Atomic operations allocate the line, then update it as a store hit
+            if (isAmo(opType)) {
+              newVal.range(TAG_SIZE + 4 * 8 * offset + 31, TAG_SIZE + 4 * 8 * offset) =
+                  amoResult(opType, dataOut.range(31, 0), dataIn.range(31, 0));
+              valStore = newVal;
+              valDirty = (WRITE_POLICY != WRITE_THROUGH);
+              if (WRITE_POLICY == WRITE_THROUGH)
+                pushWriteBuffer(addr & ~3, WORD, newVal.range(TAG_SIZE + 4 * 8 * offset + 31, TAG_SIZE + 4 * 8 * offset));
+            }
+
             dataOutStore = dataOut;
           }
         }
       }
+
+      // The next level is free: send the oldest buffered store
+      if (WRITE_POLICY != WRITE_BACK && cacheState == 0 && !flushing && writeBufferCount != 0) {
+        nextLevelAddr   = writeBufferAddr[writeBufferHead];
+        nextLevelDataIn = writeBufferData[writeBufferHead];
+        nextLevelMask   = writeBufferMask[writeBufferHead];
+        nextLevelOpType = STORE;
+        writeBufferHead++;
+        writeBufferCount--;
+      }
+    }
+
+    this->nextLevel->process(nextLevelAddr, nextLevelMask, nextLevelOpType, nextLevelDataIn, nextLevelDataOut,
+                             nextLevelWaitOut);
+    waitOut = nextLevelWaitOut || cacheState || wasStore || flushing || bufferBlocked || endAccess;
+  }
+
+  void pushWriteBuffer(ap_uint<32> addr, memMask mask, ap_uint<INTERFACE_SIZE * 8> data)
+  {
+    ap_uint<LOG_WRITE_BUFFER_SIZE> tail = writeBufferHead + writeBufferCount;
+    writeBufferAddr[tail]               = addr;
+    writeBufferMask[tail]               = mask;
+    writeBufferData[tail]               = data;
+    writeBufferCount++;
+  }
+
+  // One cycle of the flush: sends one word of the current dirty line to the next level,
+  // or moves to the next line when the current one is clean.
+  void flushStep(bool invalidate)
+  {
+    if (!flushing) {
+      flushing  = true;
+      flushLine = 0;
+      flushWord = 0;
+    }
+
+    nextLevelOpType = NONE;
+
+    if (flushLine == NB_LINES) {
+      // Every line has been visited, the last word was sent on previous cycle
+      flushing = false;
+      return;
+    }
+
+    bool inSets                          = flushLine < SET_SIZE * ASSOCIATIVITY;
+    ap_uint<LOG_SET_SIZE + 1> flushPlace = flushLine >> LOG_ASSOCIATIVITY;
+    ap_uint<LOG_ASSOCIATIVITY> flushSet  = flushLine.range(LOG_ASSOCIATIVITY - 1, 0);
+    ap_uint<LOG_VICTIM_SIZE + 1> flushVictim = flushLine - SET_SIZE * ASSOCIATIVITY;
+
+    ap_uint<1> lineValid, lineDirty;
+    ap_uint<LINE_SIZE * 8> lineData;
+    ap_uint<32> lineAddress;
+    if (inSets) {
+      ap_uint<LINE_SIZE * 8 + TAG_SIZE> val = cacheMemory[flushPlace][flushSet];
+      lineValid                             = dataValid[flushPlace][flushSet];
+      lineDirty                             = dirtyBit[flushPlace][flushSet];
+      lineData                              = val.range(TAG_SIZE + LINE_SIZE * 8 - 1, TAG_SIZE);
+      lineAddress = ((int)(val.range(TAG_SIZE - 1, 0)) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+                    ((int)(flushPlace) << LOG_LINE_SIZE);
+    } else {
+      lineValid   = victimValid[flushVictim];
+      lineDirty   = victimDirty[flushVictim];
+      lineData    = victimData[flushVictim];
+      lineAddress = ((ap_uint<32>)victimAddr[flushVictim]) << LOG_LINE_SIZE;
+    }
+
+    bool lineDone = true;
+    if (lineValid && lineDirty) {
+      nextLevelAddr   = lineAddress + (((int)flushWord) << LOG_INTERFACE_SIZE);
+      nextLevelDataIn = lineData.range(flushWord * INTERFACE_SIZE * 8 + INTERFACE_SIZE * 8 - 1,
+                                       flushWord * INTERFACE_SIZE * 8);
+      nextLevelOpType = STORE;
+      lineDone        = (flushWord == LINE_SIZE / INTERFACE_SIZE - 1);
+      flushWord       = lineDone ? 0 : (int)(flushWord + 1);
+    }
+
+    if (lineDone) {
+      if (lineValid && lineDirty)
+        numberWriteback++;
+      if (inSets) {
+        dirtyBit[flushPlace][flushSet] = 0;
+        if (invalidate) {
+          dataValid[flushPlace][flushSet] = 0;
+          age[flushPlace][flushSet]       = 0;
+        }
+      } else {
+        victimDirty[flushVictim] = 0;
+        if (invalidate)
+          victimValid[flushVictim] = 0;
+      }
+      flushLine++;
+    }
+  }
+
+  // Counts one access (a victim buffer hit is a hit). allocate is false for
+  // store misses which bypass the cache.
+  void recordAccess(ap_uint<32> addr, memOpType opType, bool miss, bool allocate)
+  {
+    if (opType == STORE || isAmo(opType)) {
+      numberWrite++;
+      numberWriteMiss += miss;
+    } else {
+      numberRead++;
+      numberReadMiss += miss;
+    }
+
+#ifndef __HLS__
+    const unsigned int place    = addr.range(LOG_LINE_SIZE + LOG_SET_SIZE - 1, LOG_LINE_SIZE);
+    const unsigned int lineAddr = addr.range(31, LOG_LINE_SIZE);
+    setAccessCount[place]++;
+
+    // Lookup in the shadow fully associative cache, which is then updated in LRU order
+    auto shadowLine  = shadowLines.find(lineAddr);
+    bool shadowHit   = shadowLine != shadowLines.end();
+    bool firstAccess = seenLines.insert(lineAddr).second;
+    if (shadowHit) {
+      shadowLru.erase(shadowLine->second);
+      shadowLines.erase(shadowLine);
+    }
+    if (allocate || shadowHit) {
+      shadowLru.push_front(lineAddr);
+      shadowLines[lineAddr] = shadowLru.begin();
+      if (shadowLru.size() > (unsigned int)NB_LINES) {
+        shadowLines.erase(shadowLru.back());
+        shadowLru.pop_back();
+      }
     }
 
-    this->nextLevel->process(nextLevelAddr, LONG, nextLevelOpType, nextLevelDataIn, nextLevelDataOut, nextLevelWaitOut);
-    waitOut = nextLevelWaitOut || cacheState || wasStore;
+    if (miss) {
+      setMissCount[place]++;
+      missPerPc[this->requestPc]++;
+      if (firstAccess)
+        numberCompulsory++;
+      else if (!shadowHit)
+        numberCapacity++;
+      else
+        numberConflict++;
+    }
+#else
+    // Only the host side classification uses them
+    (void)addr;
+    (void)allocate;
+#endif
+  }
+
+#ifndef __HLS__
+  // Prints the counters, the sets with accesses and the maxLines PCs with most misses
+  void printStats(FILE* out, int maxLines)
+  {
+    fprintf(out, "%lu accesses, %lu misses (%.2f%%), %lu victim buffer hits\n", numberAccess, numberMiss,
+            numberAccess ? 100.0 * numberMiss / numberAccess : 0.0, numberVictimHit);
+    fprintf(out, "  reads  %12lu, misses %12lu\n", numberRead, numberReadMiss);
+    fprintf(out, "  writes %12lu, misses %12lu\n", numberWrite, numberWriteMiss);
+    fprintf(out, "  writebacks %8lu\n", numberWriteback);
+    fprintf(out, "  compulsory %8lu, capacity %8lu, conflict %8lu\n", numberCompulsory, numberCapacity,
+            numberConflict);
+
+    fprintf(out, "\n   set      accesses        misses\n");
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++)
+      if (setAccessCount[oneSetElement] != 0)
+        fprintf(out, "%6d %13lu %13lu\n", oneSetElement, setAccessCount[oneSetElement], setMissCount[oneSetElement]);
+
+    std::vector<std::pair<unsigned long, unsigned int> > sortedPcs;
+    for (const auto& onePc : missPerPc)
+      sortedPcs.push_back(std::make_pair(onePc.second, onePc.first));
+    std::sort(sortedPcs.rbegin(), sortedPcs.rend());
+
+    fprintf(out, "\n        pc        misses\n");
+    for (int oneLine = 0; oneLine < (int)sortedPcs.size() && oneLine < maxLines; oneLine++)
+      fprintf(out, "  %08x %13lu\n", sortedPcs[oneLine].second, sortedPcs[oneLine].first);
+  }
+
+#endif
+
+  // Writes every dirty line back to the next level (and drops all lines when
+  // invalidate is set), for the host or at the end of a run of doCore. A miss
+  // still in flight is completed first.
+  void flush(bool invalidate)
+  {
+    ap_uint<INTERFACE_SIZE * 8> dummy;
+    bool wait = true;
+    while (wait)
+      process(0, WORD, invalidate ? FLUSH_INVALIDATE : FLUSH, 0, dummy, wait);
   }
 };
 
@@ -0,0 +1,135 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// Replays a memory trace (simulator -t) against many CacheMemory geometries,
+// one thread per configuration, and prints their statistics.
+//
+// g++ -O2 -pthread -I<vitis>/include cacheSweep.cpp -o cacheSweep
+// cacheSweep trace.dm [-j threads]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "cacheMemory.h"
+#include "memoryTrace.h"
+
+struct CacheResult {
+  unsigned long numberAccess, numberMiss, numberVictimHit;
+  unsigned long numberReadMiss, numberWriteMiss, numberWriteback;
+  unsigned long numberCompulsory, numberCapacity, numberConflict;
+};
+
+template <int LINE_SIZE, int SET_SIZE> CacheResult replay(const std::vector<TraceRecord>& trace)
+{
+  // The largest geometries do not fit on the stack of a thread
+  NullMemory<4> nextLevel;
+  typedef CacheMemory<4, LINE_SIZE, SET_SIZE> Cache;
+  std::unique_ptr<Cache> cache(new Cache(&nextLevel, false));
+
+  ap_uint<32> dataOut;
+  bool wait;
+  for (const TraceRecord& record : trace) {
+    do {
+      cache->process(record.addr, (memMask)record.mask, (memOpType)record.opType, 0, dataOut, wait);
+    } while (wait);
+  }
+
+  CacheResult result;
+  result.numberAccess     = cache->numberAccess;
+  result.numberMiss       = cache->numberMiss;
+  result.numberVictimHit  = cache->numberVictimHit;
+  result.numberReadMiss   = cache->numberReadMiss;
+  result.numberWriteMiss  = cache->numberWriteMiss;
+  result.numberWriteback  = cache->numberWriteback;
+  result.numberCompulsory = cache->numberCompulsory;
+  result.numberCapacity   = cache->numberCapacity;
+  result.numberConflict   = cache->numberConflict;
+  return result;
+}
+
+struct Configuration {
+  int lineSize, setSize;
+  CacheResult (*replay)(const std::vector<TraceRecord>&);
+};
+
+// Geometries are template parameters of CacheMemory, so the sweep is fixed at compile time.
+// LINE_SIZE is limited to 64 bytes by the width of cacheState.
+#define CONFIGURATIONS_FOR_SETS(SETS)                                                                                  \
+  {8, SETS, replay<8, SETS>}, {16, SETS, replay<16, SETS>}, {32, SETS, replay<32, SETS>}, {64, SETS, replay<64, SETS>}
+
+static const Configuration configurations[] = {
+    CONFIGURATIONS_FOR_SETS(4),   CONFIGURATIONS_FOR_SETS(8),    CONFIGURATIONS_FOR_SETS(16),
+    CONFIGURATIONS_FOR_SETS(32),  CONFIGURATIONS_FOR_SETS(64),   CONFIGURATIONS_FOR_SETS(128),
+    CONFIGURATIONS_FOR_SETS(256), CONFIGURATIONS_FOR_SETS(512),  CONFIGURATIONS_FOR_SETS(1024),
+    CONFIGURATIONS_FOR_SETS(2048), CONFIGURATIONS_FOR_SETS(4096), CONFIGURATIONS_FOR_SETS(8192)};
+
+static const int NB_CONFIGURATIONS = sizeof(configurations) / sizeof(Configuration);
+
+int main(int argc, char** argv)
+{
+  const char* tracePath = NULL;
+  int numberThreads     = std::thread::hardware_concurrency();
+
+  for (int oneArg = 1; oneArg < argc; oneArg++) {
+    if (!strcmp(argv[oneArg], "-j") && oneArg + 1 < argc)
+      numberThreads = atoi(argv[++oneArg]);
+    else if (tracePath == NULL && argv[oneArg][0] != '-')
+      tracePath = argv[oneArg];
+    else {
+      fprintf(stderr, "Usage: %s trace [-j threads]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (tracePath == NULL) {
+    fprintf(stderr, "Usage: %s trace [-j threads]\n", argv[0]);
+    return -1;
+  }
+  if (numberThreads < 1)
+    numberThreads = 1;
+
+  const std::vector<TraceRecord> trace = readTrace(tracePath);
+  fprintf(stderr, "%lu requests, %d configurations, %d threads\n", (unsigned long)trace.size(), NB_CONFIGURATIONS,
+          numberThreads);
+
+  // Threads take the next configuration to replay until all are done
+  std::vector<CacheResult> results(NB_CONFIGURATIONS);
+  std::atomic<int> nextConfiguration(0);
+  std::vector<std::thread> threads;
+  for (int oneThread = 0; oneThread < numberThreads; oneThread++)
+    threads.push_back(std::thread([&]() {
+      int configuration;
+      while ((configuration = nextConfiguration++) < NB_CONFIGURATIONS)
+        results[configuration] = configurations[configuration].replay(trace);
+    }));
+  for (std::thread& oneThread : threads)
+    oneThread.join();
+
+  printf("line  sets   size(B)      accesses        misses  miss(%%)  victimHits    readMiss   writeMiss  writebacks  "
+         "compulsory    capacity    conflict\n");
+  for (int oneConfiguration = 0; oneConfiguration < NB_CONFIGURATIONS; oneConfiguration++) {
+    const Configuration& configuration = configurations[oneConfiguration];
+    const CacheResult& result          = results[oneConfiguration];
+    printf("%4d %5d %9d %13lu %13lu %8.3f %11lu %11lu %11lu %11lu %11lu %11lu %11lu\n", configuration.lineSize,
+           configuration.setSize, configuration.lineSize * configuration.setSize * 4, result.numberAccess,
+           result.numberMiss, result.numberAccess ? 100.0 * result.numberMiss / result.numberAccess : 0.0,
+           result.numberVictimHit, result.numberReadMiss, result.numberWriteMiss, result.numberWriteback,
+           result.numberCompulsory, result.numberCapacity, result.numberConflict);
+  }
+  return 0;
+}
@@ -0,0 +1,430 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef INCLUDE_COHERENTCACHE_H_
+#define INCLUDE_COHERENTCACHE_H_
+
+#include "logarithm.h"
+#include "memoryInterface.h"
+// #include "ac_int.h"
+#include "ap_int.h"
+
+/************************************************************************
+ * 	Coherent data caches for several harts, kept by the MSI protocol on
+ * 	a snooping bus. Lines are:
+ * 		- MSI_INVALID
+ * 		- MSI_SHARED: clean, possibly in other caches
+ * 		- MSI_MODIFIED: dirty, in this cache only
+ * 	Hits (loads in S or M, stores in M) take one cycle. Other requests
+ * 	take the bus, which serves one cache at a time:
+ * 		- BusRd (load miss): a modified copy elsewhere goes back to shared
+ * 		- BusRdX (store or atomic miss): other copies are invalidated
+ * 		- BusUpgr (store hit in S): other copies are invalidated, no data
+ * 	A modified copy found by the snoop is written to the next level before
+ * 	the refill reads the line from it, then the replaced line is written
+ * 	back when it is modified. Every word takes one request on the next level.
+ * 	FENCE has nothing to flush: stores are visible to the other harts as
+ * 	soon as they are done.
+ ************************************************************************/
+typedef enum { MSI_INVALID = 0, MSI_SHARED, MSI_MODIFIED } msiState;
+
+template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE, int NB_CACHES> class CoherentCacheMemory;
+
+template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE, int NB_CACHES> class SnoopBus {
+  static const int LOG_LINE_SIZE = log2const<LINE_SIZE>::value;
+
+public:
+  MemoryInterface<INTERFACE_SIZE>* nextLevel; // shared by all caches
+  CoherentCacheMemory<INTERFACE_SIZE, LINE_SIZE, SET_SIZE, NB_CACHES>* caches[NB_CACHES];
+  int owner; // cache doing a transaction, -1 when the bus is free
+
+  // Coherence traffic
+  unsigned long numberBusRead, numberBusReadExclusive, numberBusUpgrade;
+  unsigned long numberInvalidation;   // copies invalidated in other caches
+  unsigned long numberIntervention;   // modified copies written back for another cache
+  unsigned long numberWriteback;      // modified lines replaced
+  unsigned long numberWaitCycles;     // cycles a cache waited for the bus
+
+  SnoopBus(MemoryInterface<INTERFACE_SIZE>* nextLevel = NULL)
+  {
+    this->nextLevel = nextLevel;
+    for (int oneCache = 0; oneCache < NB_CACHES; oneCache++)
+      caches[oneCache] = NULL;
+    owner                  = -1;
+    numberBusRead          = 0;
+    numberBusReadExclusive = 0;
+    numberBusUpgrade       = 0;
+    numberInvalidation     = 0;
+    numberIntervention     = 0;
+    numberWriteback        = 0;
+    numberWaitCycles       = 0;
+  }
+
+  // The bus is kept by the cache until release
+  bool acquire(const int id)
+  {
+    if (owner < 0)
+      owner = id;
+    if (owner != id)
+      numberWaitCycles++;
+    return owner == id;
+  }
+
+  void release() { owner = -1; }
+
+  // Every other cache snoops the transaction of cache id. Returns true when one of
+  // them had the line modified, its content is then in modifiedLine.
+  bool transaction(const int id, const ap_uint<32 - LOG_LINE_SIZE> lineAddr, const bool exclusive, const bool upgrade,
+                   ap_uint<LINE_SIZE * 8>& modifiedLine)
+  {
+    if (upgrade)
+      numberBusUpgrade++;
+    else if (exclusive)
+      numberBusReadExclusive++;
+    else
+      numberBusRead++;
+
+    bool modified = false;
+    for (int oneCache = 0; oneCache < NB_CACHES; oneCache++) {
+      if (oneCache == id || caches[oneCache] == NULL)
+        continue;
+      const ap_uint<2> state = caches[oneCache]->snoop(lineAddr, exclusive, modifiedLine);
+      if (state != MSI_INVALID && exclusive)
+        numberInvalidation++;
+      if (state == MSI_MODIFIED) {
+        numberIntervention++;
+        modified = true;
+      }
+    }
+    return modified;
+  }
+};
+
+template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE, int NB_CACHES>
+class CoherentCacheMemory : public MemoryInterface<INTERFACE_SIZE> {
+  static const int LOG_SET_SIZE      = log2const<SET_SIZE>::value;
+  static const int LOG_LINE_SIZE     = log2const<LINE_SIZE>::value;
+  static const int TAG_SIZE          = (32 - LOG_LINE_SIZE - LOG_SET_SIZE);
+  static const int ASSOCIATIVITY     = 4;
+  static const int LOG_ASSOCIATIVITY = 2;
+  static const int LINE_WORDS        = LINE_SIZE / 4;
+
+  // Steps of a miss, each one sends LINE_WORDS words on the next level
+  static const int STEP_INTERVENTION = 0;
+  static const int STEP_REFILL       = 1;
+  static const int STEP_WRITEBACK    = 2;
+
+public:
+  SnoopBus<INTERFACE_SIZE, LINE_SIZE, SET_SIZE, NB_CACHES>* bus;
+  int id;
+
+  ap_uint<LINE_SIZE * 8> lines[SET_SIZE][ASSOCIATIVITY];
+  ap_uint<TAG_SIZE> tags[SET_SIZE][ASSOCIATIVITY];
+  ap_uint<2> states[SET_SIZE][ASSOCIATIVITY]; // msiState
+  ap_uint<40> age[SET_SIZE][ASSOCIATIVITY];
+  ap_uint<40> cycle;
+
+  // Miss being served, the bus is held until its last step
+  bool missing;
+  ap_uint<32 - LOG_LINE_SIZE> missLine;
+  bool missWrite;
+  ap_uint<2> step;
+  ap_uint<LOG_LINE_SIZE + 1> stepWord;
+  bool interventionPending, writebackPending;
+  ap_uint<LINE_SIZE * 8> interventionLine, writebackLine;
+  ap_uint<32> writebackAddr;
+  ap_uint<LOG_ASSOCIATIVITY> missWay;
+
+  // Stats
+  unsigned long numberAccess, numberMiss, numberUpgrade, numberWriteback;
+  unsigned long numberSnoopInvalidated; // lines of this cache invalidated by the others
+
+  CoherentCacheMemory()
+  {
+    // Only 32 bits interfaces
+    assert(INTERFACE_SIZE == 4);
+
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
+      for (int oneWay = 0; oneWay < ASSOCIATIVITY; oneWay++) {
+        lines[oneSetElement][oneWay]  = 0;
+        tags[oneSetElement][oneWay]   = 0;
+        states[oneSetElement][oneWay] = MSI_INVALID;
+        age[oneSetElement][oneWay]    = 0;
+      }
+    }
+    bus                    = NULL;
+    id                     = 0;
+    cycle                  = 0;
+    missing                = false;
+    missLine               = 0;
+    missWrite              = false;
+    numberAccess           = 0;
+    numberMiss             = 0;
+    numberUpgrade          = 0;
+    numberWriteback        = 0;
+    numberSnoopInvalidated = 0;
+  }
+
+  // Connects the cache to the bus, as cache number id
+  void attach(SnoopBus<INTERFACE_SIZE, LINE_SIZE, SET_SIZE, NB_CACHES>* bus, const int id)
+  {
+    this->bus       = bus;
+    this->id        = id;
+    bus->caches[id] = this;
+  }
+
+  // Transaction of another cache on the bus: returns the state the line had here.
+  // A modified line is copied in modifiedLine.
+  ap_uint<2> snoop(const ap_uint<32 - LOG_LINE_SIZE> lineAddr, const bool exclusive,
+                   ap_uint<LINE_SIZE * 8>& modifiedLine)
+  {
+    const ap_uint<LOG_SET_SIZE> place = lineAddr.range(LOG_SET_SIZE - 1, 0);
+    const ap_uint<TAG_SIZE> tag       = lineAddr.range(31 - LOG_LINE_SIZE, LOG_SET_SIZE);
+
+    for (int oneWay = 0; oneWay < ASSOCIATIVITY; oneWay++) {
+      const ap_uint<2> state = states[place][oneWay];
+      if (state != MSI_INVALID && tags[place][oneWay] == tag) {
+        if (state == MSI_MODIFIED)
+          modifiedLine = lines[place][oneWay];
+        states[place][oneWay] = exclusive ? MSI_INVALID : MSI_SHARED;
+        numberSnoopInvalidated += exclusive;
+        return state;
+      }
+    }
+    return MSI_INVALID;
+  }
+
+  void process(const ap_uint<32> addr, const memMask mask, const memOpType opType,
+               const ap_uint<INTERFACE_SIZE * 8> dataIn, ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
+  {
+    // The ways of a set are read in the same cycle. The snoops of the other caches
+    // use the second port of lines and tags, states are registers.
+#pragma HLS ARRAY_PARTITION variable = lines dim = 2 complete
+#pragma HLS ARRAY_PARTITION variable = tags dim = 2 complete
+#pragma HLS ARRAY_PARTITION variable = states complete
+#pragma HLS ARRAY_PARTITION variable = age dim = 2 complete
+#pragma HLS BIND_STORAGE variable = lines type = ram_t2p impl = bram
+#pragma HLS BIND_STORAGE variable = tags type = ram_t2p impl = bram
+#pragma HLS BIND_STORAGE variable = age type = ram_s2p impl = lutram
+
+    cycle++;
+    waitOut    = false;
+    this->miss = false;
+
+    // Nothing to flush or drain, the caches are coherent
+    if (opType != LOAD && opType != STORE && !isAmo(opType))
+      return;
+
+    const ap_uint<LOG_SET_SIZE> place        = addr.range(LOG_LINE_SIZE + LOG_SET_SIZE - 1, LOG_LINE_SIZE);
+    const ap_uint<TAG_SIZE> tag              = addr.range(31, LOG_LINE_SIZE + LOG_SET_SIZE);
+    const ap_uint<32 - LOG_LINE_SIZE> lineAddr = addr.range(31, LOG_LINE_SIZE);
+    const bool write                         = (opType != LOAD);
+
+    bool hit                       = false;
+    ap_uint<LOG_ASSOCIATIVITY> way = 0;
+    for (int oneWay = 0; oneWay < ASSOCIATIVITY; oneWay++) {
+      if (states[place][oneWay] != MSI_INVALID && tags[place][oneWay] == tag) {
+        hit = true;
+        way = oneWay;
+      }
+    }
+
+    if (!missing) {
+      if (!hit || (write && states[place][way] != MSI_MODIFIED)) {
+        if (!bus->acquire(id)) {
+          waitOut = true;
+          return;
+        }
+        numberAccess++;
+
+        ap_uint<LINE_SIZE * 8> modifiedLine;
+        if (hit) {
+          // Upgrade: the other copies are shared, there is no data to move
+          numberUpgrade++;
+          bus->transaction(id, lineAddr, true, true, modifiedLine);
+          bus->release();
+          states[place][way] = MSI_MODIFIED;
+          access(place, way, addr, mask, opType, dataIn, dataOut);
+          return;
+        }
+
+        numberMiss++;
+        this->miss          = true;
+        interventionPending = bus->transaction(id, lineAddr, write, false, modifiedLine);
+        interventionLine    = modifiedLine;
+
+        // Replaced way: an invalid one, or the oldest
+        missWay = 0;
+        for (int oneWay = 1; oneWay < ASSOCIATIVITY; oneWay++) {
+          if (age[place][oneWay] < age[place][missWay])
+            missWay = oneWay;
+        }
+        for (int oneWay = ASSOCIATIVITY - 1; oneWay >= 0; oneWay--) {
+          if (states[place][oneWay] == MSI_INVALID)
+            missWay = oneWay;
+        }
+        writebackPending = (states[place][missWay] == MSI_MODIFIED);
+        writebackLine    = lines[place][missWay];
+        writebackAddr    = (((ap_uint<32>)tags[place][missWay]) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+                        (((ap_uint<32>)place) << LOG_LINE_SIZE);
+        states[place][missWay] = MSI_INVALID;
+        if (writebackPending) {
+          numberWriteback++;
+          bus->numberWriteback++;
+        }
+
+        missing   = true;
+        missLine  = lineAddr;
+        missWrite = write;
+        step      = interventionPending ? STEP_INTERVENTION : STEP_REFILL;
+        stepWord  = 0;
+      } else {
+        numberAccess++;
+        access(place, way, addr, mask, opType, dataIn, dataOut);
+        return;
+      }
+    }
+
+    if (missStep()) {
+      access(place, missWay, addr, mask, opType, dataIn, dataOut);
+      return;
+    }
+    waitOut = true;
+  }
+
+  // Writes every modified line back to the next level, for the host or at the
+  // end of a run of doCore. A miss cut by the end of the run is completed first:
+  // its line is installed, and the request is left to the core, which presents it
+  // again when it goes on.
+  void flush()
+  {
+    while (missing)
+      missStep();
+
+    ap_uint<INTERFACE_SIZE * 8> dummy;
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
+      for (int oneWay = 0; oneWay < ASSOCIATIVITY; oneWay++) {
+        if (states[oneSetElement][oneWay] != MSI_MODIFIED)
+          continue;
+        const ap_uint<32> lineBase =
+            (((ap_uint<32>)tags[oneSetElement][oneWay]) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+            (((ap_uint<32>)oneSetElement) << LOG_LINE_SIZE);
+        for (int oneWord = 0; oneWord < LINE_WORDS; oneWord++) {
+          bool wait = true;
+          while (wait)
+            bus->nextLevel->process(lineBase + (oneWord << 2), LONG, STORE,
+                                    lines[oneSetElement][oneWay].range(32 * oneWord + 31, 32 * oneWord), dummy, wait);
+        }
+        states[oneSetElement][oneWay] = MSI_SHARED;
+      }
+    }
+  }
+
+private:
+  // One word of the current step of the miss. Returns true when the line is
+  // installed and the bus released.
+  bool missStep()
+  {
+    const ap_uint<LOG_SET_SIZE> place = missLine.range(LOG_SET_SIZE - 1, 0);
+    const ap_uint<TAG_SIZE> tag       = missLine.range(31 - LOG_LINE_SIZE, LOG_SET_SIZE);
+    const ap_uint<32> lineBase        = ((ap_uint<32>)missLine) << LOG_LINE_SIZE;
+    ap_uint<INTERFACE_SIZE * 8> nextLevelDataOut;
+    bool nextLevelWait = false;
+    if (step == STEP_INTERVENTION) {
+      bus->nextLevel->process(lineBase + (stepWord << 2), LONG, STORE,
+                              interventionLine.range(32 * stepWord + 31, 32 * stepWord), nextLevelDataOut,
+                              nextLevelWait);
+    } else if (step == STEP_REFILL) {
+      bus->nextLevel->process(lineBase + (stepWord << 2), LONG, LOAD, 0, nextLevelDataOut, nextLevelWait);
+      if (!nextLevelWait)
+        lines[place][missWay].range(32 * stepWord + 31, 32 * stepWord) = nextLevelDataOut;
+    } else {
+      bus->nextLevel->process(writebackAddr + (stepWord << 2), LONG, STORE,
+                              writebackLine.range(32 * stepWord + 31, 32 * stepWord), nextLevelDataOut, nextLevelWait);
+    }
+
+    if (!nextLevelWait) {
+      stepWord++;
+      if (stepWord == LINE_WORDS) {
+        stepWord = 0;
+        if (step == STEP_INTERVENTION) {
+          step = STEP_REFILL;
+        } else if (step == STEP_REFILL) {
+          // The line is usable, the replaced one is still to be written back
+          tags[place][missWay]   = tag;
+          states[place][missWay] = missWrite ? MSI_MODIFIED : MSI_SHARED;
+          step                   = STEP_WRITEBACK;
+          if (!writebackPending) {
+            missing = false;
+            bus->release();
+            return true;
+          }
+        } else {
+          missing = false;
+          bus->release();
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Access to a line held with the right state
+  void access(const ap_uint<LOG_SET_SIZE> place, const ap_uint<LOG_ASSOCIATIVITY> way, const ap_uint<32> addr,
+              const memMask mask, const memOpType opType, const ap_uint<INTERFACE_SIZE * 8> dataIn,
+              ap_uint<INTERFACE_SIZE * 8>& dataOut)
+  {
+    const ap_uint<LOG_LINE_SIZE> offset = addr.range(LOG_LINE_SIZE - 1, 2);
+    const ap_uint<32> word              = lines[place][way].range(32 * offset + 31, 32 * offset);
+    const int shift                     = ((int)addr.range(1, 0)) << 3;
+    age[place][way]                     = cycle;
+
+    if (opType == LOAD) {
+      switch (mask) {
+        case BYTE:
+          dataOut = (ap_int<8>)word.range(shift + 7, shift);
+          break;
+        case BYTE_U:
+          dataOut = word.range(shift + 7, shift);
+          break;
+        case HALF:
+          dataOut = (ap_int<16>)word.range(shift + 15, shift);
+          break;
+        case HALF_U:
+          dataOut = word.range(shift + 15, shift);
+          break;
+        default:
+          dataOut = word;
+          break;
+      }
+      return;
+    }
+
+    ap_uint<32> newWord = word;
+    if (isAmo(opType)) {
+      dataOut = word;
+      newWord = amoResult(opType, word, dataIn);
+    } else if (mask == BYTE || mask == BYTE_U) {
+      newWord.range(shift + 7, shift) = dataIn.range(7, 0);
+    } else if (mask == HALF || mask == HALF_U) {
+      newWord.range(shift + 15, shift) = dataIn.range(15, 0);
+    } else {
+      newWord = dataIn;
+    }
+    lines[place][way].range(32 * offset + 31, 32 * offset) = newWord;
+  }
+};
+
+#endif /* INCLUDE_COHERENTCACHE_H_ */
@@ -19,18 +19,160 @@
 #include "core.h"
 
 
+ap_uint<32> readCsr(const struct CSR& csr, const ap_uint<12> address)
+{
+#pragma HLS INLINE
+  switch (address) {
+    case RISCV_CSR_MCYCLE:
+    case RISCV_CSR_CYCLE:
+      return csr.mcycle.range(31, 0);
+    case RISCV_CSR_MCYCLEH:
+    case RISCV_CSR_CYCLEH:
+      return csr.mcycle.range(63, 32);
+    case RISCV_CSR_MINSTRET:
+    case RISCV_CSR_INSTRET:
+      return csr.minstret.range(31, 0);
+    case RISCV_CSR_MINSTRETH:
+    case RISCV_CSR_INSTRETH:
+      return csr.minstret.range(63, 32);
+    case RISCV_CSR_MCOUNTINHIBIT:
+      return csr.mcountinhibit;
+    case RISCV_CSR_MSCRATCH:
+      return csr.mscratch;
+    case RISCV_CSR_MISA:
+      return COMPRESSED_ISA ? 0x40000105 : 0x40000101; // RV32IAC, RV32IA
+    case RISCV_CSR_MHARTID:
+      return csr.mhartid;
+  }
+
+  // Performance counters, from the machine or the user address space
+  const ap_uint<12> counter = address.range(6, 0) - 3;
+  if (counter < NB_HPM_EVENTS) {
+    switch (address.range(11, 7)) {
+      case (RISCV_CSR_MHPMCOUNTER3 >> 7):
+      case (RISCV_CSR_HPMCOUNTER3 >> 7):
+        return csr.mhpmcounter[counter].range(31, 0);
+      case (RISCV_CSR_MHPMCOUNTER3H >> 7):
+      case (RISCV_CSR_HPMCOUNTER3H >> 7):
+        return csr.mhpmcounter[counter].range(63, 32);
+    }
+  }
+  return 0;
+}
+
+void writeCsr(struct CSR& csr, const ap_uint<12> address, const ap_uint<32> value)
+{
+#pragma HLS INLINE
+  switch (address) {
+    case RISCV_CSR_MCYCLE:
+      csr.mcycle.range(31, 0) = value;
+      return;
+    case RISCV_CSR_MCYCLEH:
+      csr.mcycle.range(63, 32) = value;
+      return;
+    case RISCV_CSR_MINSTRET:
+      csr.minstret.range(31, 0) = value;
+      return;
+    case RISCV_CSR_MINSTRETH:
+      csr.minstret.range(63, 32) = value;
+      return;
+    case RISCV_CSR_MCOUNTINHIBIT:
+      csr.mcountinhibit = value;
+      return;
+    case RISCV_CSR_MSCRATCH:
+      csr.mscratch = value;
+      return;
+  }
+
+  // User counters are read only
+  const ap_uint<12> counter = address.range(6, 0) - 3;
+  if (counter < NB_HPM_EVENTS) {
+    if (address.range(11, 7) == (RISCV_CSR_MHPMCOUNTER3 >> 7))
+      csr.mhpmcounter[counter].range(31, 0) = value;
+    else if (address.range(11, 7) == (RISCV_CSR_MHPMCOUNTER3H >> 7))
+      csr.mhpmcounter[counter].range(63, 32) = value;
+  }
+}
+
 void fetch(const ap_uint<32> pc, struct FtoDC& ftoDC, const ap_uint<32> instruction)
 {
+#pragma HLS INLINE
   ftoDC.instruction = instruction;
+  ftoDC.compressed  = 0;
   ftoDC.pc          = pc;
   ftoDC.nextPCFetch = pc + 4;
+  ftoDC.bubble      = CYCLE_BUBBLE;
   ftoDC.we          = 1;
 }
 
-void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> registerFile[32])
+#if COMPRESSED_ISA
+// Word to read for the instruction at pc: the word of pc, or the next one when the
+// instruction starts in the upper half of a word which is in the buffer
+ap_uint<32> fetchWordAddress(const ap_uint<32> pc, const struct FetchBuffer& buffer)
+{
+#pragma HLS INLINE
+  ap_uint<32> address = pc;
+  address.range(1, 0) = 0;
+  if (pc[1] && buffer.valid && buffer.address == pc)
+    address += 4;
+  return address;
+}
+
+// Fetch of the instruction at pc from the word read at fetchWordAddress and the
+// buffer, which takes the upper half of the word. A 32 bits instruction which
+// straddles two words while its first half is not in the buffer (after a jump)
+// takes a second read: the first one only fills the buffer, and fetch sends a
+// bubble and stays at pc.
+void alignFetch(const ap_uint<32> pc, const struct FetchBuffer& buffer, const ap_uint<32> word, struct FtoDC& ftoDC,
+                struct FetchBuffer& nextBuffer)
+{
+#pragma HLS INLINE
+  const bool fromBuffer = pc[1] && buffer.valid && buffer.address == pc;
+  ap_uint<32> instruction;
+  if (fromBuffer) {
+    instruction.range(15, 0)  = buffer.half;
+    instruction.range(31, 16) = word.range(15, 0);
+  } else if (pc[1]) {
+    instruction.range(15, 0)  = word.range(31, 16);
+    instruction.range(31, 16) = 0;
+  } else {
+    instruction = word;
+  }
+  const bool compressed = RISCV_IS_COMPRESSED(instruction);
+
+  fetch(pc, ftoDC, instruction);
+  ftoDC.compressed  = compressed;
+  ftoDC.nextPCFetch = pc + (compressed ? 2 : 4);
+
+  nextBuffer      = buffer;
+  nextBuffer.half = word.range(31, 16);
+  if (!pc[1] && compressed) {
+    nextBuffer.valid   = true;
+    nextBuffer.address = pc + 2;
+  } else if (fromBuffer && !compressed) {
+    nextBuffer.valid   = true;
+    nextBuffer.address = pc + 4;
+  } else if (pc[1] && !fromBuffer && !compressed) {
+    nextBuffer.valid   = true;
+    nextBuffer.address = pc;
+    ftoDC.we           = 0;
+    ftoDC.nextPCFetch  = pc;
+  } else {
+    nextBuffer.half = buffer.half;
+  }
+}
+#endif
+
+void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const RegisterFile& registerFile, const struct CSR& csr)
 {
-  const ap_uint<32> pc          = ftoDC.pc;
+#pragma HLS INLINE
+  const ap_uint<32> pc = ftoDC.pc;
+#if COMPRESSED_ISA
+  const ap_uint<32> instruction = ftoDC.compressed ? expandCompressed(ftoDC.instruction.range(15, 0))
+                                                   : ftoDC.instruction;
+#else
   const ap_uint<32> instruction = ftoDC.instruction;
+#endif
 
   // R-type instruction
 //   const ap_uint<7> funct7 = instruction.slc<7>(25);
@@ -77,7 +219,7 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> re
 
   ap_uint<21> imm21_1 = 0;
 //   imm21_1.set_slc(12, instruction.slc<8>(12));
-  imm21_1.range(20, 12) = instruction.range(31, 24); // Copy bits [31:24] to imm21_1[20:12]
+  imm21_1.range(19, 12) = instruction.range(19, 12); // Copy bits [19:12] to imm21_1[19:12]
   imm21_1[11] = instruction[20];
 //   imm21_1.set_slc(1, instruction.slc<10>(21));
   imm21_1.range(10, 1) = instruction.range(30, 21);  // Copy bits [30:21] to imm21_1[10:1]
@@ -88,8 +230,8 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> re
   imm21_1_signed.range(20, 0) = imm21_1.range(20, 0); // Copy all 21 bits from imm21_1 to imm21_1_signed
 
   // Register access
-  const ap_uint<32> valueReg1 = registerFile[rs1];
-  const ap_uint<32> valueReg2 = registerFile[rs2];
+  const ap_uint<32> valueReg1 = registerFile.read1(rs1);
+  const ap_uint<32> valueReg2 = registerFile.read2(rs2);
 
   dctoEx.rs1         = rs1;
   dctoEx.rs2         = rs2;
@@ -106,6 +248,7 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> re
   dctoEx.useRs2   = 0;
   dctoEx.useRd    = 0;
   dctoEx.we       = ftoDC.we;
+  dctoEx.bubble   = ftoDC.bubble;
   dctoEx.isBranch = 0;
 
   switch (opCode) {
@@ -126,7 +269,7 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> re
       dctoEx.useRd  = 1;
       break;
     case RISCV_JAL:
-      dctoEx.lhs      = ftoDC.pc + 4;
+      dctoEx.lhs      = ftoDC.nextPCFetch; // link, after a 16 or 32 bits instruction
       dctoEx.rhs      = 0;
       dctoEx.nextPCDC = ftoDC.pc + imm21_1_signed;
       dctoEx.useRs1   = 0;
@@ -139,6 +282,7 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> re
     case RISCV_JALR:
       dctoEx.lhs    = valueReg1;
       dctoEx.rhs    = imm12_I_signed;
+      dctoEx.datac  = ftoDC.nextPCFetch; // link
       dctoEx.useRs1 = 1;
       dctoEx.useRs2 = 0;
       dctoEx.useRs3 = 0;
@@ -198,9 +342,42 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> re
 
       break;
     case RISCV_SYSTEM:
-
-
+      // The csr is read in lhs, and rs1 (or its 5 bits immediate) goes to rhs:
+      // rs1 is declared as rs2 so that the forward unit sends its value to rhs
+      dctoEx.lhs    = readCsr(csr, instruction.range(31, 20));
+      dctoEx.useRs1 = 0;
+      dctoEx.useRs3 = 0;
+      if (funct3[2]) {
+        dctoEx.rhs    = rs1;
+        dctoEx.useRs2 = 0;
+      } else {
+        dctoEx.rhs    = valueReg1;
+        dctoEx.rs2    = rs1;
+        dctoEx.useRs2 = 1;
+      }
+      dctoEx.useRd = (funct3 != RISCV_SYSTEM_ENV);
+      break;
+    case RISCV_ATOMIC:
+      // Address in lhs, value for SC and AMOs in datac, as for a store
+      dctoEx.lhs    = valueReg1;
+      dctoEx.rhs    = 0;
+      dctoEx.datac  = valueReg2;
+      dctoEx.useRs1 = 1;
+      dctoEx.useRs2 = 0;
+      dctoEx.useRs3 = 1;
+      dctoEx.useRd  = 1;
       break;
+#if CUSTOM_ACCELERATOR
+    case RISCV_CUSTOM0:
+    case RISCV_CUSTOM1:
+      dctoEx.lhs    = valueReg1;
+      dctoEx.rhs    = valueReg2;
+      dctoEx.useRs1 = 1;
+      dctoEx.useRs2 = 1;
+      dctoEx.useRs3 = 0;
+      dctoEx.useRd  = 1;
+      break;
+#endif
     default:
 
       break;
@@ -223,15 +400,19 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ap_int<32> re
 
 void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
 {
+#pragma HLS INLINE
   extoMem.pc                = dctoEx.pc;
   extoMem.opCode            = dctoEx.opCode;
   extoMem.rd                = dctoEx.rd;
   extoMem.funct3            = dctoEx.funct3;
   extoMem.we                = dctoEx.we;
+  extoMem.bubble            = dctoEx.bubble;
   extoMem.isBranch          = 0;
   extoMem.useRd             = dctoEx.useRd;
   extoMem.isLongInstruction = 0;
   extoMem.instruction       = dctoEx.instruction;
+  extoMem.isCsrWrite        = 0;
+  extoMem.csr               = dctoEx.instruction.range(31, 20);
 
   // switch must be in the else, otherwise external op may trigger default
   // case
@@ -244,16 +425,15 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
       break;
     case RISCV_JAL:
       // Note: in current version, the addition is made in the decode stage
-      // The value to store in rd (pc+4) is stored in lhs
+      // The value to store in rd (the pc of the next instruction) is stored in lhs
       extoMem.result = dctoEx.lhs;
       break;
     case RISCV_JALR:
-      // Note: in current version, the addition is made in the decode stage
-      // The value to store in rd (pc+4) is stored in lhs
+      // The value to store in rd (the pc of the next instruction) is stored in datac
       extoMem.nextPC   = dctoEx.rhs + dctoEx.lhs;
       extoMem.isBranch = 1;
 
-      extoMem.result = dctoEx.pc + 4;
+      extoMem.result = dctoEx.datac;
       break;
     case RISCV_BR:
       extoMem.nextPC = dctoEx.pc + dctoEx.datac;
@@ -364,6 +544,19 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
     case RISCV_MISC_MEM: // this does nothing because all memory accesses are
                          // ordered, and we have only one core
       break;
+    case RISCV_ATOMIC: // the value comes from the memory stage
+      extoMem.isLongInstruction = 1;
+      extoMem.datac             = dctoEx.datac;
+      extoMem.result            = dctoEx.lhs;
+      break;
+#if CUSTOM_ACCELERATOR
+    case RISCV_CUSTOM0: // the value comes from the accelerator, in the memory stage
+    case RISCV_CUSTOM1:
+      extoMem.isLongInstruction = 1;
+      extoMem.datac             = dctoEx.rhs;
+      extoMem.result            = dctoEx.lhs;
+      break;
+#endif
 
     case RISCV_SYSTEM:
       switch (dctoEx.funct3) { // case 0: mret instruction, dctoEx.memValue
@@ -376,28 +569,34 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
 #endif
           break;
         case RISCV_SYSTEM_CSRRW:       // lhs is from csr, rhs is from reg[rs1]
-          extoMem.datac  = dctoEx.rhs; // written back to csr
-          extoMem.result = dctoEx.lhs; // written back to rd
+          extoMem.datac      = dctoEx.rhs; // written back to csr
+          extoMem.result     = dctoEx.lhs; // written back to rd
+          extoMem.isCsrWrite = 1;
           break;
         case RISCV_SYSTEM_CSRRS:
-          extoMem.datac  = dctoEx.lhs | dctoEx.rhs;
-          extoMem.result = dctoEx.lhs;
+          extoMem.datac      = dctoEx.lhs | dctoEx.rhs;
+          extoMem.result     = dctoEx.lhs;
+          extoMem.isCsrWrite = (dctoEx.rs1 != 0); // csrr does not write the csr
           break;
         case RISCV_SYSTEM_CSRRC:
-          extoMem.datac  = dctoEx.lhs & ((ap_uint<32>)~dctoEx.rhs);
-          extoMem.result = dctoEx.lhs;
+          extoMem.datac      = dctoEx.lhs & ((ap_uint<32>)~dctoEx.rhs);
+          extoMem.result     = dctoEx.lhs;
+          extoMem.isCsrWrite = (dctoEx.rs1 != 0);
           break;
         case RISCV_SYSTEM_CSRRWI:
-          extoMem.datac  = dctoEx.rhs;
-          extoMem.result = dctoEx.lhs;
+          extoMem.datac      = dctoEx.rhs;
+          extoMem.result     = dctoEx.lhs;
+          extoMem.isCsrWrite = 1;
           break;
         case RISCV_SYSTEM_CSRRSI:
-          extoMem.datac  = dctoEx.lhs | dctoEx.rhs;
-          extoMem.result = dctoEx.lhs;
+          extoMem.datac      = dctoEx.lhs | dctoEx.rhs;
+          extoMem.result     = dctoEx.lhs;
+          extoMem.isCsrWrite = (dctoEx.rs1 != 0);
           break;
         case RISCV_SYSTEM_CSRRCI:
-          extoMem.datac  = dctoEx.lhs & ((ap_uint<32>)~dctoEx.rhs);
-          extoMem.result = dctoEx.lhs;
+          extoMem.datac      = dctoEx.lhs & ((ap_uint<32>)~dctoEx.rhs);
+          extoMem.result     = dctoEx.lhs;
+          extoMem.isCsrWrite = (dctoEx.rs1 != 0);
           break;
       }
       break;
@@ -405,14 +604,18 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
 
   // If the instruction was dropped, we ensure that isBranch is at zero
   if (!dctoEx.we) {
-    extoMem.isBranch = 0;
-    extoMem.useRd    = 0;
+    extoMem.isBranch   = 0;
+    extoMem.useRd      = 0;
+    extoMem.isCsrWrite = 0;
   }
 }
 
 void memory(const struct ExtoMem extoMem, struct MemtoWB& memtoWB)
 {
+#pragma HLS INLINE
+  memtoWB.pc                = extoMem.pc;
   memtoWB.we                = extoMem.we;
+  memtoWB.bubble            = extoMem.bubble;
   memtoWB.useRd             = extoMem.useRd;
   memtoWB.result            = extoMem.result;
   memtoWB.rd                = extoMem.rd;
@@ -437,12 +640,92 @@ void memory(const struct ExtoMem extoMem, struct MemtoWB& memtoWB)
       memtoWB.byteEnable   = 0xf;
 
       break;
+    case RISCV_MISC_MEM:
+      // FENCE makes previous stores visible in memory: the stores buffered by the
+      // data memory are drained. Dirty lines are written back by the top level.
+      memtoWB.isFence = 1;
+      break;
+    case RISCV_SYSTEM:
+      memtoWB.isSyscall = (extoMem.instruction.range(31, 7) == 0); // ecall
+      break;
+    case RISCV_ATOMIC: {
+      const ap_uint<5> funct5 = extoMem.instruction.range(31, 27);
+      memtoWB.address         = extoMem.result;
+      memtoWB.valueToWrite    = extoMem.datac;
+      memtoWB.byteEnable      = 0xf;
+      memtoWB.funct5          = funct5;
+      memtoWB.isLoad          = (funct5 == RISCV_ATOMIC_LR);
+      memtoWB.isReserve       = (funct5 == RISCV_ATOMIC_LR);
+      memtoWB.isStore         = (funct5 == RISCV_ATOMIC_SC);
+      memtoWB.isConditional   = (funct5 == RISCV_ATOMIC_SC);
+      memtoWB.isAmo           = (funct5 != RISCV_ATOMIC_LR && funct5 != RISCV_ATOMIC_SC);
+      break;
+    }
+#if CUSTOM_ACCELERATOR
+    case RISCV_CUSTOM0:
+    case RISCV_CUSTOM1:
+      memtoWB.isCustom     = 1;
+      memtoWB.address      = extoMem.result;
+      memtoWB.valueToWrite = extoMem.datac;
+      memtoWB.instruction  = extoMem.instruction;
+      break;
+#endif
+  }
+}
+
+// Request sent to the data memory for an atomic operation
+memOpType amoOpType(const ap_uint<5> funct5)
+{
+#pragma HLS INLINE
+  switch (funct5) {
+    case RISCV_ATOMIC_ADD:
+      return AMO_ADD;
+    case RISCV_ATOMIC_XOR:
+      return AMO_XOR;
+    case RISCV_ATOMIC_AND:
+      return AMO_AND;
+    case RISCV_ATOMIC_OR:
+      return AMO_OR;
+    case RISCV_ATOMIC_MIN:
+      return AMO_MIN;
+    case RISCV_ATOMIC_MAX:
+      return AMO_MAX;
+    case RISCV_ATOMIC_MINU:
+      return AMO_MINU;
+    case RISCV_ATOMIC_MAXU:
+      return AMO_MAXU;
+    default:
+      return AMO_SWAP;
+  }
+}
+
+// Size and sign extension of a load or store, from its funct3
+memMask memoryMask(const ap_uint<3> funct3)
+{
+#pragma HLS INLINE
+  switch (funct3) {
+    case 0:
+      return BYTE;
+    case 1:
+      return HALF;
+    case 2:
+      return WORD;
+    case 4:
+      return BYTE_U;
+    case 5:
+      return HALF_U;
+    // Should NEVER happen
+    default:
+      return WORD;
   }
 }
 
 void writeback(const struct MemtoWB memtoWB, struct WBOut& wbOut)
 {
-  wbOut.we = memtoWB.we;
+#pragma HLS INLINE
+  wbOut.we        = memtoWB.we;
+  wbOut.bubble    = memtoWB.bubble;
+  wbOut.isSyscall = memtoWB.we && memtoWB.isSyscall;
   if ((memtoWB.rd != 0) && (memtoWB.we) && memtoWB.useRd) {
     wbOut.rd    = memtoWB.rd;
     wbOut.value = memtoWB.result;
@@ -452,17 +735,21 @@ void writeback(const struct MemtoWB memtoWB, struct WBOut& wbOut)
 
 void branchUnit(const ap_uint<32> nextPC_fetch, const ap_uint<32> nextPC_decode, const bool isBranch_decode,
                 const ap_uint<32> nextPC_execute, const bool isBranch_execute, ap_uint<32>& pc, bool& we_fetch,
-                bool& we_decode, const bool stall_fetch)
+                bool& we_decode, ap_uint<4>& bubble_fetch, ap_uint<4>& bubble_decode, const bool stall_fetch)
 {
+#pragma HLS INLINE
 
   if (!stall_fetch) {
     if (isBranch_execute) {
-      we_fetch  = 0;
-      we_decode = 0;
-      pc        = nextPC_execute;
+      we_fetch      = 0;
+      we_decode     = 0;
+      bubble_fetch  = CYCLE_BRANCH_EXECUTE;
+      bubble_decode = CYCLE_BRANCH_EXECUTE;
+      pc            = nextPC_execute;
     } else if (isBranch_decode) {
-      we_fetch = 0;
-      pc       = nextPC_decode;
+      we_fetch     = 0;
+      bubble_fetch = CYCLE_BRANCH_DECODE;
+      pc           = nextPC_decode;
     } else {
       pc = nextPC_fetch;
     }
@@ -475,9 +762,9 @@ void forwardUnit(const ap_uint<5> decodeRs1, const bool decodeUseRs1,
                  const ap_uint<5> executeRd, const bool executeUseRd,
                  const bool executeIsLongComputation,
                  const ap_uint<5> memoryRd, const bool memoryUseRd,
-                 const ap_uint<5> writebackRd, const bool writebackUseRd,
                  bool stall[5], struct ForwardReg& forwardRegisters)
 {
+#pragma HLS INLINE
 
   if (decodeUseRs1) {
     if (executeUseRd && decodeRs1 == executeRd) {
@@ -489,8 +776,6 @@ void forwardUnit(const ap_uint<5> decodeRs1, const bool decodeUseRs1,
       }
     } else if (memoryUseRd && decodeRs1 == memoryRd) {
       forwardRegisters.forwardMemtoVal1 = 1;
-    } else if (writebackUseRd && decodeRs1 == writebackRd) {
-      forwardRegisters.forwardWBtoVal1 = 1;
     }
   }
 
@@ -504,8 +789,6 @@ void forwardUnit(const ap_uint<5> decodeRs1, const bool decodeUseRs1,
       }
     } else if (memoryUseRd && decodeRs2 == memoryRd)
       forwardRegisters.forwardMemtoVal2 = 1;
-    else if (writebackUseRd && decodeRs2 == writebackRd)
-      forwardRegisters.forwardWBtoVal2 = 1;
   }
 
   if (decodeUseRs3) {
@@ -518,14 +801,84 @@ void forwardUnit(const ap_uint<5> decodeRs1, const bool decodeUseRs1,
       }
     } else if (memoryUseRd && decodeRs3 == memoryRd)
       forwardRegisters.forwardMemtoVal3 = 1;
-    else if (writebackUseRd && decodeRs3 == writebackRd)
-      forwardRegisters.forwardWBtoVal3 = 1;
   }
 }
 
+#ifndef __HLS__
+// Operands which decode read through the bypass of the register file and which
+// are not forwarded from execute or memory, they are the forwards from writeback
+// of the pipeline trace (bits 6 to 8)
+static unsigned short registerBypasses(const RegisterFile& registerFile, const struct DCtoEx& dctoEx,
+                                       const struct ForwardReg& forwards)
+{
+  return ((dctoEx.useRs1 && registerFile.bypassed(dctoEx.rs1) && !forwards.forwardExtoVal1 &&
+           !forwards.forwardMemtoVal1) << 6) |
+         ((dctoEx.useRs2 && registerFile.bypassed(dctoEx.rs2) && !forwards.forwardExtoVal2 &&
+           !forwards.forwardMemtoVal2) << 7) |
+         ((dctoEx.useRs3 && registerFile.bypassed(dctoEx.rs3) && !forwards.forwardExtoVal3 &&
+           !forwards.forwardMemtoVal3) << 8);
+}
+#endif
+
+// Outputs of the stages before they run: nothing is valid and nothing is forwarded
+static void initStageOutputs(struct FtoDC& ftoDC_temp, struct DCtoEx& dctoEx_temp, struct ExtoMem& extoMem_temp,
+                             struct MemtoWB& memtoWB_temp, struct WBOut& wbOut_temp,
+                             struct ForwardReg& forwardRegisters)
+{
+#pragma HLS INLINE
+  ftoDC_temp.pc          = 0;
+  ftoDC_temp.instruction = 0;
+  ftoDC_temp.nextPCFetch = 0;
+  ftoDC_temp.we          = 0;
+
+  dctoEx_temp.isBranch = 0;
+  dctoEx_temp.useRs1   = 0;
+  dctoEx_temp.useRs2   = 0;
+  dctoEx_temp.useRs3   = 0;
+  dctoEx_temp.useRd    = 0;
+  dctoEx_temp.we       = 0;
+
+  extoMem_temp.useRd      = 0;
+  extoMem_temp.isBranch   = 0;
+  extoMem_temp.we         = 0;
+  extoMem_temp.isCsrWrite = 0;
+
+  memtoWB_temp.useRd         = 0;
+  memtoWB_temp.isStore       = 0;
+  memtoWB_temp.we            = 0;
+  memtoWB_temp.isLoad        = 0;
+  memtoWB_temp.isFence       = 0;
+  memtoWB_temp.isSyscall     = 0;
+  memtoWB_temp.isReserve     = 0;
+  memtoWB_temp.isConditional = 0;
+  memtoWB_temp.isAmo         = 0;
+  memtoWB_temp.isCustom      = 0;
+
+  wbOut_temp.useRd     = 0;
+  wbOut_temp.we        = 0;
+  wbOut_temp.rd        = 0;
+  wbOut_temp.isSyscall = 0;
+
+  forwardRegisters.forwardExtoVal1  = 0;
+  forwardRegisters.forwardExtoVal2  = 0;
+  forwardRegisters.forwardExtoVal3  = 0;
+  forwardRegisters.forwardMemtoVal1 = 0;
+  forwardRegisters.forwardMemtoVal2 = 0;
+  forwardRegisters.forwardMemtoVal3 = 0;
+}
+
 void doCycle(struct Core& core, // Core containing all values
              bool globalStall)
 {
+#pragma HLS INLINE
+  // Each bank of the register file is a LUTRAM with a read and a write port. The
+  // other arrays of the core are accessed at several indexes in the same cycle:
+  // they are registers, not memories
+#pragma HLS BIND_STORAGE variable = core.regFile.bank1 type = ram_s2p impl = lutram
+#pragma HLS BIND_STORAGE variable = core.regFile.bank2 type = ram_s2p impl = lutram
+#pragma HLS ARRAY_PARTITION variable = core.stallSignals complete
+#pragma HLS ARRAY_PARTITION variable = core.cycleClasses complete
+#pragma HLS ARRAY_PARTITION variable = core.csr.mhpmcounter complete
   // printf("PC : %x\n", core.pc);
   bool localStall = globalStall;
 
@@ -539,91 +892,115 @@ void doCycle(struct Core& core, // Core containing all values
 
   // declare temporary structs
   struct FtoDC ftoDC_temp;
-  ftoDC_temp.pc          = 0;
-  ftoDC_temp.instruction = 0;
-  ftoDC_temp.nextPCFetch = 0;
-  ftoDC_temp.we          = 0;
   struct DCtoEx dctoEx_temp;
-  dctoEx_temp.isBranch = 0;
-  dctoEx_temp.useRs1   = 0;
-  dctoEx_temp.useRs2   = 0;
-  dctoEx_temp.useRs3   = 0;
-  dctoEx_temp.useRd    = 0;
-  dctoEx_temp.we       = 0;
   struct ExtoMem extoMem_temp;
-  extoMem_temp.useRd    = 0;
-  extoMem_temp.isBranch = 0;
-  extoMem_temp.we       = 0;
   struct MemtoWB memtoWB_temp;
-  memtoWB_temp.useRd   = 0;
-  memtoWB_temp.isStore = 0;
-  memtoWB_temp.we      = 0;
-  memtoWB_temp.isLoad  = 0;
   struct WBOut wbOut_temp;
-  wbOut_temp.useRd = 0;
-  wbOut_temp.we    = 0;
-  wbOut_temp.rd    = 0;
   struct ForwardReg forwardRegisters;
-  forwardRegisters.forwardExtoVal1  = 0;
-  forwardRegisters.forwardExtoVal2  = 0;
-  forwardRegisters.forwardExtoVal3  = 0;
-  forwardRegisters.forwardMemtoVal1 = 0;
-  forwardRegisters.forwardMemtoVal2 = 0;
-  forwardRegisters.forwardMemtoVal3 = 0;
-  forwardRegisters.forwardWBtoVal1  = 0;
-  forwardRegisters.forwardWBtoVal2  = 0;
-  forwardRegisters.forwardWBtoVal3  = 0;
+  initStageOutputs(ftoDC_temp, dctoEx_temp, extoMem_temp, memtoWB_temp, wbOut_temp, forwardRegisters);
 
   // declare temporary register file
   ap_uint<32> nextInst;
+#if COMPRESSED_ISA
+  struct FetchBuffer fetchBuffer_temp;
+  const ap_uint<32> fetchAddress = fetchWordAddress(core.pc, core.fetchBuffer);
+#else
+  const ap_uint<32> fetchAddress = core.pc;
+#endif
 
-  core.im->process(core.pc, WORD, (!localStall && !core.stallDm) ? LOAD : NONE, 0, nextInst, core.stallIm);
+#ifndef __HLS__
+  core.im->requestPc = core.pc;
+#endif
+  core.im->process(fetchAddress, WORD, (!localStall && !core.stallDm) ? LOAD : NONE, 0, nextInst, core.stallIm);
+
+  // Writeback drives the write port of the register file before decode reads it
+  writeback(core.memtoWB, wbOut_temp);
+  core.regFile.write(wbOut_temp.we && wbOut_temp.useRd, wbOut_temp.rd, wbOut_temp.value);
 
+#if COMPRESSED_ISA
+  alignFetch(core.pc, core.fetchBuffer, nextInst, ftoDC_temp, fetchBuffer_temp);
+#else
   fetch(core.pc, ftoDC_temp, nextInst);
-  decode(core.ftoDC, dctoEx_temp, core.regFile);
+#endif
+  decode(core.ftoDC, dctoEx_temp, core.regFile, core.csr);
   execute(core.dctoEx, extoMem_temp);
   memory(core.extoMem, memtoWB_temp);
-  writeback(core.memtoWB, wbOut_temp);
+
+#ifndef __HLS__
+  // Pipeline registers are still the ones of the beginning of the cycle
+  core.lastCycle.pc[0] = core.pc;
+  core.lastCycle.pc[1] = core.ftoDC.pc;
+  core.lastCycle.pc[2] = core.dctoEx.pc;
+  core.lastCycle.pc[3] = core.extoMem.pc;
+  core.lastCycle.pc[4] = core.memtoWB.pc;
+  core.lastCycle.valid = 1 | (core.ftoDC.we << 1) | (core.dctoEx.we << 2) | (core.extoMem.we << 3) |
+                         (core.memtoWB.we << 4);
+#endif
 
   // resolve stalls, forwards
   if (!localStall)
     forwardUnit(dctoEx_temp.rs1, dctoEx_temp.useRs1, dctoEx_temp.rs2, dctoEx_temp.useRs2, dctoEx_temp.rs3,
                 dctoEx_temp.useRs3, extoMem_temp.rd, extoMem_temp.useRd, extoMem_temp.isLongInstruction,
-                memtoWB_temp.rd, memtoWB_temp.useRd, wbOut_temp.rd, wbOut_temp.useRd, core.stallSignals,
-                forwardRegisters);
+                memtoWB_temp.rd, memtoWB_temp.useRd, core.stallSignals, forwardRegisters);
+#ifndef __HLS__
+  const unsigned short bypasses = registerBypasses(core.regFile, dctoEx_temp, forwardRegisters);
+#endif
+  // Only the forward unit has set the stall of decode yet
+  const bool loadUse = core.stallSignals[STALL_DECODE];
+
+  // Csr are written when leaving the execute stage: a system instruction right
+  // behind a csr write waits one cycle before reading its csr
+  if (!localStall && dctoEx_temp.we && dctoEx_temp.opCode == RISCV_SYSTEM && extoMem_temp.we &&
+      extoMem_temp.isCsrWrite) {
+    core.stallSignals[STALL_FETCH]  = 1;
+    core.stallSignals[STALL_DECODE] = 1;
+  }
 
-  memMask mask;
-  // TODO: carry the data size to memToWb
-  switch (core.extoMem.funct3) {
-    case 0:
-      mask = BYTE;
-      break;
-    case 1:
-      mask = HALF;
-      break;
-    case 2:
-      mask = WORD;
-      break;
-    case 4:
-      mask = BYTE_U;
-      break;
-    case 5:
-      mask = HALF_U;
-      break;
-    // Should NEVER happen
-    default:
-      mask = WORD;
-      break;
+  // The top level answers a syscall in a0 when the ecall retires: the instruction
+  // behind it waits in decode until then
+  if (!localStall && dctoEx_temp.we &&
+      ((extoMem_temp.we && extoMem_temp.opCode == RISCV_SYSTEM && extoMem_temp.instruction.range(31, 7) == 0) ||
+       (memtoWB_temp.we && memtoWB_temp.isSyscall) || wbOut_temp.isSyscall)) {
+    core.stallSignals[STALL_FETCH]  = 1;
+    core.stallSignals[STALL_DECODE] = 1;
   }
 
+  // TODO: carry the data size to memToWb
+  const memMask mask = memoryMask(core.extoMem.funct3);
+
+  // SC only stores while the reservation of the hart holds its word
+  const bool conditionFails = memtoWB_temp.isConditional &&
+                              !(core.reservationValid && core.reservationAddress == memtoWB_temp.address.range(31, 2));
+
   memOpType opType = (!core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm && memtoWB_temp.isLoad) ? LOAD
-    : (!core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm && memtoWB_temp.isStore ? STORE : NONE);
+    : (!core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm && memtoWB_temp.isStore && !conditionFails ? STORE
+    : (!core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm && memtoWB_temp.isAmo ? amoOpType(memtoWB_temp.funct5)
+    : (!core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm && memtoWB_temp.isFence ? DRAIN : NONE)));
 
+#ifndef __HLS__
+  core.dm->requestPc = memtoWB_temp.pc;
+#endif
   core.dm->process(memtoWB_temp.address, mask, opType, memtoWB_temp.valueToWrite, memtoWB_temp.result, core.stallDm);
+  if (memtoWB_temp.isConditional)
+    memtoWB_temp.result = conditionFails;
+
+#if CUSTOM_ACCELERATOR
+  // The accelerator freezes the pipeline as the data memory does: its cycles are
+  // counted as dm stalls
+  bool acceleratorWait = false;
+  core.accelerator.process(memtoWB_temp.instruction, memtoWB_temp.address, memtoWB_temp.valueToWrite,
+                           !core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm &&
+                               memtoWB_temp.isCustom,
+                           memtoWB_temp.result, acceleratorWait);
+  core.stallDm = core.stallDm || acceleratorWait;
+#endif
 
   // commit the changes to the pipeline register
   if (!core.stallSignals[STALL_FETCH] && !localStall && !core.stallIm && !core.stallDm) {
     core.ftoDC = ftoDC_temp;
+#if COMPRESSED_ISA
+    core.fetchBuffer = fetchBuffer_temp;
+#endif
   }
 
   if (!core.stallSignals[STALL_DECODE] && !localStall && !core.stallIm && !core.stallDm) {
@@ -633,27 +1010,22 @@ void doCycle(struct Core& core, // Core containing all values
       core.dctoEx.lhs = extoMem_temp.result;
     else if (forwardRegisters.forwardMemtoVal1 && memtoWB_temp.we)
       core.dctoEx.lhs = memtoWB_temp.result;
-    else if (forwardRegisters.forwardWBtoVal1 && wbOut_temp.we)
-      core.dctoEx.lhs = wbOut_temp.value;
 
     if (forwardRegisters.forwardExtoVal2 && extoMem_temp.we)
       core.dctoEx.rhs = extoMem_temp.result;
     else if (forwardRegisters.forwardMemtoVal2 && memtoWB_temp.we)
       core.dctoEx.rhs = memtoWB_temp.result;
-    else if (forwardRegisters.forwardWBtoVal2 && wbOut_temp.we)
-      core.dctoEx.rhs = wbOut_temp.value;
 
     if (forwardRegisters.forwardExtoVal3 && extoMem_temp.we)
       core.dctoEx.datac = extoMem_temp.result;
     else if (forwardRegisters.forwardMemtoVal3 && memtoWB_temp.we)
       core.dctoEx.datac = memtoWB_temp.result;
-    else if (forwardRegisters.forwardWBtoVal3 && wbOut_temp.we)
-      core.dctoEx.datac = wbOut_temp.value;
   }
 
   if (core.stallSignals[STALL_DECODE] && !core.stallSignals[STALL_EXECUTE] && !core.stallIm && !core.stallDm &&
       !localStall) {
     core.dctoEx.we          = 0;
+    core.dctoEx.bubble      = loadUse ? CYCLE_LOAD_USE : CYCLE_SERIALIZE;
     core.dctoEx.useRd       = 0;
     core.dctoEx.isBranch    = 0;
     core.dctoEx.instruction = 0;
@@ -668,35 +1040,1212 @@ void doCycle(struct Core& core, // Core containing all values
     core.memtoWB = memtoWB_temp;
   }
 
-  if (wbOut_temp.we && wbOut_temp.useRd && !localStall && !core.stallIm && !core.stallDm) {
-    core.regFile[wbOut_temp.rd] = wbOut_temp.value;
-  }
+  core.regFile.update(!localStall && !core.stallIm && !core.stallDm);
 
   branchUnit(ftoDC_temp.nextPCFetch, dctoEx_temp.nextPCDC, dctoEx_temp.isBranch, extoMem_temp.nextPC,
-             extoMem_temp.isBranch, core.pc, core.ftoDC.we, core.dctoEx.we,
+             extoMem_temp.isBranch, core.pc, core.ftoDC.we, core.dctoEx.we, core.ftoDC.bubble, core.dctoEx.bubble,
              core.stallSignals[STALL_FETCH] || core.stallIm || core.stallDm || localStall);
 
+  // Performance counters
+  const bool commit = !localStall && !core.stallIm && !core.stallDm;
+  core.syscall      = wbOut_temp.isSyscall && commit;
+
+  // LR takes the reservation and SC releases it, whether it succeeds or not
+  core.dmWrite        = (opType == STORE || isAmo(opType)) && commit;
+  core.dmWriteAddress = memtoWB_temp.address.range(31, 2);
+  if (memtoWB_temp.we && memtoWB_temp.isReserve && commit) {
+    core.reservationValid   = true;
+    core.reservationAddress = memtoWB_temp.address.range(31, 2);
+  } else if (memtoWB_temp.we && memtoWB_temp.isConditional && commit) {
+    core.reservationValid = false;
+  }
+  bool events[NB_HPM_EVENTS];
+  events[HPM_LOAD_USE_STALL] = loadUse && commit;
+  events[HPM_BRANCH_FLUSH]   = (extoMem_temp.isBranch || dctoEx_temp.isBranch) && !core.stallSignals[STALL_FETCH] && commit;
+  events[HPM_IM_STALL]       = core.stallIm;
+  events[HPM_DM_STALL]       = core.stallDm;
+  events[HPM_IM_MISS]        = core.im->miss;
+  events[HPM_DM_MISS]        = core.dm->miss;
+
+  if (!core.csr.mcountinhibit[0])
+    core.csr.mcycle++;
+  if (!core.csr.mcountinhibit[2] && wbOut_temp.we && commit)
+    core.csr.minstret++;
+  for (int oneCounter = 0; oneCounter < NB_HPM_EVENTS; oneCounter++) {
+    if (events[oneCounter] && !core.csr.mcountinhibit[oneCounter + 3])
+      core.csr.mhpmcounter[oneCounter]++;
+  }
+
+  // CPI stack: frozen cycles are charged to their stall, other cycles are
+  // charged to the retired instruction or to the cause of the bubble in writeback
+  ap_uint<4> cycleClass;
+  if (localStall)
+    cycleClass = CYCLE_GLOBAL_STALL;
+  else if (core.stallDm)
+    cycleClass = CYCLE_DM_STALL;
+  else if (core.stallIm)
+    cycleClass = CYCLE_IM_STALL;
+  else if (wbOut_temp.we)
+    cycleClass = CYCLE_RETIRE;
+  else
+    cycleClass = wbOut_temp.bubble;
+  core.cycleClasses[cycleClass]++;
+
+#ifndef __HLS__
+  core.lastCycle.stalls = core.stallSignals[0] | (core.stallSignals[1] << 1) | (core.stallSignals[2] << 2) |
+                          (core.stallSignals[3] << 3) | (core.stallSignals[4] << 4) | (core.stallIm << 5) |
+                          (core.stallDm << 6) | (localStall << 7);
+  core.lastCycle.forwards =
+      forwardRegisters.forwardExtoVal1 | (forwardRegisters.forwardExtoVal2 << 1) |
+      (forwardRegisters.forwardExtoVal3 << 2) | (forwardRegisters.forwardMemtoVal1 << 3) |
+      (forwardRegisters.forwardMemtoVal2 << 4) | (forwardRegisters.forwardMemtoVal3 << 5) |
+      bypasses;
+  core.lastCycle.branches   = dctoEx_temp.isBranch | (extoMem_temp.isBranch << 1);
+  core.lastCycle.cycleClass = cycleClass;
+  core.lastCycle.memOpType  = isAmo(opType) ? STORE : opType;
+  core.lastCycle.memMask    = mask;
+  core.lastCycle.memAddr    = (opType != NONE) ? (unsigned int)memtoWB_temp.address : 0;
+#endif
+
+  // A csr write takes precedence over the counter increment
+  if (extoMem_temp.isCsrWrite && extoMem_temp.we && !core.stallSignals[STALL_EXECUTE] && commit)
+    writeCsr(core.csr, extoMem_temp.csr, extoMem_temp.datac);
+
   core.cycle++;
 }
 
-// void doCore(IncompleteMemory im, IncompleteMemory dm, bool globalStall)
-void doCore(bool globalStall, ap_uint<32> imData[1 << 24],
-            ap_uint<32> dmData[1 << 24])
+// The pipeline starts empty
+static void resetPipeline(struct FtoDC& ftoDC, struct DCtoEx& dctoEx, struct ExtoMem& extoMem, struct MemtoWB& memtoWB)
+{
+  ftoDC.we           = 0;
+  ftoDC.bubble       = CYCLE_BUBBLE;
+  dctoEx.we          = 0;
+  dctoEx.bubble      = CYCLE_BUBBLE;
+  dctoEx.useRd       = 0;
+  dctoEx.isBranch    = 0;
+  extoMem.we         = 0;
+  extoMem.bubble     = CYCLE_BUBBLE;
+  extoMem.useRd      = 0;
+  extoMem.isBranch   = 0;
+  extoMem.isCsrWrite = 0;
+  memtoWB.we         = 0;
+  memtoWB.bubble     = CYCLE_BUBBLE;
+  memtoWB.useRd      = 0;
+  memtoWB.isSyscall  = 0;
+}
+
+void initCore(struct Core& core, const ap_uint<32> hartId, const ap_uint<32> pc)
+{
+  resetPipeline(core.ftoDC, core.dctoEx, core.extoMem, core.memtoWB);
+  for (int oneStage = 0; oneStage < 5; oneStage++)
+    core.stallSignals[oneStage] = 0;
+  core.stallIm          = false;
+  core.stallDm          = false;
+  core.syscall          = false;
+  core.starting         = false;
+  core.startArgument    = 0;
+  core.reservationValid = false;
+  core.dmWrite          = false;
+
+  core.pc    = pc;
+  core.cycle = 0;
+#if COMPRESSED_ISA
+  core.fetchBuffer.valid = false;
+#endif
+
+  core.csr.mcycle        = 0;
+  core.csr.minstret      = 0;
+  core.csr.mcountinhibit = 0;
+  core.csr.mscratch      = 0;
+  core.csr.mhartid       = hartId;
+  for (int i = 0; i < NB_HPM_EVENTS; i++)
+    core.csr.mhpmcounter[i] = 0;
+  for (int i = 0; i < NB_CYCLE_CLASSES; i++)
+    core.cycleClasses[i] = 0;
+}
+
+// Syscalls of the ecalls which retired during the cycle, register a7 gives the number:
+//  - SYS_nbcore returns the number of harts,
+//  - SYS_threadstart starts hart a0 at pc a1, with a2 as stack pointer and a3 as
+//    argument (in its a0, the hart runs from the next cycle). It returns 0, or -1
+//    when the hart does not exist or is already running. The started code ends
+//    with SYS_exit.
+//  - SYS_exit stops the hart, it can be started again.
+// Other syscalls are left to the host. The arguments come from the copies of the
+// register file, its ports are used by the pipeline.
+void threadSyscalls(struct Core cores[NB_CORES], bool running[NB_CORES])
+{
+#pragma HLS INLINE
+  // Harts started during the last cycle, before any start of this one
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++) {
+    if (cores[oneCore].starting) {
+      cores[oneCore].regFile.set(10, cores[oneCore].startArgument);
+      cores[oneCore].starting = false;
+      running[oneCore]        = true;
+    }
+  }
+
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++) {
+    if (!running[oneCore] || !cores[oneCore].syscall)
+      continue;
+
+    struct Core& core = cores[oneCore];
+    switch (core.regFile.a7) {
+      case SYS_nbcore:
+        core.regFile.set(10, NB_CORES);
+        break;
+      case SYS_threadstart: {
+        const ap_uint<32> hart = core.regFile.a0;
+        if (hart < NB_CORES && !running[hart] && !cores[hart].starting) {
+          initCore(cores[hart], hart, core.regFile.a1);
+          cores[hart].regFile.set(2, core.regFile.a2);
+          cores[hart].starting      = true;
+          cores[hart].startArgument = core.regFile.a3;
+          core.regFile.set(10, 0);
+        } else {
+          core.regFile.set(10, -1);
+        }
+        break;
+      }
+      case SYS_exit:
+        running[oneCore] = false;
+        break;
+    }
+  }
+}
+
+// One cycle of all the harts, then the syscalls. Harts access the data memory
+// in order: a write cancels the reservations of the harts after it on the same
+// word, and of the ones before it for the next cycle.
+void doHarts(struct Core cores[NB_CORES], bool running[NB_CORES], bool globalStall)
+{
+#pragma HLS INLINE
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++) {
+    // Harts which are not running are not clocked
+    if (!running[oneCore])
+      continue;
+    doCycle(cores[oneCore], globalStall);
+
+    if (cores[oneCore].dmWrite) {
+      for (int otherCore = 0; otherCore < NB_CORES; otherCore++) {
+        if (otherCore != oneCore && cores[otherCore].reservationAddress == cores[oneCore].dmWriteAddress)
+          cores[otherCore].reservationValid = false;
+      }
+    }
+  }
+
+  threadSyscalls(cores, running);
+}
+
+#if BARREL_CORE
+void initBarrel(struct BarrelCore& barrel)
+{
+  resetPipeline(barrel.ftoDC, barrel.dctoEx, barrel.extoMem, barrel.memtoWB);
+  barrel.threadDC  = 0;
+  barrel.threadEx  = 0;
+  barrel.threadMem = 0;
+  barrel.threadWB  = 0;
+
+  barrel.fetchThread  = NB_CORES - 1; // hart 0 is fetched first
+  barrel.fetchPc      = 0;
+  barrel.fetchPending = false;
+  barrel.missPending  = false;
+  barrel.stallDm      = false;
+  for (int oneThread = 0; oneThread < NB_CORES; oneThread++) {
+    barrel.waiting[oneThread]   = false;
+    barrel.fillValid[oneThread] = false;
+  }
+
+  barrel.cycle          = 0;
+  barrel.numberSwitches = 0;
+  for (int i = 0; i < NB_CYCLE_CLASSES; i++)
+    barrel.cycleClasses[i] = 0;
+}
+
+// The data memory served the request of the switched out thread: a load keeps its
+// data for the replay, and all threads can run again
+static void completeMiss(struct BarrelCore& barrel, const ap_uint<32> dmOut)
+{
+#pragma HLS INLINE
+  barrel.missPending = false;
+  if (barrel.missOpType == LOAD) {
+    barrel.fillValid[barrel.missThread]   = true;
+    barrel.fillAddress[barrel.missThread] = barrel.missAddress;
+    barrel.fillMask[barrel.missThread]    = barrel.missMask;
+    barrel.fillData[barrel.missThread]    = dmOut;
+  }
+  for (int oneThread = 0; oneThread < NB_CORES; oneThread++)
+    barrel.waiting[oneThread] = false;
+}
+
+// Runs the data memory until the request of the switched out thread is served,
+// before the flush at the end of doCore
+static void drainBarrel(struct BarrelCore& barrel)
+{
+  while (barrel.missPending) {
+    bool missWait = false;
+    ap_uint<32> dmOut;
+    barrel.dm->process(barrel.missAddress, barrel.missMask, barrel.missOpType, barrel.missValue, dmOut, missWait);
+    if (!missWait)
+      completeMiss(barrel, dmOut);
+  }
+}
+
+// One cycle of the barrel core, then the syscalls (see threadSyscalls). The stages
+// are the ones of doCycle, on the context of the thread of their instruction.
+void doBarrel(struct BarrelCore& barrel, struct Core threads[NB_CORES], bool running[NB_CORES], bool globalStall)
+{
+#pragma HLS INLINE
+  const bool localStall      = globalStall;
+  const ap_uint<8> threadDC  = barrel.threadDC;
+  const ap_uint<8> threadEx  = barrel.threadEx;
+  const ap_uint<8> threadMem = barrel.threadMem;
+  const ap_uint<8> threadWB  = barrel.threadWB;
+
+  // Instructions of the threads which stopped are dropped, the thread may be started again
+  if (!running[threadDC])
+    barrel.ftoDC.we = 0;
+  if (!running[threadEx]) {
+    barrel.dctoEx.we    = 0;
+    barrel.dctoEx.useRd = 0;
+  }
+  if (!running[threadMem]) {
+    barrel.extoMem.we    = 0;
+    barrel.extoMem.useRd = 0;
+  }
+  if (!running[threadWB])
+    barrel.memtoWB.we = 0;
+  for (int oneThread = 0; oneThread < NB_CORES; oneThread++) {
+    if (!running[oneThread]) {
+      barrel.waiting[oneThread]   = false;
+      barrel.fillValid[oneThread] = false;
+    }
+  }
+
+  // declare temporary structs
+  struct FtoDC ftoDC_temp;
+  struct DCtoEx dctoEx_temp;
+  struct ExtoMem extoMem_temp;
+  struct MemtoWB memtoWB_temp;
+  struct WBOut wbOut_temp;
+  struct ForwardReg forwardRegisters;
+  initStageOutputs(ftoDC_temp, dctoEx_temp, extoMem_temp, memtoWB_temp, wbOut_temp, forwardRegisters);
+
+  // Fetch: next running thread which does not wait for the data memory
+  ap_uint<8> fetchThread = barrel.fetchThread;
+  bool fetching          = barrel.fetchPending;
+  if (!fetching) {
+    for (int oneThread = 1; oneThread <= NB_CORES; oneThread++) {
+      const int candidate = (barrel.fetchThread + oneThread) % NB_CORES;
+      if (!fetching && running[candidate] && !barrel.waiting[candidate]) {
+        fetchThread = candidate;
+        fetching    = true;
+      }
+    }
+    barrel.fetchPc = threads[fetchThread].pc;
+  }
+
+  ap_uint<32> nextInst;
+  bool stallIm = false;
+#if COMPRESSED_ISA
+  // The buffer of the thread does not change while its fetch is pending
+  struct FetchBuffer fetchBuffer_temp;
+  const ap_uint<32> fetchAddress = fetchWordAddress(barrel.fetchPc, threads[fetchThread].fetchBuffer);
+#else
+  const ap_uint<32> fetchAddress = barrel.fetchPc;
+#endif
+#ifndef __HLS__
+  barrel.im->requestPc = barrel.fetchPc;
+#endif
+  barrel.im->process(fetchAddress, WORD, (fetching && !localStall) ? LOAD : NONE, 0, nextInst, stallIm);
+
+#if COMPRESSED_ISA
+  alignFetch(barrel.fetchPc, threads[fetchThread].fetchBuffer, nextInst, ftoDC_temp, fetchBuffer_temp);
+#else
+  fetch(barrel.fetchPc, ftoDC_temp, nextInst);
+#endif
+  // The word of a miss is dropped when its thread went elsewhere in the meantime
+  ftoDC_temp.we     = ftoDC_temp.we && fetching && !stallIm && running[fetchThread] && !barrel.waiting[fetchThread] &&
+                  threads[fetchThread].pc == barrel.fetchPc;
+  ftoDC_temp.bubble = stallIm ? CYCLE_IM_STALL : CYCLE_BUBBLE;
+
+  // The register file of the thread in writeback bypasses its write to decode when
+  // decode holds the same thread
+  writeback(barrel.memtoWB, wbOut_temp);
+  threads[threadWB].regFile.write(wbOut_temp.we && wbOut_temp.useRd, wbOut_temp.rd, wbOut_temp.value);
+
+  decode(barrel.ftoDC, dctoEx_temp, threads[threadDC].regFile, threads[threadDC].csr);
+  execute(barrel.dctoEx, extoMem_temp);
+  memory(barrel.extoMem, memtoWB_temp);
+
+#ifndef __HLS__
+  barrel.lastCycle.pc[0] = barrel.fetchPc;
+  barrel.lastCycle.pc[1] = barrel.ftoDC.pc;
+  barrel.lastCycle.pc[2] = barrel.dctoEx.pc;
+  barrel.lastCycle.pc[3] = barrel.extoMem.pc;
+  barrel.lastCycle.pc[4] = barrel.memtoWB.pc;
+  barrel.lastCycle.valid = fetching | (barrel.ftoDC.we << 1) | (barrel.dctoEx.we << 2) | (barrel.extoMem.we << 3) |
+                           (barrel.memtoWB.we << 4);
+#endif
+
+  // Forwards only between instructions of the same thread. The hazards which stall
+  // decode in doCycle send its instruction back to fetch.
+  bool stallSignals[5] = {0, 0, 0, 0, 0};
+  if (!localStall)
+    forwardUnit(dctoEx_temp.rs1, dctoEx_temp.useRs1, dctoEx_temp.rs2, dctoEx_temp.useRs2, dctoEx_temp.rs3,
+                dctoEx_temp.useRs3, extoMem_temp.rd, extoMem_temp.useRd && threadEx == threadDC,
+                extoMem_temp.isLongInstruction, memtoWB_temp.rd, memtoWB_temp.useRd && threadMem == threadDC,
+                stallSignals, forwardRegisters);
+#ifndef __HLS__
+  const unsigned short bypasses = registerBypasses(threads[threadDC].regFile, dctoEx_temp, forwardRegisters);
+#endif
+  const bool csrHazard = dctoEx_temp.opCode == RISCV_SYSTEM && extoMem_temp.we && extoMem_temp.isCsrWrite &&
+                         threadEx == threadDC;
+  const bool syscallHazard =
+      (extoMem_temp.we && extoMem_temp.opCode == RISCV_SYSTEM && extoMem_temp.instruction.range(31, 7) == 0 &&
+       threadEx == threadDC) ||
+      (memtoWB_temp.we && memtoWB_temp.isSyscall && threadMem == threadDC) ||
+      (wbOut_temp.isSyscall && threadWB == threadDC);
+  const bool replay = !localStall && dctoEx_temp.we && (stallSignals[STALL_DECODE] || csrHazard || syscallHazard);
+
+  // TODO: carry the data size to memToWb
+  const memMask mask = memoryMask(barrel.extoMem.funct3);
+
+  // SC only stores while the reservation of the thread holds its word
+  const bool conditionFails =
+      memtoWB_temp.isConditional &&
+      !(threads[threadMem].reservationValid && threads[threadMem].reservationAddress == memtoWB_temp.address.range(31, 2));
+
+  memOpType opType = NONE;
+  if (!localStall && memtoWB_temp.we) {
+    if (memtoWB_temp.isLoad)
+      opType = LOAD;
+    else if (memtoWB_temp.isStore && !conditionFails)
+      opType = STORE;
+    else if (memtoWB_temp.isAmo)
+      opType = amoOpType(memtoWB_temp.funct5);
+    else if (memtoWB_temp.isFence)
+      opType = DRAIN;
+  }
+
+  // The replay of a load which missed reads the data kept for it
+  const bool fromFill = opType == LOAD && barrel.fillValid[threadMem] &&
+                        barrel.fillAddress[threadMem] == memtoWB_temp.address && barrel.fillMask[threadMem] == mask;
+
+  bool stallDm            = false;
+  bool switchOut          = false; // the thread in memory leaves the pipeline until the data memory is available
+  ap_uint<8> dmMissThread = threadMem; // thread of the request the data memory serves
+  ap_uint<32> dmOut;
+  if (barrel.missPending) {
+    bool missWait = false;
+    dmMissThread  = barrel.missThread;
+#ifndef __HLS__
+    barrel.dm->requestPc = barrel.missPc;
+#endif
+    barrel.dm->process(barrel.missAddress, barrel.missMask, localStall ? NONE : barrel.missOpType, barrel.missValue,
+                       dmOut, missWait);
+    if (!localStall && !missWait)
+      completeMiss(barrel, dmOut);
+    // FENCE is a request as well. An ecall waits too: after SYS_exit, the run may
+    // end before the data memory gets the request again.
+    switchOut = (opType != NONE && !fromFill) ||
+                (!localStall && memtoWB_temp.we && memtoWB_temp.isSyscall && barrel.missPending);
+  } else if (fromFill) {
+    // The data memory stays clocked
+    bool unused;
+    barrel.dm->process(0, WORD, NONE, 0, dmOut, unused);
+  } else {
+#ifndef __HLS__
+    barrel.dm->requestPc = memtoWB_temp.pc;
+#endif
+    barrel.dm->process(memtoWB_temp.address, mask, opType, memtoWB_temp.valueToWrite, memtoWB_temp.result, stallDm);
+
+    // A load miss switches its thread out when another one can run, a store miss is
+    // posted: the data memory gets the request every cycle until it is served
+    bool otherReady = false;
+    for (int oneThread = 0; oneThread < NB_CORES; oneThread++) {
+      if (oneThread != threadMem && running[oneThread] && !barrel.waiting[oneThread])
+        otherReady = true;
+    }
+    if (stallDm && ((opType == LOAD && otherReady) || (opType == STORE && !memtoWB_temp.isConditional))) {
+      barrel.missPending = true;
+      barrel.missThread  = threadMem;
+      barrel.missPc      = memtoWB_temp.pc;
+      barrel.missAddress = memtoWB_temp.address;
+      barrel.missMask    = mask;
+      barrel.missOpType  = opType;
+      barrel.missValue   = memtoWB_temp.valueToWrite;
+      switchOut          = (opType == LOAD);
+      stallDm            = false;
+    }
+  }
+  if (fromFill)
+    memtoWB_temp.result = barrel.fillData[threadMem];
+  if (memtoWB_temp.isConditional)
+    memtoWB_temp.result = conditionFails;
+
+#if CUSTOM_ACCELERATOR
+  // Every thread has its accelerator, the one of the thread in memory freezes the
+  // pipeline until its result is ready
+  for (int oneThread = 0; oneThread < NB_CORES; oneThread++) {
+    bool acceleratorWait = false;
+    threads[oneThread].accelerator.process(memtoWB_temp.instruction, memtoWB_temp.address, memtoWB_temp.valueToWrite,
+                                           oneThread == threadMem && !localStall && memtoWB_temp.we &&
+                                               memtoWB_temp.isCustom,
+                                           memtoWB_temp.result, acceleratorWait);
+    stallDm = stallDm || acceleratorWait;
+  }
+#endif
+  const bool dmIssued = opType != NONE && !switchOut && !fromFill;
+
+  const bool commit = !localStall && !stallDm;
+
+  // Squashes and redirections, from the oldest instruction to the youngest one: an
+  // instruction only acts when no older one of its thread squashed it
+  bool branchExecute = false;
+  bool branchDecode  = false;
+  if (commit) {
+    if (switchOut) {
+      // The thread replays from the instruction in memory
+      barrel.numberSwitches++;
+      barrel.waiting[threadMem] = barrel.missPending;
+      threads[threadMem].pc     = memtoWB_temp.pc;
+      memtoWB_temp.we           = 0;
+      memtoWB_temp.useRd        = 0;
+      memtoWB_temp.bubble       = CYCLE_DM_STALL;
+      if (threadEx == threadMem) {
+        extoMem_temp.we         = 0;
+        extoMem_temp.useRd      = 0;
+        extoMem_temp.isBranch   = 0;
+        extoMem_temp.isCsrWrite = 0;
+        extoMem_temp.bubble     = CYCLE_DM_STALL;
+      }
+      if (threadDC == threadMem) {
+        dctoEx_temp.we       = 0;
+        dctoEx_temp.useRd    = 0;
+        dctoEx_temp.isBranch = 0;
+        dctoEx_temp.bubble   = CYCLE_DM_STALL;
+      }
+      if (fetchThread == threadMem) {
+        ftoDC_temp.we     = 0;
+        ftoDC_temp.bubble = CYCLE_DM_STALL;
+      }
+    }
+
+    if (extoMem_temp.we && extoMem_temp.isBranch) {
+      branchExecute        = true;
+      threads[threadEx].pc = extoMem_temp.nextPC;
+      if (threadDC == threadEx) {
+        dctoEx_temp.we       = 0;
+        dctoEx_temp.useRd    = 0;
+        dctoEx_temp.isBranch = 0;
+        dctoEx_temp.bubble   = CYCLE_BRANCH_EXECUTE;
+      }
+      if (fetchThread == threadEx) {
+        ftoDC_temp.we     = 0;
+        ftoDC_temp.bubble = CYCLE_BRANCH_EXECUTE;
+      }
+    }
+
+    if (dctoEx_temp.we && replay) {
+      threads[threadDC].pc = barrel.ftoDC.pc;
+      dctoEx_temp.we       = 0;
+      dctoEx_temp.useRd    = 0;
+      dctoEx_temp.isBranch = 0;
+      dctoEx_temp.bubble   = stallSignals[STALL_DECODE] ? CYCLE_LOAD_USE : CYCLE_SERIALIZE;
+      if (fetchThread == threadDC) {
+        ftoDC_temp.we     = 0;
+        ftoDC_temp.bubble = dctoEx_temp.bubble;
+      }
+    }
+
+    if (dctoEx_temp.we && dctoEx_temp.isBranch) {
+      branchDecode         = true;
+      threads[threadDC].pc = dctoEx_temp.nextPCDC;
+      if (fetchThread == threadDC) {
+        ftoDC_temp.we     = 0;
+        ftoDC_temp.bubble = CYCLE_BRANCH_DECODE;
+      }
+    }
+
+    if (ftoDC_temp.we)
+      threads[fetchThread].pc = ftoDC_temp.nextPCFetch;
+#if COMPRESSED_ISA
+    // The buffer holds the half at its address whatever the thread does next
+    if (fetching && !stallIm)
+      threads[fetchThread].fetchBuffer = fetchBuffer_temp;
+#endif
+  }
+  barrel.fetchThread  = fetchThread;
+  barrel.fetchPending = stallIm;
+  barrel.stallDm      = stallDm;
+
+  // commit the changes to the pipeline registers
+  threads[threadWB].regFile.update(commit);
+  if (commit) {
+    barrel.ftoDC  = ftoDC_temp;
+    barrel.dctoEx = dctoEx_temp;
+
+    if (forwardRegisters.forwardExtoVal1 && extoMem_temp.we)
+      barrel.dctoEx.lhs = extoMem_temp.result;
+    else if (forwardRegisters.forwardMemtoVal1 && memtoWB_temp.we)
+      barrel.dctoEx.lhs = memtoWB_temp.result;
+
+    if (forwardRegisters.forwardExtoVal2 && extoMem_temp.we)
+      barrel.dctoEx.rhs = extoMem_temp.result;
+    else if (forwardRegisters.forwardMemtoVal2 && memtoWB_temp.we)
+      barrel.dctoEx.rhs = memtoWB_temp.result;
+
+    if (forwardRegisters.forwardExtoVal3 && extoMem_temp.we)
+      barrel.dctoEx.datac = extoMem_temp.result;
+    else if (forwardRegisters.forwardMemtoVal3 && memtoWB_temp.we)
+      barrel.dctoEx.datac = memtoWB_temp.result;
+
+    barrel.extoMem   = extoMem_temp;
+    barrel.memtoWB   = memtoWB_temp;
+    barrel.threadWB  = threadMem;
+    barrel.threadMem = threadEx;
+    barrel.threadEx  = threadDC;
+    barrel.threadDC  = fetchThread;
+
+    // Writes cancel the reservations and the kept loads of the other threads on their word
+    if (dmIssued && (opType == STORE || isAmo(opType))) {
+      for (int oneThread = 0; oneThread < NB_CORES; oneThread++) {
+        if (oneThread != threadMem && threads[oneThread].reservationAddress == memtoWB_temp.address.range(31, 2))
+          threads[oneThread].reservationValid = false;
+        if (barrel.fillAddress[oneThread].range(31, 2) == memtoWB_temp.address.range(31, 2))
+          barrel.fillValid[oneThread] = false;
+      }
+    }
+    if (fromFill)
+      barrel.fillValid[threadMem] = false;
+
+    // LR takes the reservation and SC releases it, whether it succeeds or not
+    if (memtoWB_temp.we && memtoWB_temp.isReserve) {
+      threads[threadMem].reservationValid   = true;
+      threads[threadMem].reservationAddress = memtoWB_temp.address.range(31, 2);
+    } else if (memtoWB_temp.we && memtoWB_temp.isConditional) {
+      threads[threadMem].reservationValid = false;
+    }
+  }
+
+  // Performance counters, the events are charged to the thread which causes them
+  for (int oneThread = 0; oneThread < NB_CORES; oneThread++) {
+    threads[oneThread].syscall = false;
+    if (!running[oneThread])
+      continue;
+
+    struct Core& context = threads[oneThread];
+    bool events[NB_HPM_EVENTS];
+    events[HPM_LOAD_USE_STALL] = replay && stallSignals[STALL_DECODE] && commit && threadDC == oneThread;
+    events[HPM_BRANCH_FLUSH]   = (branchExecute && threadEx == oneThread) || (branchDecode && threadDC == oneThread);
+    events[HPM_IM_STALL]       = stallIm && fetchThread == oneThread;
+    events[HPM_DM_STALL]       = (stallDm && threadMem == oneThread) || barrel.waiting[oneThread];
+    events[HPM_IM_MISS]        = barrel.im->miss && fetchThread == oneThread;
+    events[HPM_DM_MISS]        = barrel.dm->miss && dmMissThread == oneThread;
+
+    if (!context.csr.mcountinhibit[0])
+      context.csr.mcycle++;
+    if (!context.csr.mcountinhibit[2] && wbOut_temp.we && commit && threadWB == oneThread)
+      context.csr.minstret++;
+    for (int oneCounter = 0; oneCounter < NB_HPM_EVENTS; oneCounter++) {
+      if (events[oneCounter] && !context.csr.mcountinhibit[oneCounter + 3])
+        context.csr.mhpmcounter[oneCounter]++;
+    }
+    context.cycle++;
+  }
+  threads[threadWB].syscall = wbOut_temp.isSyscall && commit;
+
+  // CPI stack of the pipeline, as in doCycle
+  ap_uint<4> cycleClass;
+  if (localStall)
+    cycleClass = CYCLE_GLOBAL_STALL;
+  else if (stallDm)
+    cycleClass = CYCLE_DM_STALL;
+  else if (wbOut_temp.we)
+    cycleClass = CYCLE_RETIRE;
+  else
+    cycleClass = wbOut_temp.bubble;
+  barrel.cycleClasses[cycleClass]++;
+
+#ifndef __HLS__
+  barrel.lastCycle.stalls = (stallDm << 6) | (localStall << 7);
+  barrel.lastCycle.forwards =
+      forwardRegisters.forwardExtoVal1 | (forwardRegisters.forwardExtoVal2 << 1) |
+      (forwardRegisters.forwardExtoVal3 << 2) | (forwardRegisters.forwardMemtoVal1 << 3) |
+      (forwardRegisters.forwardMemtoVal2 << 4) | (forwardRegisters.forwardMemtoVal3 << 5) |
+      bypasses;
+  barrel.lastCycle.branches   = branchDecode | (branchExecute << 1);
+  barrel.lastCycle.cycleClass = cycleClass;
+  barrel.lastCycle.memOpType  = dmIssued || fromFill ? (isAmo(opType) ? STORE : opType) : NONE;
+  barrel.lastCycle.memMask    = mask;
+  barrel.lastCycle.memAddr    = dmIssued || fromFill ? (unsigned int)memtoWB_temp.address : 0;
+#endif
+
+  // A csr write takes precedence over the counter increment
+  if (extoMem_temp.isCsrWrite && extoMem_temp.we && commit)
+    writeCsr(threads[threadEx].csr, extoMem_temp.csr, extoMem_temp.datac);
+
+  barrel.cycle++;
+  threadSyscalls(threads, running);
+}
+#endif
+
+#if DATAFLOW_CORE
+void initDataflow(struct DataflowCore& dataflow)
+{
+  dataflow.fetchToDecode     = PipelineChannel<struct FetchToken>();
+  dataflow.decodeToExecute   = PipelineChannel<struct DecodeToken>();
+  dataflow.executeToMemory   = PipelineChannel<struct ExecuteToken>();
+  dataflow.memoryToWriteback = PipelineChannel<struct MemoryToken>();
+  dataflow.executeRedirects  = PipelineChannel<struct Redirect>();
+  dataflow.decodeRedirects   = PipelineChannel<struct Redirect>();
+  dataflow.retires           = PipelineChannel<struct RetireToken>();
+  dataflow.csrWrites         = PipelineChannel<struct CsrWrite>();
+
+  dataflow.requestPc         = 0;
+  dataflow.fetchPending      = false;
+  dataflow.fetchExecuteEpoch = false;
+  dataflow.fetchDecodeEpoch  = false;
+
+  for (int oneRegister = 0; oneRegister < 32; oneRegister++)
+    dataflow.busy[oneRegister] = 0;
+  dataflow.inFlight           = 0;
+  dataflow.systemInFlight     = false;
+  dataflow.decodeExecuteEpoch = false;
+  dataflow.decodeDecodeEpoch  = false;
+
+  dataflow.executeEpoch = false;
+  dataflow.stallIm      = false;
+  dataflow.stallDm      = false;
+  dataflow.retired      = false;
+  dataflow.retiredPc    = 0;
+}
+
+// Fetch process: applies the redirections, then fetches at the pc of the hart when
+// decode has room. A word fetched before a redirection is dropped.
+#if COMPRESSED_ISA
+static void dataflowFetch(struct DataflowCore& dataflow, ap_uint<32>& pc, struct FetchBuffer& buffer, bool& redirected)
+#else
+static void dataflowFetch(struct DataflowCore& dataflow, ap_uint<32>& pc, bool& redirected)
+#endif
+{
+#pragma HLS INLINE off
+  redirected = false;
+  if (dataflow.executeRedirects.canRead()) {
+    const struct Redirect redirect = dataflow.executeRedirects.pop();
+    pc                             = redirect.pc;
+    dataflow.fetchExecuteEpoch     = redirect.executeEpoch;
+    dataflow.fetchDecodeEpoch      = redirect.decodeEpoch;
+    redirected                     = true;
+  }
+  // A jump of decode is on the wrong path when execute redirected fetch after it
+  if (dataflow.decodeRedirects.canRead()) {
+    const struct Redirect redirect = dataflow.decodeRedirects.pop();
+    if (!redirected && redirect.executeEpoch == dataflow.fetchExecuteEpoch) {
+      pc                        = redirect.pc;
+      dataflow.fetchDecodeEpoch = redirect.decodeEpoch;
+      redirected                = true;
+    }
+  }
+
+  // The memory is clocked every cycle, a miss goes on while decode has no room
+  const bool request        = dataflow.fetchToDecode.canWrite();
+  const ap_uint<32> address = dataflow.fetchPending ? dataflow.requestPc : pc;
+#if COMPRESSED_ISA
+  const ap_uint<32> wordAddress = fetchWordAddress(address, buffer);
+#else
+  const ap_uint<32> wordAddress = address;
+#endif
+  ap_uint<32> instruction;
+  bool wait = false;
+#ifndef __HLS__
+  dataflow.im->requestPc = address;
+#endif
+  dataflow.im->process(wordAddress, WORD, request ? LOAD : NONE, 0, instruction, wait);
+  dataflow.stallIm = request && wait;
+
+  if (request) {
+    dataflow.requestPc    = address;
+    dataflow.fetchPending = wait;
+    if (!wait && address == pc) {
+      struct FetchToken token;
+#if COMPRESSED_ISA
+      struct FetchBuffer nextBuffer;
+      alignFetch(address, buffer, instruction, token.ftoDC, nextBuffer);
+      buffer = nextBuffer;
+#else
+      fetch(address, token.ftoDC, instruction);
+#endif
+      token.executeEpoch = dataflow.fetchExecuteEpoch;
+      token.decodeEpoch  = dataflow.fetchDecodeEpoch;
+      if (token.ftoDC.we)
+        dataflow.fetchToDecode.push(token);
+      pc = token.ftoDC.nextPCFetch;
+    }
+  }
+}
+
+// Decode process: retires the instructions coming back from writeback in the
+// register file of the hart, then issues the instruction from fetch when its
+// operands are not in flight. serialize tells that the hazard is a system
+// instruction waiting for the pipeline to drain.
+static void dataflowDecode(struct DataflowCore& dataflow, struct Core& core, bool& retired, bool& hazard,
+                           bool& serialize, bool& issued, struct DCtoEx& dctoEx)
+{
+#pragma HLS INLINE off
+#pragma HLS ARRAY_PARTITION variable = dataflow.busy complete
+  // The answer of a syscall is in the register file one cycle after its ecall retired
+  if (dataflow.systemInFlight && dataflow.inFlight == 0)
+    dataflow.systemInFlight = false;
+
+  retired      = false;
+  core.syscall = false;
+  core.regFile.write(false, 0, 0);
+  if (dataflow.retires.canRead()) {
+    const struct RetireToken token = dataflow.retires.pop();
+    core.regFile.write(token.wbOut.we && token.wbOut.useRd, token.wbOut.rd, token.wbOut.value);
+    if (token.release != 0)
+      dataflow.busy[token.release]--;
+    dataflow.inFlight--;
+    retired      = token.wbOut.we;
+    core.syscall = token.wbOut.isSyscall;
+  }
+
+  hazard    = false;
+  serialize = false;
+  issued    = false;
+  if (dataflow.fetchToDecode.canRead() && dataflow.decodeToExecute.canWrite() &&
+      dataflow.decodeRedirects.canWrite() && !dataflow.systemInFlight) {
+    const struct FetchToken token = dataflow.fetchToDecode.peek();
+    // Fetch was redirected by execute: the decode epoch starts again from its one
+    if (token.executeEpoch != dataflow.decodeExecuteEpoch) {
+      dataflow.decodeExecuteEpoch = token.executeEpoch;
+      dataflow.decodeDecodeEpoch  = token.decodeEpoch;
+    }
+
+    if (token.decodeEpoch != dataflow.decodeDecodeEpoch) {
+      dataflow.fetchToDecode.pop(); // fetched behind a jump
+    } else {
+      decode(token.ftoDC, dctoEx, core.regFile, core.csr);
+      serialize = dctoEx.opCode == RISCV_SYSTEM && dataflow.inFlight != 0;
+      hazard    = (dctoEx.useRs1 && dctoEx.rs1 != 0 && dataflow.busy[dctoEx.rs1] != 0) ||
+                  (dctoEx.useRs2 && dctoEx.rs2 != 0 && dataflow.busy[dctoEx.rs2] != 0) ||
+                  (dctoEx.useRs3 && dctoEx.rs3 != 0 && dataflow.busy[dctoEx.rs3] != 0) || serialize;
+
+      if (!hazard) {
+        struct DecodeToken issue;
+        issue.dctoEx       = dctoEx;
+        issue.executeEpoch = dataflow.decodeExecuteEpoch;
+        issue.release      = (dctoEx.useRd && dctoEx.rd != 0) ? dctoEx.rd : (ap_uint<5>)0;
+        dataflow.fetchToDecode.pop();
+        dataflow.decodeToExecute.push(issue);
+        if (issue.release != 0)
+          dataflow.busy[issue.release]++;
+        dataflow.inFlight++;
+        dataflow.systemInFlight = (dctoEx.opCode == RISCV_SYSTEM);
+        issued                  = true;
+
+        if (dctoEx.isBranch) {
+          struct Redirect redirect;
+          dataflow.decodeDecodeEpoch = !dataflow.decodeDecodeEpoch;
+          redirect.pc                = dctoEx.nextPCDC;
+          redirect.executeEpoch      = dataflow.decodeExecuteEpoch;
+          redirect.decodeEpoch       = dataflow.decodeDecodeEpoch;
+          dataflow.decodeRedirects.push(redirect);
+        }
+      }
+    }
+  }
+}
+
+// Execute process: the instructions of a former epoch are killed, they only go
+// on to release the scoreboard
+static void dataflowExecute(struct DataflowCore& dataflow, bool& branch)
+{
+#pragma HLS INLINE off
+  branch = false;
+  if (dataflow.decodeToExecute.canRead() && dataflow.executeToMemory.canWrite() &&
+      dataflow.executeRedirects.canWrite() && dataflow.csrWrites.canWrite()) {
+    struct DecodeToken token = dataflow.decodeToExecute.pop();
+    if (token.executeEpoch != dataflow.executeEpoch) {
+      token.dctoEx.we     = 0;
+      token.dctoEx.bubble = CYCLE_BRANCH_EXECUTE;
+    }
+
+    struct ExecuteToken result;
+    execute(token.dctoEx, result.extoMem);
+    result.release = token.release;
+    dataflow.executeToMemory.push(result);
+
+    if (result.extoMem.isBranch) {
+      struct Redirect redirect;
+      dataflow.executeEpoch = !dataflow.executeEpoch;
+      redirect.pc           = result.extoMem.nextPC;
+      redirect.executeEpoch = dataflow.executeEpoch;
+      redirect.decodeEpoch  = false;
+      dataflow.executeRedirects.push(redirect);
+      branch = true;
+    }
+    if (result.extoMem.isCsrWrite) {
+      struct CsrWrite write;
+      write.csr   = result.extoMem.csr;
+      write.value = result.extoMem.datac;
+      dataflow.csrWrites.push(write);
+    }
+  }
+}
+
+// Memory process: the instruction stays in the stage until the data memory answers.
+// The reservation of LR/SC is the one of the hart.
+static void dataflowMemory(struct DataflowCore& dataflow, struct Core& core, memOpType& opType,
+                           struct MemtoWB& memtoWB)
+{
+#pragma HLS INLINE off
+  opType           = NONE;
+  dataflow.stallDm = false;
+  if (dataflow.executeToMemory.canRead() && dataflow.memoryToWriteback.canWrite()) {
+    const struct ExecuteToken token = dataflow.executeToMemory.peek();
+    memtoWB.isStore       = 0;
+    memtoWB.isLoad        = 0;
+    memtoWB.isFence       = 0;
+    memtoWB.isSyscall     = 0;
+    memtoWB.isReserve     = 0;
+    memtoWB.isConditional = 0;
+    memtoWB.isAmo         = 0;
+    memtoWB.isCustom      = 0;
+    memory(token.extoMem, memtoWB);
+
+    const memMask mask = memoryMask(token.extoMem.funct3);
+    const bool conditionFails =
+        memtoWB.isConditional && !(core.reservationValid && core.reservationAddress == memtoWB.address.range(31, 2));
+    if (memtoWB.we) {
+      if (memtoWB.isLoad)
+        opType = LOAD;
+      else if (memtoWB.isStore && !conditionFails)
+        opType = STORE;
+      else if (memtoWB.isAmo)
+        opType = amoOpType(memtoWB.funct5);
+      else if (memtoWB.isFence)
+        opType = DRAIN;
+    }
+
+#ifndef __HLS__
+    dataflow.dm->requestPc = memtoWB.pc;
+#endif
+    dataflow.dm->process(memtoWB.address, mask, opType, memtoWB.valueToWrite, memtoWB.result, dataflow.stallDm);
+#if CUSTOM_ACCELERATOR
+    bool acceleratorWait = false;
+    core.accelerator.process(memtoWB.instruction, memtoWB.address, memtoWB.valueToWrite,
+                             memtoWB.we && memtoWB.isCustom, memtoWB.result, acceleratorWait);
+    dataflow.stallDm = dataflow.stallDm || acceleratorWait;
+#endif
+    if (!dataflow.stallDm) {
+      if (memtoWB.isConditional)
+        memtoWB.result = conditionFails;
+      if (memtoWB.we && memtoWB.isReserve) {
+        core.reservationValid   = true;
+        core.reservationAddress = memtoWB.address.range(31, 2);
+      } else if (memtoWB.we && memtoWB.isConditional) {
+        core.reservationValid = false;
+      }
+
+      struct MemoryToken result;
+      result.memtoWB = memtoWB;
+      result.release = token.release;
+      dataflow.executeToMemory.pop();
+      dataflow.memoryToWriteback.push(result);
+    }
+  }
+}
+
+// Writeback process: every instruction goes back to decode
+static void dataflowWriteback(struct DataflowCore& dataflow, struct WBOut& wbOut, ap_uint<32>& pc, bool& valid)
 {
-  Core core;
+#pragma HLS INLINE off
+  valid = false;
+  if (dataflow.memoryToWriteback.canRead() && dataflow.retires.canWrite()) {
+    const struct MemoryToken token = dataflow.memoryToWriteback.pop();
+    struct RetireToken result;
+    result.wbOut = wbOut;
+    writeback(token.memtoWB, result.wbOut);
+    result.release = token.release;
+    dataflow.retires.push(result);
+    wbOut = result.wbOut;
+    pc    = token.memtoWB.pc;
+    valid = true;
+  }
+}
 
-  IncompleteMemory<4> imInterface = IncompleteMemory<4>(imData);
-  IncompleteMemory<4> dmInterface = IncompleteMemory<4>(dmData);
+// One cycle of the dataflow core, then the syscalls (see threadSyscalls). The stages
+// run on the channels of the beginning of the cycle, in any order, and the channels
+// take what the stages wrote at the end of the cycle. Each stage is a module of its
+// own (INLINE off), scheduled alone in the pipelined loop of doCore: an HLS DATAFLOW
+// region would not take the feedback channels.
+void doDataflow(struct DataflowCore& dataflow, struct Core& core, bool running[NB_CORES])
+{
+#pragma HLS INLINE
+#pragma HLS BIND_STORAGE variable = core.regFile.bank1 type = ram_s2p impl = lutram
+#pragma HLS BIND_STORAGE variable = core.regFile.bank2 type = ram_s2p impl = lutram
+#pragma HLS ARRAY_PARTITION variable = core.cycleClasses complete
+#pragma HLS ARRAY_PARTITION variable = core.csr.mhpmcounter complete
 
-  // CacheMemory<4, 16, 64> dmCache = CacheMemory<4, 16, 64>(&dmInterface, false);
-  // CacheMemory<4, 16, 64> imCache = CacheMemory<4, 16, 64>(&imInterface, false);
+  struct FtoDC ftoDC_temp;
+  struct DCtoEx dctoEx_temp;
+  struct ExtoMem extoMem_temp;
+  struct MemtoWB memtoWB_temp;
+  struct WBOut wbOut_temp;
+  struct ForwardReg forwardRegisters;
+  initStageOutputs(ftoDC_temp, dctoEx_temp, extoMem_temp, memtoWB_temp, wbOut_temp, forwardRegisters);
 
-  core.im         = &imInterface;
-  core.dm         = &dmInterface;
-  core.pc         = 0;
+#ifndef __HLS__
+  // Channels are still the ones of the beginning of the cycle
+  const ap_uint<32> fetchPc = dataflow.fetchPending ? dataflow.requestPc : core.pc;
+  core.lastCycle.pc[0]      = fetchPc;
+  core.lastCycle.pc[1]      = dataflow.fetchToDecode.peek().ftoDC.pc;
+  core.lastCycle.pc[2]      = dataflow.decodeToExecute.peek().dctoEx.pc;
+  core.lastCycle.pc[3]      = dataflow.executeToMemory.peek().extoMem.pc;
+  core.lastCycle.pc[4]      = dataflow.memoryToWriteback.peek().memtoWB.pc;
+  core.lastCycle.valid      = dataflow.fetchToDecode.canWrite() | (dataflow.fetchToDecode.canRead() << 1) |
+                         (dataflow.decodeToExecute.canRead() << 2) |
+                         ((dataflow.executeToMemory.canRead() && dataflow.executeToMemory.peek().extoMem.we) << 3) |
+                         ((dataflow.memoryToWriteback.canRead() && dataflow.memoryToWriteback.peek().memtoWB.we) << 4);
+  const memMask traceMask = memoryMask(dataflow.executeToMemory.peek().extoMem.funct3);
+#endif
 
-  while (1) {
-    doCycle(core, globalStall);
+  bool redirected, retired, hazard, serialize, issued, branchExecute, inWriteback;
+  memOpType opType;
+  ap_uint<32> writebackPc;
+#if COMPRESSED_ISA
+  dataflowFetch(dataflow, core.pc, core.fetchBuffer, redirected);
+#else
+  dataflowFetch(dataflow, core.pc, redirected);
+#endif
+  dataflowDecode(dataflow, core, retired, hazard, serialize, issued, dctoEx_temp);
+  dataflowExecute(dataflow, branchExecute);
+  dataflowMemory(dataflow, core, opType, memtoWB_temp);
+  dataflowWriteback(dataflow, wbOut_temp, writebackPc, inWriteback);
+#ifndef __HLS__
+  const bool branchDecode       = issued && dctoEx_temp.isBranch;
+  const unsigned short bypasses = issued ? registerBypasses(core.regFile, dctoEx_temp, forwardRegisters) : 0;
+#endif
+  core.regFile.update(true);
+
+  // Csr writes of execute come back to the hart after the counters of the cycle
+  const bool csrWrite = dataflow.csrWrites.canRead();
+  struct CsrWrite write;
+  if (csrWrite)
+    write = dataflow.csrWrites.pop();
+
+  dataflow.fetchToDecode.tick();
+  dataflow.decodeToExecute.tick();
+  dataflow.executeToMemory.tick();
+  dataflow.memoryToWriteback.tick();
+  dataflow.executeRedirects.tick();
+  dataflow.decodeRedirects.tick();
+  dataflow.retires.tick();
+  dataflow.csrWrites.tick();
+
+  dataflow.retired   = inWriteback && wbOut_temp.we;
+  dataflow.retiredPc = writebackPc;
+
+  bool events[NB_HPM_EVENTS];
+  events[HPM_LOAD_USE_STALL] = hazard && !serialize;
+  events[HPM_BRANCH_FLUSH]   = redirected;
+  events[HPM_IM_STALL]       = dataflow.stallIm;
+  events[HPM_DM_STALL]       = dataflow.stallDm;
+  events[HPM_IM_MISS]        = dataflow.im->miss;
+  events[HPM_DM_MISS]        = opType != NONE && dataflow.dm->miss; // only clocked with a request
+
+  if (!core.csr.mcountinhibit[0])
+    core.csr.mcycle++;
+  if (!core.csr.mcountinhibit[2] && retired)
+    core.csr.minstret++;
+  for (int oneCounter = 0; oneCounter < NB_HPM_EVENTS; oneCounter++) {
+    if (events[oneCounter] && !core.csr.mcountinhibit[oneCounter + 3])
+      core.csr.mhpmcounter[oneCounter]++;
   }
-  return;
+  if (csrWrite)
+    writeCsr(core.csr, write.csr, write.value);
+
+  // CPI stack, from what leaves writeback: a retired instruction, a killed one, or
+  // nothing because of the first stage which holds the flow
+  ap_uint<4> cycleClass;
+  if (dataflow.retired)
+    cycleClass = CYCLE_RETIRE;
+  else if (inWriteback)
+    cycleClass = wbOut_temp.bubble;
+  else if (dataflow.stallDm)
+    cycleClass = CYCLE_DM_STALL;
+  else if (hazard)
+    cycleClass = serialize ? CYCLE_SERIALIZE : CYCLE_LOAD_USE;
+  else if (dataflow.stallIm)
+    cycleClass = CYCLE_IM_STALL;
+  else
+    cycleClass = CYCLE_BUBBLE;
+  core.cycleClasses[cycleClass]++;
+
+#ifndef __HLS__
+  core.lastCycle.stalls     = (hazard << STALL_DECODE) | (dataflow.stallIm << 5) | (dataflow.stallDm << 6);
+  core.lastCycle.forwards   = bypasses;
+  core.lastCycle.branches   = branchDecode | (branchExecute << 1);
+  core.lastCycle.cycleClass = cycleClass;
+  core.lastCycle.memOpType  = isAmo(opType) ? STORE : opType;
+  core.lastCycle.memMask    = traceMask;
+  core.lastCycle.memAddr    = (opType != NONE) ? (unsigned int)memtoWB_temp.address : 0;
+#endif
+
+  core.cycle++;
+  threadSyscalls(&core, running);
+}
+#endif
+
+// Kernel top level. A call runs one program: the harts are reset, hart 0 starts
+// at startPc with stackPointer in sp, and the call returns when hart 0 calls exit
+// or after maxCycles cycles (0 for no limit). The data caches are then written back,
+// so that the host reads the results in dmData, loads the next program and calls
+// doCore again. start, idle and done are the ap_ctrl_hs signals of the control
+// block, the other registers of the block are the arguments.
+void doCore(const ap_uint<32> startPc, const ap_uint<32> stackPointer, const ap_uint<32> maxCycles,
+            ap_uint<2>& status, ap_uint<32>& exitCode, ap_uint<64>& cycles, ap_uint<64>& instret,
+            ap_uint<32> imData[1 << 24], ap_uint<32> dmData[1 << 24])
+{
+#pragma HLS INTERFACE m_axi port = imData offset = slave bundle = im
+#pragma HLS INTERFACE m_axi port = dmData offset = slave bundle = dm
+#pragma HLS INTERFACE s_axilite port = startPc bundle = control
+#pragma HLS INTERFACE s_axilite port = stackPointer bundle = control
+#pragma HLS INTERFACE s_axilite port = maxCycles bundle = control
+#pragma HLS INTERFACE s_axilite port = status bundle = control
+#pragma HLS INTERFACE s_axilite port = exitCode bundle = control
+#pragma HLS INTERFACE s_axilite port = cycles bundle = control
+#pragma HLS INTERFACE s_axilite port = instret bundle = control
+#pragma HLS INTERFACE s_axilite port = return bundle = control
+
+  Core cores[NB_CORES];
+  bool running[NB_CORES];
+  // Each field of the pipeline registers is a register of its own
+#pragma HLS DISAGGREGATE variable = cores
+#pragma HLS ARRAY_PARTITION variable = cores complete
+#pragma HLS ARRAY_PARTITION variable = running complete
+
+#if BARREL_CORE
+  // The harts share the pipeline and the memory interfaces of the barrel core
+  BarrelCore barrel;
+#pragma HLS DISAGGREGATE variable = barrel
+  MEMORY_INTERFACE<4> imInterface(imData);
+  MEMORY_INTERFACE<4> dmInterface(dmData);
+#if ICACHE_SETS
+  CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE> imCache(&imInterface, false);
+  barrel.im = &imCache;
+#else
+  barrel.im = &imInterface;
+#endif
+#if DCACHE_SETS
+  CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE> dmCache(&dmInterface, false);
+  barrel.dm = &dmCache;
+#else
+  barrel.dm = &dmInterface;
+#endif
+  initBarrel(barrel);
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++) {
+    initCore(cores[oneCore], oneCore, startPc);
+    running[oneCore] = (oneCore == 0);
+  }
+#elif DATAFLOW_CORE
+  // The stages are the processes of dataflow, the channels their registers
+  DataflowCore dataflow;
+#pragma HLS DISAGGREGATE variable = dataflow
+  MEMORY_INTERFACE<4> imInterface(imData);
+  MEMORY_INTERFACE<4> dmInterface(dmData);
+#if ICACHE_SETS
+  CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE> imCache(&imInterface, false);
+  dataflow.im = &imCache;
+#else
+  dataflow.im = &imInterface;
+#endif
+#if DCACHE_SETS
+  CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE> dmCache(&dmInterface, false);
+  dataflow.dm = &dmCache;
+#else
+  dataflow.dm = &dmInterface;
+#endif
+  initDataflow(dataflow);
+  initCore(cores[0], 0, startPc);
+  running[0] = true;
+#else
+  // Every hart has its own interfaces on the shared memories
+  MEMORY_INTERFACE<4> imInterfaces[NB_CORES];
+  MEMORY_INTERFACE<4> dmInterfaces[NB_CORES];
+#if ICACHE_SETS
+  CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE> imCaches[NB_CORES];
+#endif
+#if DCACHE_SETS && DCACHE_COHERENT
+  SnoopBus<4, DCACHE_LINE_SIZE, DCACHE_SETS, NB_CORES> dmBus(&dmInterfaces[0]);
+  CoherentCacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, NB_CORES> dmCaches[NB_CORES];
+#elif DCACHE_SETS
+  CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE> dmCaches[NB_CORES];
+#endif
+
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++) {
+    imInterfaces[oneCore] = MEMORY_INTERFACE<4>(imData);
+    dmInterfaces[oneCore] = MEMORY_INTERFACE<4>(dmData);
+#if ICACHE_SETS
+    imCaches[oneCore]  = CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE>(&imInterfaces[oneCore], false);
+    cores[oneCore].im = &imCaches[oneCore];
+#else
+    cores[oneCore].im = &imInterfaces[oneCore];
+#endif
+#if DCACHE_SETS && DCACHE_COHERENT
+    // The caches share the interface of hart 0 through the bus
+    dmCaches[oneCore].attach(&dmBus, oneCore);
+    cores[oneCore].dm = &dmCaches[oneCore];
+#elif DCACHE_SETS
+    dmCaches[oneCore]  = CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE>(&dmInterfaces[oneCore], false);
+    cores[oneCore].dm = &dmCaches[oneCore];
+#else
+    cores[oneCore].dm = &dmInterfaces[oneCore];
+#endif
+    initCore(cores[oneCore], oneCore, startPc);
+    running[oneCore] = (oneCore == 0);
+  }
+#endif
+  cores[0].regFile.set(2, stackPointer);
+
+  ap_uint<32> elapsed = 0;
+  while (running[0] && (maxCycles == 0 || elapsed < maxCycles)) {
+    // One cycle of the processor per iteration, the nested loops (harts, counters)
+    // are unrolled. II = 1 is the target, no synthesis report backs it yet. Each
+    // memory pointer is set once above, to the object of the configuration, so
+    // that its process() is resolved statically. imData is only read. A store to
+    // dmData in one cycle can be read by a load of the next one, so its dependency stays.
+#pragma HLS PIPELINE II = 1
+#pragma HLS DEPENDENCE variable = imData type = inter false
+#if BARREL_CORE
+    doBarrel(barrel, cores, running, false);
+#elif DATAFLOW_CORE
+    doDataflow(dataflow, cores[0], running);
+#else
+    doHarts(cores, running, false);
+#endif
+    elapsed++;
+  }
+
+  // Dirty lines go back to dmData before done is raised
+#if BARREL_CORE
+  drainBarrel(barrel);
+#endif
+#if (BARREL_CORE || DATAFLOW_CORE) && DCACHE_SETS
+  dmCache.flush(false);
+#elif DCACHE_SETS && DCACHE_COHERENT
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++)
+    dmCaches[oneCore].flush();
+#elif DCACHE_SETS
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++)
+    dmCaches[oneCore].flush(false);
+#endif
+
+  status   = running[0] ? CORE_BUDGET : CORE_EXITED;
+  exitCode = cores[0].regFile[10];
+  cycles   = cores[0].csr.mcycle;
+  instret  = cores[0].csr.minstret;
 }
@@ -22,11 +22,81 @@
 
 // all the possible memories
 #include "cacheMemory.h"
+#include "coherentCache.h"
+#include "customAccelerator.h"
 #include "memoryInterface.h" // finished
+#include "pipelineChannel.h"
 #include "pipelineRegisters.h" //finished
+#include "registerFile.h"
 
+// Memory model used by doCore for the instruction and data memories:
+// IncompleteMemory, SimpleMemory or TimingMemory (DRAM latency/bandwidth model)
 #ifndef MEMORY_INTERFACE
-#define MEMORY_INTERFACE SimpleMemory
+#define MEMORY_INTERFACE IncompleteMemory
+#endif
+
+// Optional caches in front of the instruction and data memories (0 sets means
+// no cache). They are usually set on the command line, see dse.py.
+#ifndef ICACHE_SETS
+#define ICACHE_SETS 0
+#endif
+#ifndef ICACHE_LINE_SIZE
+#define ICACHE_LINE_SIZE 16
+#endif
+#ifndef ICACHE_VICTIM_SIZE
+#define ICACHE_VICTIM_SIZE 4
+#endif
+#ifndef DCACHE_SETS
+#define DCACHE_SETS 0
+#endif
+#ifndef DCACHE_LINE_SIZE
+#define DCACHE_LINE_SIZE 16
+#endif
+#ifndef DCACHE_VICTIM_SIZE
+#define DCACHE_VICTIM_SIZE 4
+#endif
+
+// Number of harts of doCore. They share the instruction and data memories, each
+// one with its own interfaces and caches. Only hart 0 runs at reset, the others
+// are started by the SYS_threadstart syscall (see threadSyscalls).
+#ifndef NB_CORES
+#define NB_CORES 1
+#endif
+
+// With BARREL_CORE, the harts are the thread contexts of a single fine-grained
+// multithreaded pipeline instead (see BarrelCore)
+#ifndef BARREL_CORE
+#define BARREL_CORE 0
+#endif
+
+// With DATAFLOW_CORE, the single hart runs on the decoupled pipeline of
+// DataflowCore instead of doCycle
+#ifndef DATAFLOW_CORE
+#define DATAFLOW_CORE 0
+#endif
+#if DATAFLOW_CORE && (NB_CORES > 1 || BARREL_CORE)
+#error "The dataflow core has a single hart"
+#endif
+
+// With COMPRESSED_ISA, the cores implement RV32C: fetch realigns the instructions
+// on half words (see FetchBuffer) and decode expands the compressed ones
+#ifndef COMPRESSED_ISA
+#define COMPRESSED_ISA 0
+#endif
+
+// With CUSTOM_ACCELERATOR, every hart has an ACCELERATOR_TYPE which serves the
+// instructions of the custom-0 and custom-1 opcodes (see customAccelerator.h)
+#ifndef CUSTOM_ACCELERATOR
+#define CUSTOM_ACCELERATOR 0
+#endif
+#ifndef ACCELERATOR_TYPE
+#define ACCELERATOR_TYPE Dct8Accelerator
+#endif
+
+// With several cores, the data caches are CoherentCacheMemory on a snooping bus
+// (DCACHE_LINE_SIZE and DCACHE_SETS apply, there is no victim buffer)
+#ifndef DCACHE_COHERENT
+#define DCACHE_COHERENT (NB_CORES > 1 && !BARREL_CORE)
 #endif
 
 /******************************************************************************************
@@ -35,6 +105,75 @@
  */
 enum StallNames{ STALL_FETCH = 0, STALL_DECODE = 1, STALL_EXECUTE = 2, STALL_MEMORY = 3, STALL_WRITEBACK = 4 };
 
+/******************************************************************************************
+ * Events counted by the performance counters mhpmcounter3 and following
+ * ****************************************************************************************
+ */
+enum HpmEventNames{ HPM_LOAD_USE_STALL = 0, HPM_BRANCH_FLUSH = 1, HPM_IM_STALL = 2, HPM_DM_STALL = 3,
+                    HPM_IM_MISS = 4, HPM_DM_MISS = 5, NB_HPM_EVENTS = 6 };
+
+/******************************************************************************************
+ * Classes of cycles, used to build a CPI stack
+ * Every cycle falls in exactly one class: either an instruction retires, or the whole
+ * pipeline is frozen (memory or global stall), or writeback receives a bubble. A bubble
+ * carries the cause which created it down the pipeline registers. Pipeline registers
+ * at reset hold CYCLE_BUBBLE (pipeline fill). CYCLE_SERIALIZE is decode waiting for a
+ * csr write or an ecall ahead of it, CYCLE_LOAD_USE only the hazards of the forward unit.
+ * ****************************************************************************************
+ */
+enum CycleClassNames{ CYCLE_BUBBLE = 0, CYCLE_RETIRE = 1, CYCLE_IM_STALL = 2, CYCLE_DM_STALL = 3,
+                      CYCLE_LOAD_USE = 4, CYCLE_BRANCH_DECODE = 5, CYCLE_BRANCH_EXECUTE = 6,
+                      CYCLE_GLOBAL_STALL = 7, CYCLE_SERIALIZE = 8, NB_CYCLE_CLASSES = 9 };
+
+/******************************************************************************************
+ * Control and status registers
+ * ****************************************************************************************
+ */
+struct CSR {
+  ap_uint<64> mcycle;
+  ap_uint<64> minstret;
+  ap_uint<64> mhpmcounter[NB_HPM_EVENTS]; // mhpmcounter3 is mhpmcounter[0]
+  ap_uint<32> mcountinhibit;
+  ap_uint<32> mscratch;
+  ap_uint<32> mhartid; // read only
+};
+
+#ifndef __HLS__
+/******************************************************************************************
+ * Snapshot of one cycle, filled by doCycle for the host-side pipeline trace
+ * Stages are fetch, decode, execute, memory and writeback, pcs are the ones of the
+ * instructions in each stage during the cycle.
+ * ****************************************************************************************
+ */
+struct CycleTrace {
+  unsigned int pc[5];
+  unsigned char valid;      // one bit per stage, set when the stage holds an instruction
+  unsigned char stalls;     // stallSignals in bits [4:0], then stallIm, stallDm and globalStall
+  unsigned short forwards;  // forwardExtoVal1..3, forwardMemtoVal1..3, register file bypass of operands 1..3
+                            // in bits [8:0]
+  unsigned char branches;   // branch taken in decode (bit 0) and in execute (bit 1)
+  unsigned char cycleClass; // CycleClassNames
+  unsigned char memOpType;  // request sent to the data memory, atomic operations are STORE
+  unsigned char memMask;
+  unsigned int memAddr;
+};
+#endif
+
+#if COMPRESSED_ISA
+/******************************************************************************************
+ * Fetch buffer of a hart
+ * The upper half of the last word fetched, keyed by its address: with compressed code, it
+ * is the next instruction or the first half of a 32 bits instruction which straddles two
+ * words. Instruction memory is read only, the buffer never needs to be invalidated.
+ * ****************************************************************************************
+ */
+struct FetchBuffer {
+  bool valid;
+  ap_uint<32> address;
+  ap_uint<16> half;
+};
+#endif
+
 // This is ugly but otherwise with have a dependency : alu.h includes core.h
 // (for pipeline regs) and core.h includes alu.h...
 
@@ -47,12 +186,36 @@ struct Core {
   // Interface size are configured with 4 bytes interface size (32 bits)
   MemoryInterface<4>*dm, *im;
 
-  ap_int<32> regFile[32];
+  RegisterFile regFile;
   ap_uint<32> pc;
+#if COMPRESSED_ISA
+  struct FetchBuffer fetchBuffer;
+#endif
+#if CUSTOM_ACCELERATOR
+  ACCELERATOR_TYPE accelerator;
+#endif
+
+  struct CSR csr;
+  ap_uint<64> cycleClasses[NB_CYCLE_CLASSES]; // CPI stack, indexed by CycleClassNames
+#ifndef __HLS__
+  struct CycleTrace lastCycle; // what happened during the last call to doCycle
+#endif
 
   // stall
   bool stallSignals[5] = {0, 0, 0, 0, 0};
   bool stallIm, stallDm;
+  bool syscall; // an ecall retired during the last cycle, the top level answers it in a0
+  // Started by SYS_threadstart: its argument goes to a0 on the next cycle, then the
+  // hart runs (a bank of the register file takes one write per cycle)
+  bool starting;
+  ap_int<32> startArgument;
+
+  // Reservation of LR/SC, on a word. Stores of the other harts to this word cancel
+  // it (see doHarts), the dm request of the last cycle is here for that purpose.
+  bool reservationValid;
+  ap_uint<30> reservationAddress;
+  bool dmWrite;
+  ap_uint<30> dmWriteAddress;
   unsigned long cycle;
   /// Multicycle operation
 
@@ -65,6 +228,173 @@ struct Core {
   // modelsim
 };
 
+void initCore(struct Core& core, const ap_uint<32> hartId, const ap_uint<32> pc);
 void doCycle(struct Core& core, bool globalStall);
+void threadSyscalls(struct Core cores[NB_CORES], bool running[NB_CORES]);
+void doHarts(struct Core cores[NB_CORES], bool running[NB_CORES], bool globalStall);
+
+#if BARREL_CORE
+/******************************************************************************************
+ * Fine-grained multithreaded (barrel) core
+ * The NB_CORES harts are thread contexts (the register file, pc, csr and reservation of
+ * their Core) sharing one pipeline and one pair of memory interfaces. Fetch takes the next
+ * thread in round robin every cycle and each pipeline register carries the thread of its
+ * instruction, so that forwards and branches only apply within a thread.
+ * Hazards which stall the single-thread pipeline (load-use, csr, ecall) send the
+ * instruction in decode back to fetch instead, the other threads go on. A load which
+ * misses switches its thread out: the memory keeps serving the miss while the other
+ * threads run, then the thread replays the load, which reads the data kept for it. A
+ * store which misses is posted and retires. Atomics, SC and FENCE keep the pipeline
+ * frozen until the memory answers, as in doCycle.
+ * ****************************************************************************************
+ */
+struct BarrelCore {
+  FtoDC ftoDC;
+  DCtoEx dctoEx;
+  ExtoMem extoMem;
+  MemtoWB memtoWB;
+  ap_uint<8> threadDC, threadEx, threadMem, threadWB; // thread of the instruction in each pipeline register
+
+  MemoryInterface<4>*dm, *im;
+
+  // Thread of the last fetch, it keeps the instruction memory until its miss is served
+  ap_uint<8> fetchThread;
+  ap_uint<32> fetchPc;
+  bool fetchPending;
+
+  // Request served by the data memory in the background, the memory stage only uses
+  // the data memory again when it is done. Threads switched out wait for it.
+  bool missPending;
+  ap_uint<8> missThread;
+  ap_uint<32> missPc;
+  ap_uint<32> missAddress;
+  memMask missMask;
+  memOpType missOpType;
+  ap_uint<32> missValue;
+  bool waiting[NB_CORES];
+
+  // Data of the last load miss of each thread, until its replay. Stores to the word drop it.
+  bool fillValid[NB_CORES];
+  ap_uint<32> fillAddress[NB_CORES];
+  memMask fillMask[NB_CORES];
+  ap_uint<32> fillData[NB_CORES];
+
+  bool stallDm; // the data memory froze the pipeline during the last cycle
+  ap_uint<64> cycleClasses[NB_CYCLE_CLASSES]; // CPI stack of the pipeline
+  unsigned long cycle;
+  unsigned long numberSwitches; // threads switched out for the data memory
+#ifndef __HLS__
+  struct CycleTrace lastCycle;
+#endif
+};
+
+void initBarrel(struct BarrelCore& barrel);
+void doBarrel(struct BarrelCore& barrel, struct Core threads[NB_CORES], bool running[NB_CORES], bool globalStall);
+#endif
+
+#if DATAFLOW_CORE
+/******************************************************************************************
+ * Decoupled (dataflow) core
+ * Fetch, decode, execute, memory and writeback are processes of their own: each one keeps
+ * its state and only talks to the others through PipelineChannel, so that no path goes
+ * through more than one stage in a cycle. Instructions flow forward in the channels, and
+ * three feedback channels carry the hazards back: the redirections of the branches to
+ * fetch, the results written back and the csr writes to decode.
+ * Decode owns the register file and the csr of the hart (its Core). It keeps a scoreboard
+ * of the registers written by the instructions in flight, an instruction waits in decode
+ * until its operands come back from writeback: there is no forwarding. A system
+ * instruction waits for the pipeline to be empty and holds decode until it retires, as
+ * the syscall answer of threadSyscalls and the csr writes come back through the hart.
+ * Fetch tags its instructions with two epochs, one per stage which redirects it: a taken
+ * branch in execute changes the execute epoch and kills the instructions of the former
+ * one when they reach execute, a jump in decode changes the decode epoch and decode drops
+ * the instructions fetched behind it.
+ * ****************************************************************************************
+ */
+struct FetchToken {
+  struct FtoDC ftoDC;
+  bool executeEpoch;
+  bool decodeEpoch;
+};
+
+struct DecodeToken {
+  struct DCtoEx dctoEx;
+  bool executeEpoch;
+  ap_uint<5> release; // register of the scoreboard freed when the instruction leaves writeback, 0 for none
+};
+
+struct ExecuteToken {
+  struct ExtoMem extoMem;
+  ap_uint<5> release;
+};
+
+struct MemoryToken {
+  struct MemtoWB memtoWB;
+  ap_uint<5> release;
+};
+
+// Every instruction comes back to decode, the killed ones only release the scoreboard
+struct RetireToken {
+  struct WBOut wbOut;
+  ap_uint<5> release;
+};
+
+struct Redirect {
+  ap_uint<32> pc;
+  bool executeEpoch; // epochs of fetch after the redirection
+  bool decodeEpoch;
+};
+
+struct CsrWrite {
+  ap_uint<12> csr;
+  ap_uint<32> value;
+};
+
+struct DataflowCore {
+  // Forward channels
+  PipelineChannel<struct FetchToken> fetchToDecode;
+  PipelineChannel<struct DecodeToken> decodeToExecute;
+  PipelineChannel<struct ExecuteToken> executeToMemory;
+  PipelineChannel<struct MemoryToken> memoryToWriteback;
+
+  // Feedback channels
+  PipelineChannel<struct Redirect> executeRedirects, decodeRedirects;
+  PipelineChannel<struct RetireToken> retires;
+  PipelineChannel<struct CsrWrite> csrWrites;
+
+  MemoryInterface<4>*dm, *im;
+
+  // Fetch: the pc of a miss is kept until the memory answers
+  ap_uint<32> requestPc;
+  bool fetchPending;
+  bool fetchExecuteEpoch, fetchDecodeEpoch;
+
+  // Decode
+  ap_uint<4> busy[32]; // instructions in flight which write each register
+  ap_uint<4> inFlight;
+  bool systemInFlight;
+  bool decodeExecuteEpoch, decodeDecodeEpoch;
+
+  // Execute
+  bool executeEpoch;
+
+  bool stallIm, stallDm; // the memories kept fetch or memory waiting during the last cycle
+  bool retired;          // an instruction retired during the last cycle, at retiredPc
+  ap_uint<32> retiredPc;
+#ifndef __HLS__
+  struct CycleTrace lastCycle;
+#endif
+};
+
+void initDataflow(struct DataflowCore& dataflow);
+void doDataflow(struct DataflowCore& dataflow, struct Core& core, bool running[NB_CORES]);
+#endif
+
+// Why a run of doCore ended
+enum CoreStatus { CORE_EXITED = 0, CORE_BUDGET = 1 };
+
+void doCore(const ap_uint<32> startPc, const ap_uint<32> stackPointer, const ap_uint<32> maxCycles,
+            ap_uint<2>& status, ap_uint<32>& exitCode, ap_uint<64>& cycles, ap_uint<64>& instret,
+            ap_uint<32> imData[1 << 24], ap_uint<32> dmData[1 << 24]);
 
 #endif // __CORE_H__
@@ -0,0 +1,152 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// Array of independent cores in one kernel, for throughput computing: every core
+// runs its own job (see CoreJob) and the host dispatches jobs to the cores as
+// they become idle.
+
+#include "ap_int.h"
+#include "cacheMemory.h"
+#include "coreArray.h"
+
+void initCoreArray(struct CoreArray& array, MemoryArbiter<4, ARRAY_CORES>* imArbiter,
+                   MemoryArbiter<4, ARRAY_CORES>* dmArbiter)
+{
+  array.imArbiter = imArbiter;
+  array.dmArbiter = dmArbiter;
+  for (int oneCore = 0; oneCore < ARRAY_CORES; oneCore++) {
+    initCore(array.cores[oneCore], oneCore, 0);
+    array.cores[oneCore].im = &imArbiter->ports[oneCore];
+    array.cores[oneCore].dm = &dmArbiter->ports[oneCore];
+    array.states[oneCore]   = ARRAY_IDLE;
+  }
+  array.cycle = 0;
+}
+
+// One cycle of every core. Returns true when the host has something to do: a job
+// finished, or no core is busy.
+bool doArrayCycle(struct CoreArray& array, struct CoreJob jobs[ARRAY_CORES])
+{
+  bool finished = false;
+  bool busy     = false;
+
+  for (int oneCore = 0; oneCore < ARRAY_CORES; oneCore++) {
+    struct Core& core = array.cores[oneCore];
+    struct CoreJob& job = jobs[oneCore];
+
+    switch (array.states[oneCore]) {
+      case ARRAY_IDLE:
+        if (job.start) {
+          // Nothing is left of the previous job: registers, accelerator
+          initCore(core, oneCore, job.pc);
+          for (int oneRegister = 0; oneRegister < 32; oneRegister++)
+            core.regFile.set(oneRegister, oneRegister == 2 ? (ap_int<32>)job.sp : (ap_int<32>)0);
+#if CUSTOM_ACCELERATOR
+          core.accelerator = ACCELERATOR_TYPE();
+#endif
+          array.dmArbiter->ports[oneCore].base = job.dataBase;
+          job.start                            = false;
+          job.done                             = false;
+          array.states[oneCore]                = ARRAY_RUNNING;
+        }
+        break;
+
+      case ARRAY_RUNNING:
+        doCycle(core, false);
+        // Exit is the only syscall of a job, the other ones are ignored
+        if (core.syscall && core.regFile.a7 == SYS_exit) {
+          job.exitCode              = core.regFile.a0;
+          job.cycles                = core.csr.mcycle;
+          job.instret               = core.csr.minstret;
+          array.imFlushed[oneCore]  = false;
+          array.dmFlushed[oneCore]  = false;
+          array.states[oneCore]     = ARRAY_FLUSHING;
+        }
+        break;
+
+      case ARRAY_FLUSHING: {
+        // The results go back to memory and the next job starts with empty caches
+        ap_uint<32> unused;
+        bool wait;
+        if (!array.dmFlushed[oneCore]) {
+          wait = false;
+          core.dm->process(0, WORD, FLUSH_INVALIDATE, 0, unused, wait);
+          array.dmFlushed[oneCore] = !wait;
+        }
+        if (!array.imFlushed[oneCore]) {
+          wait = false;
+          core.im->process(0, WORD, FLUSH_INVALIDATE, 0, unused, wait);
+          array.imFlushed[oneCore] = !wait;
+        }
+        if (array.dmFlushed[oneCore] && array.imFlushed[oneCore]) {
+          job.done              = true;
+          finished              = true;
+          array.states[oneCore] = ARRAY_IDLE;
+        }
+        break;
+      }
+    }
+    busy |= (array.states[oneCore] != ARRAY_IDLE);
+  }
+
+  array.imArbiter->tick();
+  array.dmArbiter->tick();
+  array.cycle++;
+  return finished || !busy;
+}
+
+// Top level: runs the array until a job finishes, no core is busy or maxCycles
+// cycles have passed. The cores, their caches and the arbiters keep their state
+// from one call to the next, so that the host gives a new job to a core while the
+// other ones go on.
+void doCoreArray(struct CoreJob jobs[ARRAY_CORES], const ap_uint<32> maxCycles, ap_uint<32> imData[1 << 24],
+                 ap_uint<32> dmData[1 << 24])
+{
+  static MEMORY_INTERFACE<4> imInterface(imData);
+  static MEMORY_INTERFACE<4> dmInterface(dmData);
+  static MemoryArbiter<4, ARRAY_CORES> imArbiter(&imInterface);
+  static MemoryArbiter<4, ARRAY_CORES> dmArbiter(&dmInterface);
+#if ICACHE_SETS
+  static CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE> imCaches[ARRAY_CORES];
+#endif
+#if DCACHE_SETS
+  static CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE> dmCaches[ARRAY_CORES];
+#endif
+  static CoreArray array;
+  static bool initialized = false;
+
+  if (!initialized) {
+    initCoreArray(array, &imArbiter, &dmArbiter);
+    for (int oneCore = 0; oneCore < ARRAY_CORES; oneCore++) {
+#if ICACHE_SETS
+      imCaches[oneCore].nextLevel = &imArbiter.ports[oneCore];
+      array.cores[oneCore].im = &imCaches[oneCore];
+#endif
+#if DCACHE_SETS
+      dmCaches[oneCore].nextLevel = &dmArbiter.ports[oneCore];
+      array.cores[oneCore].dm = &dmCaches[oneCore];
+#endif
+    }
+    initialized = true;
+  }
+  // The host may pass other buffers from one call to the next
+  imInterface.bind(imData);
+  dmInterface.bind(dmData);
+
+  for (ap_uint<32> oneCycle = 0; oneCycle < maxCycles; oneCycle++) {
+    if (doArrayCycle(array, jobs))
+      break;
+  }
+}
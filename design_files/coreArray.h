@@ -0,0 +1,67 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef __CORE_ARRAY_H__
+#define __CORE_ARRAY_H__
+
+#include "core.h"
+#include "memoryArbiter.h"
+
+// Number of independent cores of doCoreArray. Each one has its own caches
+// (ICACHE_* and DCACHE_* of core.h), the caches share the instruction and data
+// memory ports through a MemoryArbiter.
+#ifndef ARRAY_CORES
+#define ARRAY_CORES 4
+#endif
+
+/******************************************************************************************
+ * Control and status of one core of the array
+ * The host sets the entry pc, the stack pointer and the data window of a job, then start.
+ * The core clears start when it takes the job. It sets done when the program has called
+ * exit and the caches have been written back and emptied, the host can then read the
+ * results in the data window and give the next job.
+ * ****************************************************************************************
+ */
+struct CoreJob {
+  bool start;
+  ap_uint<32> pc;
+  ap_uint<32> sp;
+  ap_uint<32> dataBase; // added to every data address of the job
+
+  bool done;
+  ap_uint<32> exitCode; // a0 at exit
+  ap_uint<64> cycles;
+  ap_uint<64> instret;
+};
+
+enum ArrayCoreStates{ ARRAY_IDLE = 0, ARRAY_RUNNING = 1, ARRAY_FLUSHING = 2 };
+
+struct CoreArray {
+  struct Core cores[ARRAY_CORES];
+  ap_uint<2> states[ARRAY_CORES]; // ArrayCoreStates
+  bool imFlushed[ARRAY_CORES], dmFlushed[ARRAY_CORES];
+
+  MemoryArbiter<4, ARRAY_CORES>*imArbiter, *dmArbiter;
+  unsigned long cycle;
+};
+
+// The cores use the ports of the arbiters, caches may then be put in front of them
+void initCoreArray(struct CoreArray& array, MemoryArbiter<4, ARRAY_CORES>* imArbiter,
+                   MemoryArbiter<4, ARRAY_CORES>* dmArbiter);
+bool doArrayCycle(struct CoreArray& array, struct CoreJob jobs[ARRAY_CORES]);
+void doCoreArray(struct CoreJob jobs[ARRAY_CORES], const ap_uint<32> maxCycles, ap_uint<32> imData[1 << 24],
+                 ap_uint<32> dmData[1 << 24]);
+
+#endif // __CORE_ARRAY_H__
@@ -0,0 +1,437 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// Host throughput of the simulator: how long doCycle, the pipeline stages and
+// the memory models take on the host, on a fixed instruction mix and a fixed
+// address stream. Each benchmark is run several times and the fastest run is
+// kept. When perf_event_open is allowed, host cycles, IPC, cache and branch
+// misses are measured over the same run.
+//
+// g++ -O2 -I<vitis>/include coreBench.cpp core.cpp riscvISA.cpp
+// coreBench [-s scale] [-f filter] [-o results] [-b baseline] [-t threshold%]
+//
+// -o writes "name ns/op" lines, -b compares with such a file and the exit code
+// is 1 when a benchmark is slower than its baseline by more than the threshold
+// (default 5%).
+
+#include <asm/unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <linux/perf_event.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <vector>
+#include "core.h"
+
+#define MEMORY_WORDS (1 << 20)
+#define DATA_BASE    0x100000
+#define REPEATS      5
+
+// Pipeline stages of core.cpp, which core.h does not export
+void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const RegisterFile& registerFile, const struct CSR& csr);
+void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem);
+
+static ap_uint<32> imData[MEMORY_WORDS];
+static ap_uint<32> dmData[MEMORY_WORDS];
+static volatile unsigned int sink; // keeps the results of the benchmarks alive
+
+/************************************************************************
+ * Instruction mix: an endless loop with ALU operations, loads and stores
+ * (with a load-use dependency), a data-dependent branch, a call and a return.
+ ************************************************************************/
+static unsigned int encodeR(int funct7, int rs2, int rs1, int funct3, int rd, int opcode)
+{
+  return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static unsigned int encodeI(int imm, int rs1, int funct3, int rd, int opcode)
+{
+  return ((imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static unsigned int encodeS(int imm, int rs2, int rs1, int funct3)
+{
+  return (((imm >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((imm & 0x1f) << 7) | RISCV_ST;
+}
+
+static unsigned int encodeB(int offset, int rs2, int rs1, int funct3)
+{
+  return (((offset >> 12) & 1) << 31) | (((offset >> 5) & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) |
+         (((offset >> 1) & 0xf) << 8) | (((offset >> 11) & 1) << 7) | RISCV_BR;
+}
+
+static unsigned int encodeJ(int offset, int rd)
+{
+  return (((offset >> 20) & 1) << 31) | (((offset >> 1) & 0x3ff) << 21) | (((offset >> 11) & 1) << 20) |
+         (((offset >> 12) & 0xff) << 12) | (rd << 7) | RISCV_JAL;
+}
+
+static std::vector<unsigned int> instructionMix()
+{
+  enum { ZERO = 0, RA = 1, T0 = 5, T1 = 6, T2 = 7, S0 = 8, A0 = 10, A1, A2, A3, A4, A5, A6, A7, T3 = 28, T4, T5, T6 };
+  std::vector<unsigned int> program;
+  program.push_back((DATA_BASE & 0xfffff000) | (S0 << 7) | RISCV_LUI);
+  const int loop = program.size() * 4;
+  program.push_back(encodeI(1, T0, 0, T0, RISCV_OPI));        // addi t0, t0, 1
+  program.push_back(encodeR(0, T0, T1, 0, T1, RISCV_OP));     // add t1, t1, t0
+  program.push_back(encodeI(0, S0, 2, T2, RISCV_LD));         // lw t2, 0(s0)
+  program.push_back(encodeR(0, T1, T2, 4, T3, RISCV_OP));     // xor t3, t2, t1
+  program.push_back(encodeS(4, T3, S0, 2));                   // sw t3, 4(s0)
+  program.push_back(encodeI(2, T0, 1, T4, RISCV_OPI));        // slli t4, t0, 2
+  program.push_back(encodeI(0x7fc, T4, 7, T4, RISCV_OPI));    // andi t4, t4, 0x7fc
+  program.push_back(encodeR(0, T4, S0, 0, T5, RISCV_OP));     // add t5, s0, t4
+  program.push_back(encodeI(0, T5, 2, T6, RISCV_LD));         // lw t6, 0(t5)
+  program.push_back(encodeR(0, T6, A0, 0, A0, RISCV_OP));     // add a0, a0, t6 (load-use)
+  program.push_back(encodeR(0, T1, T0, 3, A1, RISCV_OP));     // sltu a1, t0, t1
+  program.push_back(encodeI(3, T0, 7, A7, RISCV_OPI));        // andi a7, t0, 3
+  program.push_back(encodeB(8, ZERO, A7, RISCV_BR_BNE));      // bne a7, zero, +8
+  program.push_back(encodeI(1, A2, 0, A2, RISCV_OPI));        // addi a2, a2, 1
+  const int call = program.size() * 4;
+  program.push_back(0);                                       // jal ra, function
+  program.push_back((0x12345 << 12) | (A3 << 7) | RISCV_LUI); // lui a3, 0x12345
+  program.push_back(encodeR(0x20, A0, A3, 0, A4, RISCV_OP));  // sub a4, a3, a0
+  program.push_back(encodeR(0, A2, A4, 6, A5, RISCV_OP));     // or a5, a4, a2
+  program.push_back(encodeS(8, A5, S0, 0));                   // sb a5, 8(s0)
+  program.push_back(encodeI(8, S0, 4, A6, RISCV_LD));         // lbu a6, 8(s0)
+  program.push_back(encodeJ(loop - (int)program.size() * 4, ZERO)); // j loop
+  const int function = program.size() * 4;
+  program.push_back(encodeI(3, A7, 0, A7, RISCV_OPI));        // addi a7, a7, 3
+  program.push_back(encodeI(0, RA, 0, ZERO, RISCV_JALR));     // jalr zero, 0(ra)
+  program[call / 4] = encodeJ(function - call, RA);
+  return program;
+}
+
+/************************************************************************
+ * Address stream: mostly sequential words, with random accesses over
+ * 256 KB, and one store every four requests.
+ ************************************************************************/
+struct Request {
+  unsigned int addr;
+  memOpType opType;
+};
+
+static std::vector<Request> addressStream()
+{
+  std::vector<Request> requests;
+  unsigned int seed = 1, sequential = DATA_BASE;
+  for (int oneRequest = 0; oneRequest < 4096; oneRequest++) {
+    seed = seed * 1103515245u + 12345u;
+    Request request;
+    if ((seed >> 16) % 10 < 7) {
+      request.addr = sequential;
+      sequential   = DATA_BASE + ((sequential + 4 - DATA_BASE) & 0x3fff);
+    } else
+      request.addr = DATA_BASE + ((seed >> 8) & 0x3fffc);
+    request.opType = (oneRequest % 4 == 3) ? STORE : LOAD;
+    requests.push_back(request);
+  }
+  return requests;
+}
+
+/************************************************************************
+ * Host performance counters, read over each measured run
+ ************************************************************************/
+class PerfCounters {
+public:
+  enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NB_COUNTERS };
+
+  PerfCounters()
+  {
+    const unsigned long long configs[NB_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int oneCounter = 0; oneCounter < NB_COUNTERS; oneCounter++) {
+      struct perf_event_attr attributes;
+      memset(&attributes, 0, sizeof(attributes));
+      attributes.type           = PERF_TYPE_HARDWARE;
+      attributes.size           = sizeof(attributes);
+      attributes.config         = configs[oneCounter];
+      attributes.disabled       = 1;
+      attributes.exclude_kernel = 1;
+      attributes.exclude_hv     = 1;
+      descriptors[oneCounter]   = syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+    }
+  }
+
+  ~PerfCounters()
+  {
+    for (int oneCounter = 0; oneCounter < NB_COUNTERS; oneCounter++)
+      if (descriptors[oneCounter] >= 0)
+        close(descriptors[oneCounter]);
+  }
+
+  bool available() const { return descriptors[CYCLES] >= 0; }
+
+  void start()
+  {
+    for (int oneCounter = 0; oneCounter < NB_COUNTERS; oneCounter++) {
+      if (descriptors[oneCounter] >= 0) {
+        ioctl(descriptors[oneCounter], PERF_EVENT_IOC_RESET, 0);
+        ioctl(descriptors[oneCounter], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  void stop(unsigned long long values[NB_COUNTERS])
+  {
+    for (int oneCounter = 0; oneCounter < NB_COUNTERS; oneCounter++) {
+      values[oneCounter] = 0;
+      if (descriptors[oneCounter] >= 0) {
+        ioctl(descriptors[oneCounter], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(descriptors[oneCounter], &values[oneCounter], sizeof(values[oneCounter])) != 8)
+          values[oneCounter] = 0;
+      }
+    }
+  }
+
+private:
+  int descriptors[NB_COUNTERS];
+};
+
+struct BenchResult {
+  std::string name;
+  double nsPerOp;
+  unsigned long long counters[PerfCounters::NB_COUNTERS]; // of the fastest run
+  unsigned long operations;
+};
+
+// Runs body (which performs operations operations) REPEATS times, keeps the fastest run
+static BenchResult measure(PerfCounters& perf, const char* name, const unsigned long operations,
+                           const std::function<void()>& setup, const std::function<void()>& body)
+{
+  BenchResult result;
+  result.name       = name;
+  result.operations = operations;
+  result.nsPerOp    = 1e30;
+  for (int oneRepeat = 0; oneRepeat < REPEATS; oneRepeat++) {
+    setup();
+    unsigned long long counters[PerfCounters::NB_COUNTERS];
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    perf.start();
+    body();
+    perf.stop(counters);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds * 1e9 / operations < result.nsPerOp) {
+      result.nsPerOp = seconds * 1e9 / operations;
+      memcpy(result.counters, counters, sizeof(counters));
+    }
+  }
+  return result;
+}
+
+static void resetCore(Core& core, MemoryInterface<4>* im, MemoryInterface<4>* dm)
+{
+  core            = Core(); // zero, with the pipeline registers at reset
+  core.im         = im;
+  core.dm         = dm;
+  core.regFile.set(2, (MEMORY_WORDS << 2) - 16);
+}
+
+template <class MEMORY>
+static BenchResult measureMemory(PerfCounters& perf, const char* name, MEMORY& memory,
+                                 const std::vector<Request>& requests, const unsigned long operations)
+{
+  return measure(perf, name, operations, []() {}, [&]() {
+    ap_uint<32> dataOut;
+    bool wait;
+    unsigned int total = 0;
+    for (unsigned long oneRequest = 0; oneRequest < operations; oneRequest++) {
+      const Request& request = requests[oneRequest & (requests.size() - 1)];
+      do {
+        memory.process(request.addr, WORD, request.opType, oneRequest, dataOut, wait);
+      } while (wait);
+      total += dataOut;
+    }
+    sink = total;
+  });
+}
+
+int main(int argc, char** argv)
+{
+  double scale             = 1.0;
+  const char* filter       = NULL;
+  const char* outputPath   = NULL;
+  const char* baselinePath = NULL;
+  double threshold         = 5.0;
+
+  for (int oneArg = 1; oneArg < argc; oneArg++) {
+    if (!strcmp(argv[oneArg], "-s") && oneArg + 1 < argc)
+      scale = atof(argv[++oneArg]);
+    else if (!strcmp(argv[oneArg], "-f") && oneArg + 1 < argc)
+      filter = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-o") && oneArg + 1 < argc)
+      outputPath = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-b") && oneArg + 1 < argc)
+      baselinePath = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-t") && oneArg + 1 < argc)
+      threshold = atof(argv[++oneArg]);
+    else {
+      fprintf(stderr, "Usage: %s [-s scale] [-f filter] [-o results] [-b baseline] [-t threshold%%]\n", argv[0]);
+      return -1;
+    }
+  }
+
+  const std::vector<unsigned int> program = instructionMix();
+  for (unsigned int oneInstruction = 0; oneInstruction < program.size(); oneInstruction++)
+    imData[oneInstruction] = program[oneInstruction];
+  const std::vector<Request> requests = addressStream();
+
+  PerfCounters perf;
+  if (!perf.available())
+    fprintf(stderr, "perf_event_open is not allowed (see /proc/sys/kernel/perf_event_paranoid), "
+                    "host counters are not reported\n");
+
+  const unsigned long cycles     = 2000000 * scale;
+  const unsigned long stageCalls = 5000000 * scale;
+  const unsigned long memoryOps  = 2000000 * scale;
+  std::vector<BenchResult> results;
+  auto selected = [&](const char* name) { return filter == NULL || strstr(name, filter) != NULL; };
+
+  static Core core;
+  IncompleteMemory<4> im(imData), dm(dmData);
+  if (selected("doCycle")) {
+    results.push_back(measure(perf, "doCycle", cycles, [&]() { resetCore(core, &im, &dm); }, [&]() {
+      for (unsigned long oneCycle = 0; oneCycle < cycles; oneCycle++)
+        doCycle(core, false);
+      sink = core.regFile[10];
+    }));
+  }
+
+  if (selected("doCycle+caches")) {
+    typedef CacheMemory<4, 16, 64> Cache;
+    std::unique_ptr<Cache> imCache(new Cache(&im, false));
+    std::unique_ptr<Cache> dmCache(new Cache(&dm, false));
+    // Every run starts with cold caches, reset out of the timed body
+    results.push_back(measure(perf, "doCycle+caches", cycles, [&]() {
+      *imCache = Cache(&im, false);
+      *dmCache = Cache(&dm, false);
+      resetCore(core, imCache.get(), dmCache.get());
+    }, [&]() {
+      for (unsigned long oneCycle = 0; oneCycle < cycles; oneCycle++)
+        doCycle(core, false);
+      sink = core.regFile[10];
+    }));
+  }
+
+  // Inputs of the stages, from the instructions of the mix
+  std::vector<FtoDC> fetched;
+  std::vector<DCtoEx> decoded;
+  for (unsigned int oneInstruction = 0; oneInstruction < program.size(); oneInstruction++) {
+    FtoDC ftoDC;
+    ftoDC.pc          = oneInstruction * 4;
+    ftoDC.instruction = program[oneInstruction];
+    ftoDC.nextPCFetch = ftoDC.pc + 4;
+    ftoDC.we          = 1;
+    fetched.push_back(ftoDC);
+    DCtoEx dctoEx;
+    decode(ftoDC, dctoEx, core.regFile, core.csr);
+    decoded.push_back(dctoEx);
+  }
+
+  if (selected("decode")) {
+    results.push_back(measure(perf, "decode", stageCalls, []() {}, [&]() {
+      DCtoEx dctoEx;
+      unsigned int total = 0;
+      for (unsigned long oneCall = 0; oneCall < stageCalls; oneCall++) {
+        decode(fetched[oneCall % fetched.size()], dctoEx, core.regFile, core.csr);
+        total += dctoEx.rd;
+      }
+      sink = total;
+    }));
+  }
+
+  if (selected("execute")) {
+    results.push_back(measure(perf, "execute", stageCalls, []() {}, [&]() {
+      ExtoMem extoMem;
+      unsigned int total = 0;
+      for (unsigned long oneCall = 0; oneCall < stageCalls; oneCall++) {
+        execute(decoded[oneCall % decoded.size()], extoMem);
+        total += extoMem.result;
+      }
+      sink = total;
+    }));
+  }
+
+  if (selected("IncompleteMemory"))
+    results.push_back(measureMemory(perf, "IncompleteMemory", dm, requests, memoryOps));
+  if (selected("SimpleMemory")) {
+    SimpleMemory<4> memory(dmData);
+    results.push_back(measureMemory(perf, "SimpleMemory", memory, requests, memoryOps));
+  }
+  if (selected("TimingMemory")) {
+    TimingMemory<4> memory(dmData);
+    results.push_back(measureMemory(perf, "TimingMemory", memory, requests, memoryOps));
+  }
+  if (selected("CacheMemory")) {
+    std::unique_ptr<CacheMemory<4, 16, 64> > cache(new CacheMemory<4, 16, 64>(&dm, false));
+    results.push_back(measureMemory(perf, "CacheMemory", *cache, requests, memoryOps));
+  }
+
+  // Previous results, "name ns/op" per line
+  std::map<std::string, double> baseline;
+  if (baselinePath != NULL) {
+    FILE* baselineFile = fopen(baselinePath, "r");
+    if (baselineFile == NULL) {
+      fprintf(stderr, "Failed to open baseline %s\n", baselinePath);
+      return -1;
+    }
+    char name[64];
+    double nsPerOp;
+    while (fscanf(baselineFile, "%63s %lf", name, &nsPerOp) == 2)
+      baseline[name] = nsPerOp;
+    fclose(baselineFile);
+  }
+
+  bool regression = false;
+  printf("%-18s %12s %10s %12s %6s %14s %14s %10s\n", "benchmark", "operations", "ns/op", "host cyc/op", "IPC",
+         "cache miss/op", "branch miss/op", "baseline");
+  for (const BenchResult& result : results) {
+    printf("%-18s %12lu %10.2f", result.name.c_str(), result.operations, result.nsPerOp);
+    if (perf.available()) {
+      const unsigned long long* counters = result.counters;
+      const double ipc =
+          counters[PerfCounters::CYCLES] ? (double)counters[PerfCounters::INSTRUCTIONS] / counters[PerfCounters::CYCLES] : 0;
+      printf(" %12.1f %6.2f %14.4f %14.4f", (double)counters[PerfCounters::CYCLES] / result.operations, ipc,
+             (double)counters[PerfCounters::CACHE_MISSES] / result.operations,
+             (double)counters[PerfCounters::BRANCH_MISSES] / result.operations);
+    } else
+      printf(" %12s %6s %14s %14s", "-", "-", "-", "-");
+
+    if (baseline.count(result.name)) {
+      const double change = 100.0 * (result.nsPerOp / baseline[result.name] - 1.0);
+      printf(" %+9.1f%%%s", change, change > threshold ? "  REGRESSION" : "");
+      regression |= change > threshold;
+    }
+    putchar('\n');
+  }
+
+  if (outputPath != NULL) {
+    FILE* outputFile = fopen(outputPath, "w");
+    if (outputFile == NULL) {
+      fprintf(stderr, "Failed to open %s\n", outputPath);
+      return -1;
+    }
+    for (const BenchResult& result : results)
+      fprintf(outputFile, "%s %.3f\n", result.name.c_str(), result.nsPerOp);
+    fclose(outputFile);
+  }
+
+  return regression ? 1 : 0;
+}
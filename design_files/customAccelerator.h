@@ -0,0 +1,178 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef INCLUDE_CUSTOMACCELERATOR_H_
+#define INCLUDE_CUSTOMACCELERATOR_H_
+
+#include "ap_int.h"
+#include "riscvISA.h"
+
+/************************************************************************
+ * 	Accelerator port of a hart (CUSTOM_ACCELERATOR in core.h)
+ * 	Instructions of the custom-0 and custom-1 opcodes are R-type: decode
+ * 	reads rs1 and rs2, and the accelerator serves the instruction in the
+ * 	memory stage, as the data memory serves a load. Its result goes to rd
+ * 	and, as for a load, the instruction right behind which uses it waits
+ * 	in decode (isLongInstruction).
+ * 	An accelerator has the interface of Dct8Accelerator:
+ * 		process(instruction, lhs, rhs, start, result, waitOut)
+ * 	It is clocked every cycle. start is set while the memory stage holds
+ * 	a custom instruction and the pipeline is not frozen by another cause.
+ * 	waitOut freezes the pipeline, the instruction is then presented
+ * 	again until the result is ready. result is only written when the
+ * 	instruction completes.
+ ************************************************************************/
+
+// Operations of Dct8Accelerator, in funct3 of custom-0 (funct7 is the index)
+#define DCT8_PUT 0x0 // in[2 * index] = rs1, in[2 * index + 1] = rs2
+#define DCT8_RUN 0x1 // out = dct8(in)
+#define DCT8_GET 0x2 // rd = out[index]
+
+// Cycles of a run: a level of butterflies per cycle (see dct8Level)
+#define DCT8_LATENCY 4
+
+/************************************************************************
+ * 	8-point fixed point DCT of fast_fixed_dct8 (dct-test.c), with the
+ * 	same results. Inputs and outputs are in registers of the accelerator:
+ * 	four PUT fill the inputs, RUN computes the outputs, eight GET read
+ * 	them. The multiplications by the constants of a level of butterflies
+ * 	are done in parallel, and the result of each of the four levels is
+ * 	registered: RUN computes a level per cycle and holds the pipeline
+ * 	until the last one writes the outputs.
+ ************************************************************************/
+class Dct8Accelerator {
+public:
+  ap_int<32> in[8];
+  ap_int<32> out[8];
+  ap_int<32> level[8]; // results of the last level of butterflies of the run
+  bool running;
+  ap_uint<2> step; // levels of the run already computed
+
+  // Stats
+  unsigned long numberRuns;
+
+  Dct8Accelerator()
+  {
+    for (int oneValue = 0; oneValue < 8; oneValue++) {
+      in[oneValue]    = 0;
+      out[oneValue]   = 0;
+      level[oneValue] = 0;
+    }
+    running    = false;
+    step       = 0;
+    numberRuns = 0;
+  }
+
+  // MULFIXED of dct-test.c: the product wraps around on 32 bits
+  static ap_int<32> mulFixed(const ap_int<32> constant, const ap_int<32> value)
+  {
+#pragma HLS INLINE
+    const ap_int<32> product = constant * value;
+    return product >> 15;
+  }
+
+  // Level number step of the butterflies: the first three go to level, the last one to out
+  void dct8Level()
+  {
+#pragma HLS INLINE
+    const ap_int<32> c1 = 32138, c2 = 30274, c3 = 27245, c4 = 23170, c5 = 18205, c6 = 12540, c7 = 6393;
+    ap_int<32> next[8];
+
+    switch (step) {
+      case 0:
+        for (int i = 0; i < 4; i++)
+          next[i] = in[i] + in[7 - i];
+        for (int i = 4; i < 8; i++)
+          next[i] = -in[i] + in[7 - i];
+        break;
+      case 1:
+        next[0] = level[0] + level[3];
+        next[1] = level[1] + level[2];
+        next[2] = level[1] - level[2];
+        next[3] = level[0] - level[3];
+        next[4] = level[4];
+        next[5] = mulFixed(c4, level[6] - level[5]);
+        next[6] = mulFixed(c4, level[5] + level[5]);
+        next[7] = level[7];
+        break;
+      case 2:
+        next[0] = mulFixed(c4, level[0] + level[1]);
+        next[1] = mulFixed(c4, level[0] - level[1]);
+        next[2] = mulFixed(c6, level[2]) + mulFixed(c2, level[3]);
+        next[3] = mulFixed(c6, level[3]) - mulFixed(c2, level[2]);
+        next[4] = level[4] + level[5];
+        next[5] = level[4] - level[5];
+        next[6] = level[7] - level[6];
+        next[7] = level[6] + level[7];
+        break;
+      default:
+        out[0] = level[0] >> 1;
+        out[4] = level[1] >> 1;
+        out[2] = level[2] >> 1;
+        out[6] = level[3] >> 1;
+        out[1] = (mulFixed(c7, level[4]) + mulFixed(c1, level[7])) >> 1;
+        out[5] = (mulFixed(c3, level[5]) + mulFixed(c5, level[6])) >> 1;
+        out[3] = (mulFixed(c3, level[6]) - mulFixed(c5, level[5])) >> 1;
+        out[7] = (mulFixed(c7, level[7]) - mulFixed(c1, level[4])) >> 1;
+        return;
+    }
+    for (int oneValue = 0; oneValue < 8; oneValue++)
+      level[oneValue] = next[oneValue];
+  }
+
+  void process(const ap_uint<32> instruction, const ap_uint<32> lhs, const ap_uint<32> rhs, const bool start,
+               ap_uint<32>& result, bool& waitOut)
+  {
+    const ap_uint<3> funct3 = instruction.range(14, 12);
+    const ap_uint<3> index  = instruction.range(27, 25);
+
+    waitOut = false;
+    if (!start || instruction.range(6, 0) != RISCV_CUSTOM0)
+      return;
+
+    switch (funct3) {
+      case DCT8_PUT: {
+        const ap_uint<3> first = ((ap_uint<3>)index.range(1, 0)) << 1;
+        in[first]              = lhs;
+        in[first + 1]          = rhs;
+        result                 = 0;
+        break;
+      }
+      case DCT8_RUN:
+        if (!running) {
+          running = true;
+          step    = 0;
+          numberRuns++;
+        }
+        dct8Level();
+        if (step != DCT8_LATENCY - 1) {
+          step++;
+          waitOut = true;
+          return;
+        }
+        running = false;
+        result  = 0;
+        break;
+      case DCT8_GET:
+        result = out[index];
+        break;
+      default:
+        result = 0;
+        break;
+    }
+  }
+};
+
+#endif /* INCLUDE_CUSTOMACCELERATOR_H_ */
@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+# Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#       http://www.apache.org/licenses/LICENSE-2.0
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+
+"""Design space exploration driver.
+
+Every configuration of the grid is a set of preprocessor definitions
+(MEMORY_INTERFACE, ICACHE_*, DCACHE_*, NB_CORES, BARREL_CORE, DATAFLOW_CORE,
+COMPRESSED_ISA, see core.h). Each one is compiled into its own simulator binary, then all binaries
+run all benchmarks, using all host cores. The result is a table of CPI per benchmark and per configuration, joined
+with the resources reported by Vitis HLS when synthesis reports are given.
+
+  dse.py --include $XILINX_HLS/include bench1.elf bench2.elf
+  dse.py --grid grid.json --reports syn_runs/ --csv results.csv *.elf
+  dse.py --list                # names and flags, to synthesize each configuration
+
+A grid file maps each definition to its values, the grid is their product:
+  {"MEMORY_INTERFACE": ["IncompleteMemory", "TimingMemory"], "DCACHE_SETS": [0, 64, 256]}
+
+With --reports DIR, the resources of a configuration are read from the
+csynth.xml found under DIR/<configuration name>/ (the report written next to
+csynth_design_size.rpt in syn/report).
+"""
+
+import argparse
+import concurrent.futures
+import itertools
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import xml.etree.ElementTree as ElementTree
+
+SOURCES = ["simulator.cpp", "core.cpp", "riscvISA.cpp", "elfFile.cpp", "profiler.cpp"]
+DESIGN_DIR = os.path.dirname(os.path.abspath(__file__))
+
+DEFAULT_GRID = {
+    "MEMORY_INTERFACE": ["IncompleteMemory", "TimingMemory"],
+    "ICACHE_SETS": [0, 16, 64],
+    "DCACHE_SETS": [0, 64, 256],
+    "DCACHE_LINE_SIZE": [16, 32],
+}
+
+SHORT_NAMES = {
+    "MEMORY_INTERFACE": "",
+    "ICACHE_SETS": "is",
+    "ICACHE_LINE_SIZE": "il",
+    "ICACHE_VICTIM_SIZE": "iv",
+    "DCACHE_SETS": "ds",
+    "DCACHE_LINE_SIZE": "dl",
+    "DCACHE_VICTIM_SIZE": "dv",
+    "NB_CORES": "c",
+    "BARREL_CORE": "b",
+    "DATAFLOW_CORE": "df",
+    "COMPRESSED_ISA": "rvc",
+    "CUSTOM_ACCELERATOR": "acc",
+}
+
+RESOURCES = ["LUT", "FF", "BRAM_18K", "DSP"]
+
+
+def expand_grid(grid):
+    """Cartesian product of the grid, as a list of (name, definitions)."""
+    keys = list(grid)
+    configurations = []
+    seen = set()
+    for values in itertools.product(*(grid[key] for key in keys)):
+        definitions = dict(zip(keys, values))
+        # Line and victim sizes are meaningless without the cache
+        for cache in ("ICACHE", "DCACHE"):
+            if definitions.get(cache + "_SETS", 0) == 0:
+                for key in (cache + "_LINE_SIZE", cache + "_VICTIM_SIZE"):
+                    definitions.pop(key, None)
+        # The dataflow core has a single hart
+        if definitions.get("DATAFLOW_CORE", 0) and (definitions.get("NB_CORES", 1) > 1 or
+                                                    definitions.get("BARREL_CORE", 0)):
+            continue
+        name = "_".join(SHORT_NAMES.get(key, key) + str(value) for key, value in definitions.items())
+        if name not in seen:
+            seen.add(name)
+            configurations.append((name, definitions))
+    return configurations
+
+
+def build(name, definitions, args):
+    binary = os.path.join(args.build_dir, name, "simulator")
+    os.makedirs(os.path.dirname(binary), exist_ok=True)
+    command = [args.cxx, "-O2", "-std=c++14", "-pthread", "-I" + DESIGN_DIR]
+    if args.include:
+        command.append("-I" + args.include)
+    command += ["-D%s=%s" % (key, value) for key, value in definitions.items()]
+    command += [os.path.join(DESIGN_DIR, source) for source in SOURCES]
+    command += ["-o", binary]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        sys.exit("Failed to build %s:\n%s" % (name, result.stdout))
+    return binary
+
+
+def run(binary, benchmark, args):
+    """Returns the CPI of the benchmark, or None when it fails."""
+    command = [binary, "-f", benchmark]
+    if args.max_cycles:
+        command += ["-m", str(args.max_cycles)]
+    try:
+        result = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                universal_newlines=True, timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+        return None
+    match = re.search(r"(\d+) cycles, (\d+) instructions", result.stderr)
+    if result.returncode != 0 or match is None or "Cycle limit reached" in result.stderr:
+        return None
+    return int(match.group(1)) / max(int(match.group(2)), 1)
+
+
+def read_resources(name, reports):
+    """LUT/FF/BRAM/DSP estimates from the csynth.xml of the configuration."""
+    for directory, _, files in os.walk(os.path.join(reports, name)):
+        if "csynth.xml" in files:
+            root = ElementTree.parse(os.path.join(directory, "csynth.xml")).getroot()
+            estimates = root.find("AreaEstimates/Resources")
+            if estimates is not None:
+                return {resource: estimates.findtext(resource, "") for resource in RESOURCES}
+    return {}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("benchmarks", nargs="*", help="RISC-V ELF files")
+    parser.add_argument("--grid", help="JSON file with the values of each definition")
+    parser.add_argument("--include", default=os.path.join(os.environ.get("XILINX_HLS", ""), "include"),
+                        help="directory of ap_int.h (default $XILINX_HLS/include)")
+    parser.add_argument("--cxx", default="g++")
+    parser.add_argument("--build-dir", default="dse_build")
+    parser.add_argument("--reports", help="directory with one synthesis run per configuration name")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--max-cycles", type=int, default=0)
+    parser.add_argument("--timeout", type=int, default=3600, help="seconds per simulation")
+    parser.add_argument("--csv", help="also write the table to this file")
+    parser.add_argument("--list", action="store_true", help="print the configurations and their flags")
+    args = parser.parse_args()
+
+    grid = DEFAULT_GRID
+    if args.grid:
+        with open(args.grid) as grid_file:
+            grid = json.load(grid_file)
+    configurations = expand_grid(grid)
+
+    if args.list:
+        for name, definitions in configurations:
+            print(name, " ".join("-D%s=%s" % item for item in definitions.items()))
+        return
+    if not args.benchmarks:
+        parser.error("no benchmark given")
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        binaries = dict(zip((name for name, _ in configurations),
+                            executor.map(lambda configuration: build(*configuration, args), configurations)))
+        print("Built %d configurations" % len(binaries), file=sys.stderr)
+
+        jobs = {(name, benchmark): executor.submit(run, binaries[name], benchmark, args)
+                for name, _ in configurations for benchmark in args.benchmarks}
+        cpis = {key: job.result() for key, job in jobs.items()}
+
+    benchmark_names = [os.path.splitext(os.path.basename(benchmark))[0] for benchmark in args.benchmarks]
+    header = ["configuration"] + benchmark_names + ["geomean"] + (RESOURCES if args.reports else [])
+    rows = []
+    for name, _ in configurations:
+        values = [cpis[(name, benchmark)] for benchmark in args.benchmarks]
+        valid = [value for value in values if value is not None]
+        geomean = math.exp(sum(math.log(value) for value in valid) / len(valid)) if len(valid) == len(values) else None
+        row = [name] + ["%.3f" % value if value is not None else "fail" for value in values]
+        row.append("%.3f" % geomean if geomean is not None else "fail")
+        if args.reports:
+            resources = read_resources(name, args.reports)
+            row += [resources.get(resource, "") for resource in RESOURCES]
+        rows.append((geomean if geomean is not None else math.inf, row))
+    rows.sort(key=lambda row: row[0])
+
+    widths = [max(len(str(line[column])) for line in [header] + [row for _, row in rows]) for column in range(len(header))]
+    for line in [header] + [row for _, row in rows]:
+        print("  ".join(str(cell).rjust(width) for cell, width in zip(line, widths)))
+
+    if args.csv:
+        with open(args.csv, "w") as csv_file:
+            for line in [header] + [row for _, row in rows]:
+                csv_file.write(",".join(line) + "\n")
+
+
+if __name__ == "__main__":
+    main()
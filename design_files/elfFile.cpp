@@ -0,0 +1,130 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "elfFile.h"
+
+#define EI_CLASS    4
+#define EI_DATA     5
+#define ELFCLASS32  1
+#define ELFDATA2LSB 1
+#define EM_RISCV    243
+
+ElfFile::ElfFile(const char* pathToElfFile)
+{
+  FILE* elfFile = fopen(pathToElfFile, "rb");
+  if (elfFile == NULL) {
+    fprintf(stderr, "Failed to open file %s\n", pathToElfFile);
+    exit(-1);
+  }
+
+  fseek(elfFile, 0, SEEK_END);
+  const long fileSize = ftell(elfFile);
+  fseek(elfFile, 0, SEEK_SET);
+  content.resize(fileSize > 0 ? fileSize : 0);
+  if (fileSize < 52 || fread(content.data(), 1, fileSize, elfFile) != (size_t)fileSize) {
+    fprintf(stderr, "Failed to read file %s\n", pathToElfFile);
+    exit(-1);
+  }
+  fclose(elfFile);
+
+  if (content[0] != 0x7f || content[1] != 'E' || content[2] != 'L' || content[3] != 'F' ||
+      content[EI_CLASS] != ELFCLASS32 || content[EI_DATA] != ELFDATA2LSB || read16(18) != EM_RISCV) {
+    fprintf(stderr, "%s is not a 32 bits little endian RISC-V ELF file\n", pathToElfFile);
+    exit(-1);
+  }
+
+  entry = read32(24);
+
+  // Section header table
+  const unsigned int sectionTableOffset = read32(32);
+  const unsigned int sectionEntrySize   = read16(46);
+  const unsigned int numberOfSections   = read16(48);
+  const unsigned int nameSectionIndex   = read16(50);
+
+  if (sectionTableOffset + numberOfSections * sectionEntrySize > content.size()) {
+    fprintf(stderr, "%s has a truncated section table\n", pathToElfFile);
+    exit(-1);
+  }
+
+  for (unsigned int oneSection = 0; oneSection < numberOfSections; oneSection++) {
+    const unsigned int header = sectionTableOffset + oneSection * sectionEntrySize;
+    ElfSection section;
+    section.nameIndex = read32(header);
+    section.type      = read32(header + 4);
+    section.flags     = read32(header + 8);
+    section.address   = read32(header + 12);
+    section.offset    = read32(header + 16);
+    section.size      = read32(header + 20);
+    section.link      = read32(header + 24);
+    sectionTable.push_back(section);
+  }
+
+  // Section names are stored in the section designated by e_shstrndx
+  if (nameSectionIndex < sectionTable.size()) {
+    const unsigned int namesOffset = sectionTable[nameSectionIndex].offset;
+    for (ElfSection& section : sectionTable)
+      section.name = std::string((const char*)&content[namesOffset + section.nameIndex]);
+  }
+
+  // Symbols, with their names in the string table linked to the symbol table
+  for (const ElfSection& section : sectionTable) {
+    if (section.type != ELF_SHT_SYMTAB || section.link >= sectionTable.size())
+      continue;
+
+    const unsigned int namesOffset = sectionTable[section.link].offset;
+    for (unsigned int oneSymbol = section.offset; oneSymbol + 16 <= section.offset + section.size; oneSymbol += 16) {
+      ElfSymbol symbol;
+      symbol.name    = std::string((const char*)&content[namesOffset + read32(oneSymbol)]);
+      symbol.value   = read32(oneSymbol + 4);
+      symbol.size    = read32(oneSymbol + 8);
+      symbol.type    = content[oneSymbol + 12] & 0xf;
+      symbol.section = read16(oneSymbol + 14);
+      symbols.push_back(symbol);
+    }
+  }
+}
+
+const unsigned char* ElfFile::getSectionCode(const ElfSection& section) const
+{
+  if (section.type == ELF_SHT_NOBITS || section.offset + section.size > content.size())
+    return NULL;
+  return &content[section.offset];
+}
+
+std::vector<ElfSymbol> ElfFile::getFunctions() const
+{
+  std::vector<ElfSymbol> functions;
+  for (const ElfSymbol& symbol : symbols)
+    if (symbol.type == ELF_STT_FUNC && !symbol.name.empty())
+      functions.push_back(symbol);
+
+  std::sort(functions.begin(), functions.end(),
+            [](const ElfSymbol& a, const ElfSymbol& b) { return a.value < b.value; });
+  return functions;
+}
+
+unsigned int ElfFile::read16(unsigned int offset) const
+{
+  return content[offset] | (content[offset + 1] << 8);
+}
+
+unsigned int ElfFile::read32(unsigned int offset) const
+{
+  return content[offset] | (content[offset + 1] << 8) | (content[offset + 2] << 16) |
+         ((unsigned int)content[offset + 3] << 24);
+}
@@ -0,0 +1,72 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef __ELFFILE_H__
+#define __ELFFILE_H__
+
+// Host-side reader for 32 bits little endian RISC-V ELF files. It is not part
+// of the synthesized design: it is used by the simulator to load programs and
+// by the profiler to map PCs back to symbols.
+
+#include <string>
+#include <vector>
+
+#define ELF_SHT_PROGBITS 1
+#define ELF_SHT_SYMTAB   2
+#define ELF_SHT_NOBITS   8
+#define ELF_SHF_ALLOC    0x2
+#define ELF_STT_FUNC     2
+
+struct ElfSection {
+  std::string name;
+  unsigned int nameIndex; // offset of the name in the section name table
+  unsigned int type;
+  unsigned int flags;
+  unsigned int address; // where the section is loaded in the guest memory
+  unsigned int offset;  // where the section is in the file
+  unsigned int size;
+  unsigned int link;
+};
+
+struct ElfSymbol {
+  std::string name;
+  unsigned int value;
+  unsigned int size;
+  unsigned char type;
+  unsigned short section;
+};
+
+class ElfFile {
+public:
+  std::vector<ElfSection> sectionTable;
+  std::vector<ElfSymbol> symbols;
+  std::vector<unsigned char> content;
+  unsigned int entry;
+
+  // Exits with an error message when the file cannot be read or is not a RV32 ELF
+  ElfFile(const char* pathToElfFile);
+
+  // Content of a section, NULL for sections without data in the file (.bss)
+  const unsigned char* getSectionCode(const ElfSection& section) const;
+
+  // Function symbols sorted by address, used to map a PC to its function
+  std::vector<ElfSymbol> getFunctions() const;
+
+private:
+  unsigned int read16(unsigned int offset) const;
+  unsigned int read32(unsigned int offset) const;
+};
+
+#endif // __ELFFILE_H__
@@ -13,6 +13,9 @@
 
 
 
+#ifndef INCLUDE_LOGARITHM_H_
+#define INCLUDE_LOGARITHM_H_
+
 template <int x> struct log2const {
   enum { value = 1 + log2const<x / 2>::value };
 };
@@ -20,3 +23,5 @@ template <int x> struct log2const {
 template <> struct log2const<1> {
   enum { value = 0 };
 };
+
+#endif /* INCLUDE_LOGARITHM_H_ */
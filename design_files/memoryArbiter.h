@@ -0,0 +1,148 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef INCLUDE_MEMORYARBITER_H_
+#define INCLUDE_MEMORYARBITER_H_
+
+#include "memoryInterface.h"
+// #include "ac_int.h"
+#include "ap_int.h"
+
+/************************************************************************
+ * 	Arbiter sharing one memory interface (an AXI master port of the
+ * 	kernel) between NB_PORTS clients, each one through its ArbiterPort.
+ * 	The next level serves one port at a time: the owner keeps it from the
+ * 	first cycle of a request until the request is served, then as long
+ * 	as no other port asks for it. At the end of every cycle (tick), a free
+ * 	interface goes to the next waiting port in round robin order.
+ * 	Each port adds its base to the addresses, so that the clients can
+ * 	have private windows in the shared memory.
+ * 	Requests other than loads, stores and atomics (flushes of a missing
+ * 	cache) do not reach the next level.
+ * 	Each port keeps the word of its last load as long as its client
+ * 	presents the same load again: a core without cache re-presents its
+ * 	fetch while the data memory stalls it, and would otherwise have to
+ * 	own both arbiters in the same cycle to go on.
+ ************************************************************************/
+template <unsigned int INTERFACE_SIZE, int NB_PORTS> class MemoryArbiter;
+
+template <unsigned int INTERFACE_SIZE, int NB_PORTS> class ArbiterPort : public MemoryInterface<INTERFACE_SIZE> {
+public:
+  MemoryArbiter<INTERFACE_SIZE, NB_PORTS>* arbiter;
+  int id;
+  ap_uint<32> base;
+
+  // Last load served, any other request drops it
+  bool loadValid;
+  ap_uint<32> loadAddress;
+  memMask loadMask;
+  ap_uint<INTERFACE_SIZE * 8> loadData;
+
+  ArbiterPort()
+  {
+    arbiter   = NULL;
+    id        = 0;
+    base      = 0;
+    loadValid = false;
+  }
+
+  void process(const ap_uint<32> addr, const memMask mask, const memOpType opType, const ap_uint<INTERFACE_SIZE * 8> dataIn,
+               ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
+  {
+    if (opType == LOAD && loadValid && addr == loadAddress && mask == loadMask) {
+      dataOut = loadData;
+      waitOut = false;
+      return;
+    }
+
+    loadValid = false;
+#ifndef __HLS__
+    arbiter->nextLevel->requestPc = this->requestPc;
+#endif
+    arbiter->request(id, addr + base, mask, opType, dataIn, dataOut, waitOut);
+    if (opType == LOAD && !waitOut) {
+      loadValid   = true;
+      loadAddress = addr;
+      loadMask    = mask;
+      loadData    = dataOut;
+    }
+  }
+};
+
+template <unsigned int INTERFACE_SIZE, int NB_PORTS> class MemoryArbiter {
+public:
+  MemoryInterface<INTERFACE_SIZE>* nextLevel;
+  ArbiterPort<INTERFACE_SIZE, NB_PORTS> ports[NB_PORTS];
+  int owner;                 // port served by the next level
+  bool ownerBusy;            // the request of the owner is not served yet
+  bool requesting[NB_PORTS]; // ports which waited during the cycle
+
+  // Stats per port
+  unsigned long numberRequests[NB_PORTS];
+  unsigned long numberWaitCycles[NB_PORTS];
+
+  // The ports point to the arbiter, which is not meant to be copied
+  MemoryArbiter(MemoryInterface<INTERFACE_SIZE>* nextLevel = NULL)
+  {
+    this->nextLevel = nextLevel;
+    for (int onePort = 0; onePort < NB_PORTS; onePort++) {
+      ports[onePort].arbiter    = this;
+      ports[onePort].id         = onePort;
+      requesting[onePort]       = false;
+      numberRequests[onePort]   = 0;
+      numberWaitCycles[onePort] = 0;
+    }
+    owner     = 0;
+    ownerBusy = false;
+  }
+
+  void request(const int id, const ap_uint<32> addr, const memMask mask, const memOpType opType,
+               const ap_uint<INTERFACE_SIZE * 8> dataIn, ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
+  {
+    if (opType != LOAD && opType != STORE && !isAmo(opType)) {
+      waitOut = false;
+      return;
+    }
+
+    if (id != owner) {
+      requesting[id] = true;
+      numberWaitCycles[id]++;
+      waitOut = true;
+      return;
+    }
+
+    if (!ownerBusy)
+      numberRequests[id]++;
+    nextLevel->process(addr, mask, opType, dataIn, dataOut, waitOut);
+    ownerBusy = waitOut;
+  }
+
+  // End of the cycle, once all the ports were processed
+  void tick()
+  {
+    bool granted = false;
+    for (int oneStep = 1; oneStep <= NB_PORTS; oneStep++) {
+      const int candidate = (owner + oneStep) % NB_PORTS;
+      if (!ownerBusy && !granted && requesting[candidate]) {
+        owner   = candidate;
+        granted = true;
+      }
+    }
+    for (int onePort = 0; onePort < NB_PORTS; onePort++)
+      requesting[onePort] = false;
+  }
+};
+
+#endif /* INCLUDE_MEMORYARBITER_H_ */
@@ -18,16 +18,64 @@
 
 // #include "ac_int.h"
 #include "ap_int.h"
+#include "logarithm.h"
 
 typedef enum { BYTE = 0, HALF, WORD, BYTE_U, HALF_U, LONG } memMask;
 
-typedef enum { NONE = 0, LOAD, STORE } memOpType;
+// FLUSH writes dirty lines back to memory, FLUSH_INVALIDATE also empties the cache.
+// DRAIN waits until the stores buffered by the memory reached the next level (FENCE),
+// the content of the cache is left as is. Memories without a cache ignore all three.
+// AMO_* are atomic operations on a word, in a single request: the memory returns
+// the word and replaces it by the result of the operation with dataIn.
+typedef enum { NONE = 0, LOAD, STORE, FLUSH, FLUSH_INVALIDATE, DRAIN, AMO_SWAP, AMO_ADD, AMO_XOR, AMO_AND, AMO_OR,
+               AMO_MIN, AMO_MAX, AMO_MINU, AMO_MAXU } memOpType;
+
+inline bool isAmo(const memOpType opType)
+{
+  return opType >= AMO_SWAP;
+}
+
+// Value written back by an atomic operation
+inline ap_uint<32> amoResult(const memOpType opType, const ap_uint<32> memoryValue, const ap_uint<32> operand)
+{
+  switch (opType) {
+    case AMO_ADD:
+      return memoryValue + operand;
+    case AMO_XOR:
+      return memoryValue ^ operand;
+    case AMO_AND:
+      return memoryValue & operand;
+    case AMO_OR:
+      return memoryValue | operand;
+    case AMO_MIN:
+      return ((ap_int<32>)memoryValue < (ap_int<32>)operand) ? memoryValue : operand;
+    case AMO_MAX:
+      return ((ap_int<32>)memoryValue > (ap_int<32>)operand) ? memoryValue : operand;
+    case AMO_MINU:
+      return (memoryValue < operand) ? memoryValue : operand;
+    case AMO_MAXU:
+      return (memoryValue > operand) ? memoryValue : operand;
+    default: // AMO_SWAP
+      return operand;
+  }
+}
 
 template <unsigned int INTERFACE_SIZE> class MemoryInterface {
 protected:
   bool wait;
 
 public:
+#ifndef __HLS__
+  // Pc of the instruction behind the next request, only used for statistics
+  ap_uint<32> requestPc = 0;
+#endif
+
+  // Set by the caches for the call where a request misses, read by the hardware counters
+  bool miss = false;
+
+  // Wrappers such as TracingMemory are deleted through this interface
+  virtual ~MemoryInterface() {}
+
   virtual void process(const ap_uint<32> addr, const memMask mask, const memOpType opType, const ap_uint<INTERFACE_SIZE * 8> dataIn,
                        ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut) = 0;
 };
@@ -39,7 +87,8 @@ public:
   ap_uint<32> valueLoaded;
 
 public:
-  IncompleteMemory(ap_uint<32>* arg) { data = arg; }
+  IncompleteMemory(ap_uint<32>* arg = NULL) { data = arg; }
+  void bind(ap_uint<32>* arg) { data = arg; }
   void process(const ap_uint<32> addr, const memMask mask, const memOpType opType, const ap_uint<INTERFACE_SIZE * 8> dataIn,
                ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
   {
@@ -52,11 +101,18 @@ public:
     ap_uint<16> t16;
     ap_uint<32> mergedAccess;
 
-    if ((!pendingWrite && opType == STORE && mask != WORD) || opType == LOAD) {
+    if (isAmo(opType)) {
+      dataOut           = data[(addr >> 2)];
+      data[(addr >> 2)] = amoResult(opType, dataOut, dataIn);
+      waitOut           = false;
+      return;
+    }
+
+    if ((!pendingWrite && opType == STORE && mask != WORD && mask != LONG) || opType == LOAD) {
 
       mergedAccess = data[(addr >> 2)];
       // printf("Loading at %x : %x\n", addr >> 2, mergedAccess);
-      if (!pendingWrite && opType == STORE && mask != WORD) {
+      if (!pendingWrite && opType == STORE && mask != WORD && mask != LONG) {
         waitOut      = true;
         valueLoaded  = mergedAccess;
         pendingWrite = 1;
@@ -107,7 +163,8 @@ public:
             // Extract a 16-bit slice, mask with 0xFFFF
             dataOut = dataOutTmp.range(addr[1] ? 31 : 15, addr[1] ? 16 : 0) & 0xffff;
             break;
-          case LONG:
+          case LONG: // with a 32 bits interface, a LONG access is a full word
+            dataOut = dataOutTmp;
             break;
           }
       }
@@ -136,6 +193,7 @@ public:
           valToStore = dataIn;
           break;
         case LONG:
+          valToStore = dataIn;
           break;
         }
       // printf("Loading at %x : %x\n", addr >> 2, mergedAccess);
@@ -148,7 +206,8 @@ template <unsigned int INTERFACE_SIZE> class SimpleMemory : public MemoryInterfa
 public:
   ap_uint<32>* data;
 
-  SimpleMemory(ap_uint<32>* arg) { data = arg; }
+  SimpleMemory(ap_uint<32>* arg = NULL) { data = arg; }
+  void bind(ap_uint<32>* arg) { data = arg; }
   void process(const ap_uint<32> addr, const memMask mask, const memOpType opType, const ap_uint<INTERFACE_SIZE * 8> dataIn,
                ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
   {
@@ -159,6 +218,13 @@ public:
     ap_int<1> bit;
     ap_uint<16> t16;
 
+    if (isAmo(opType)) {
+      dataOut         = data[addr >> 2];
+      data[addr >> 2] = amoResult(opType, dataOut, dataIn);
+      waitOut         = false;
+      return;
+    }
+
     switch (opType) {
       case STORE:
         switch (mask) {
@@ -182,7 +248,7 @@ public:
             break;
           case LONG:
             for (int oneWord = 0; oneWord < INTERFACE_SIZE / 4; oneWord++)
-              data[(addr >> 2) + oneWord] = dataIn.template slc<32>(32 * oneWord);
+              data[(addr >> 2) + oneWord] = dataIn.range(32 * oneWord + 31, 32 * oneWord);
             break;
         }
         break;
@@ -239,4 +305,115 @@ public:
   }
 };
 
+/************************************************************************
+ * 	Timing model of an external DRAM. Data is held as in SimpleMemory,
+ * 	each access is delayed by:
+ * 		- LATENCY: fixed part (controller, interconnect)
+ * 		- ROW_HIT_LATENCY / ROW_MISS_LATENCY: depending on whether the
+ * 		  row is already open in the addressed bank
+ * 		- TRANSFER_CYCLES: cycles the data bus is busy for one access
+ * 		  (bandwidth cap of INTERFACE_SIZE / TRANSFER_CYCLES bytes/cycle)
+ * 	Banks are interleaved on ROW_SIZE bytes. A request has to be kept
+ * 	until waitOut is released.
+ ************************************************************************/
+template <unsigned int INTERFACE_SIZE, int LATENCY = 10, int ROW_HIT_LATENCY = 4, int ROW_MISS_LATENCY = 12,
+          int NB_BANKS = 8, int ROW_SIZE = 1024, int TRANSFER_CYCLES = 1>
+class TimingMemory : public MemoryInterface<INTERFACE_SIZE> {
+  static const int LOG_NB_BANKS = log2const<NB_BANKS>::value;
+  static const int LOG_ROW_SIZE = log2const<ROW_SIZE>::value;
+
+public:
+  SimpleMemory<INTERFACE_SIZE> storage;
+
+  ap_uint<32 - LOG_ROW_SIZE - LOG_NB_BANKS> openRow[NB_BANKS];
+  bool rowOpen[NB_BANKS];
+
+  // Request being served
+  bool busy;
+  ap_uint<32> pendingAddr;
+  memOpType pendingOpType;
+  ap_uint<40> readyCycle;
+
+  // Last load served, its data is still in the output register
+  bool lastValid;
+  ap_uint<32> lastAddr;
+
+  ap_uint<40> cycle;
+  ap_uint<40> busFree; // first cycle where the data bus is available
+
+  // Stats
+  unsigned long numberAccess, numberRowHit, numberRowMiss, numberWaitCycles;
+
+  TimingMemory(ap_uint<32>* arg = NULL) : storage(arg)
+  {
+    for (int oneBank = 0; oneBank < NB_BANKS; oneBank++) {
+      openRow[oneBank] = 0;
+      rowOpen[oneBank] = false;
+    }
+    busy             = false;
+    lastValid        = false;
+    cycle            = 0;
+    busFree          = 0;
+    numberAccess     = 0;
+    numberRowHit     = 0;
+    numberRowMiss    = 0;
+    numberWaitCycles = 0;
+  }
+  void bind(ap_uint<32>* arg) { storage.bind(arg); }
+
+  void process(const ap_uint<32> addr, const memMask mask, const memOpType opType, const ap_uint<INTERFACE_SIZE * 8> dataIn,
+               ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
+  {
+    cycle++;
+    waitOut = false;
+
+    if (opType != LOAD && opType != STORE && !isAmo(opType))
+      return;
+
+    // Same word loaded again (e.g. fetch while the pipeline is stalled)
+    if (opType == LOAD && !busy && lastValid && (addr >> 2) == (lastAddr >> 2)) {
+      storage.process(addr, mask, opType, dataIn, dataOut, waitOut);
+      return;
+    }
+
+    if (!busy || pendingAddr != addr || pendingOpType != opType) {
+      // New request: open the row and reserve the data bus
+      ap_uint<LOG_NB_BANKS + 1> bank = (addr >> LOG_ROW_SIZE) & (NB_BANKS - 1);
+      ap_uint<32 - LOG_ROW_SIZE - LOG_NB_BANKS> row = addr >> (LOG_ROW_SIZE + LOG_NB_BANKS);
+
+      ap_uint<40> latency = LATENCY;
+      if (rowOpen[bank] && openRow[bank] == row) {
+        latency += ROW_HIT_LATENCY;
+        numberRowHit++;
+      } else {
+        latency += ROW_MISS_LATENCY;
+        numberRowMiss++;
+      }
+      rowOpen[bank] = true;
+      openRow[bank] = row;
+
+      readyCycle = cycle + latency;
+      if (readyCycle < busFree + TRANSFER_CYCLES)
+        readyCycle = busFree + TRANSFER_CYCLES;
+      busFree = readyCycle;
+
+      busy          = true;
+      pendingAddr   = addr;
+      pendingOpType = opType;
+      numberAccess++;
+    }
+
+    if (cycle < readyCycle) {
+      numberWaitCycles++;
+      waitOut = true;
+      return;
+    }
+
+    busy = false;
+    storage.process(addr, mask, opType, dataIn, dataOut, waitOut);
+    lastValid = (opType == LOAD);
+    lastAddr  = addr;
+  }
+};
+
 #endif //__MEMORY_INTERFACE_H__
@@ -0,0 +1,175 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef __MEMORY_TRACE_H__
+#define __MEMORY_TRACE_H__
+
+// Host-side recording and replay of the requests seen by a memory interface,
+// used to evaluate cache configurations without running the pipeline.
+//
+// Trace format: the 4 bytes "CMTR", a version byte and the interface size, then
+// one record per completed request:
+//   - one byte: opType in bits [2:0], mask in bits [5:3]
+//   - the difference with the previous address, zigzag encoded as a LEB128 varint
+// Sequential fetches take two bytes per request.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "memoryInterface.h"
+
+#define TRACE_VERSION 1
+
+struct TraceRecord {
+  unsigned int addr;
+  unsigned char opType;
+  unsigned char mask;
+};
+
+class TraceWriter {
+public:
+  TraceWriter(const char* path, unsigned int interfaceSize)
+  {
+    traceFile = fopen(path, "wb");
+    if (traceFile == NULL) {
+      fprintf(stderr, "Failed to open trace file %s\n", path);
+      exit(-1);
+    }
+    setvbuf(traceFile, NULL, _IOFBF, 1 << 20);
+    const unsigned char header[6] = {'C', 'M', 'T', 'R', TRACE_VERSION, (unsigned char)interfaceSize};
+    fwrite(header, 1, 6, traceFile);
+    previousAddr  = 0;
+    numberRecords = 0;
+  }
+
+  ~TraceWriter() { fclose(traceFile); }
+
+  void write(unsigned int addr, memOpType opType, memMask mask)
+  {
+    unsigned char record[6];
+    int size = 0;
+
+    record[size++]      = opType | (mask << 3);
+    const int delta     = addr - previousAddr;
+    unsigned int zigzag = ((unsigned int)delta << 1) ^ (delta >> 31);
+    while (zigzag >= 0x80) {
+      record[size++] = zigzag | 0x80;
+      zigzag >>= 7;
+    }
+    record[size++] = zigzag;
+
+    fwrite(record, 1, size, traceFile);
+    previousAddr = addr;
+    numberRecords++;
+  }
+
+  unsigned long numberRecords;
+
+private:
+  FILE* traceFile;
+  unsigned int previousAddr;
+};
+
+// Reads a whole trace, exits with an error message if the file is not a trace
+inline std::vector<TraceRecord> readTrace(const char* path)
+{
+  FILE* traceFile = fopen(path, "rb");
+  if (traceFile == NULL) {
+    fprintf(stderr, "Failed to open trace file %s\n", path);
+    exit(-1);
+  }
+
+  std::vector<unsigned char> content;
+  unsigned char buffer[1 << 16];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), traceFile)) != 0)
+    content.insert(content.end(), buffer, buffer + size);
+  fclose(traceFile);
+
+  if (content.size() < 6 || content[0] != 'C' || content[1] != 'M' || content[2] != 'T' || content[3] != 'R' ||
+      content[4] != TRACE_VERSION) {
+    fprintf(stderr, "%s is not a memory trace\n", path);
+    exit(-1);
+  }
+
+  std::vector<TraceRecord> trace;
+  unsigned int previousAddr = 0;
+  size_t position           = 6;
+  while (position < content.size()) {
+    TraceRecord record;
+    record.opType = content[position] & 0x7;
+    record.mask   = (content[position] >> 3) & 0x7;
+    position++;
+
+    unsigned int zigzag = 0;
+    int shift           = 0;
+    while (position < content.size() && (content[position] & 0x80)) {
+      zigzag |= (content[position++] & 0x7f) << shift;
+      shift += 7;
+    }
+    if (position == content.size()) {
+      fprintf(stderr, "%s is truncated\n", path);
+      exit(-1);
+    }
+    zigzag |= content[position++] << shift;
+
+    record.addr  = previousAddr + ((zigzag >> 1) ^ -(zigzag & 1));
+    previousAddr = record.addr;
+    trace.push_back(record);
+  }
+  return trace;
+}
+
+/************************************************************************
+ * TracingMemory forwards every request to the wrapped memory, and records
+ * it when it completes (a request lasting several cycles is recorded once).
+ ************************************************************************/
+template <unsigned int INTERFACE_SIZE> class TracingMemory : public MemoryInterface<INTERFACE_SIZE> {
+public:
+  MemoryInterface<INTERFACE_SIZE>* nextLevel;
+  TraceWriter writer;
+
+  TracingMemory(MemoryInterface<INTERFACE_SIZE>* nextLevel, const char* path)
+      : nextLevel(nextLevel), writer(path, INTERFACE_SIZE)
+  {
+  }
+
+  void process(const ap_uint<32> addr, const memMask mask, const memOpType opType,
+               const ap_uint<INTERFACE_SIZE * 8> dataIn, ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
+  {
+    nextLevel->requestPc = this->requestPc;
+    nextLevel->process(addr, mask, opType, dataIn, dataOut, waitOut);
+    this->miss = nextLevel->miss;
+    // Atomic operations are recorded as the stores they are for a cache
+    if (opType != NONE && !waitOut)
+      writer.write(addr, isAmo(opType) ? STORE : opType, mask);
+  }
+};
+
+/************************************************************************
+ * NullMemory answers every request immediately, with zeros. It is the next
+ * level of the caches when replaying a trace, where only their statistics matter.
+ ************************************************************************/
+template <unsigned int INTERFACE_SIZE> class NullMemory : public MemoryInterface<INTERFACE_SIZE> {
+public:
+  void process(const ap_uint<32>, const memMask, const memOpType, const ap_uint<INTERFACE_SIZE * 8>,
+               ap_uint<INTERFACE_SIZE * 8>& dataOut, bool& waitOut)
+  {
+    dataOut = 0;
+    waitOut = false;
+  }
+};
+
+#endif // __MEMORY_TRACE_H__
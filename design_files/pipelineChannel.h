@@ -0,0 +1,77 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef INCLUDE_PIPELINECHANNEL_H_
+#define INCLUDE_PIPELINECHANNEL_H_
+
+#include "ap_int.h"
+
+/************************************************************************
+ * 	Channel between two stages of the dataflow core: a FIFO of two
+ * 	registers (ping-pong), as a stream of depth 2 between two processes.
+ * 	During a cycle the consumer sees the tokens of the beginning of the
+ * 	cycle and the producer sees the free places of the beginning of the
+ * 	cycle, whatever the other side does: nothing goes through the channel
+ * 	in the cycle it is written, and no stage waits on the decision of
+ * 	the other one. tick() ends the cycle.
+ * 	With both places, the producer can write every cycle while the
+ * 	consumer reads every cycle.
+ ************************************************************************/
+template <class T> class PipelineChannel {
+public:
+  T tokens[2];
+  ap_uint<1> head;
+  ap_uint<2> count; // tokens at the beginning of the cycle
+  bool popped, pushed;
+
+  PipelineChannel()
+  {
+    head   = 0;
+    count  = 0;
+    popped = false;
+    pushed = false;
+  }
+
+  bool canRead() const { return count != 0; }
+  bool canWrite() const { return count != 2; }
+
+  const T& peek() const { return tokens[head]; }
+
+  T pop()
+  {
+    popped = true;
+    return tokens[head];
+  }
+
+  // The place after the tokens of the beginning of the cycle is free, even when
+  // the oldest one is read in the same cycle
+  void push(const T& token)
+  {
+    const ap_uint<1> tail = head + count;
+    tokens[tail]          = token;
+    pushed                = true;
+  }
+
+  void tick()
+  {
+    count = count - popped + pushed;
+    if (popped)
+      head++;
+    popped = false;
+    pushed = false;
+  }
+};
+
+#endif /* INCLUDE_PIPELINECHANNEL_H_ */
@@ -22,11 +22,8 @@
  * ****************************************************************************************
  */
 
+// Writeback needs no forward: the register file bypasses its write to decode
 struct ForwardReg {
-  bool forwardWBtoVal1;
-  bool forwardWBtoVal2;
-  bool forwardWBtoVal3;
-
   bool forwardMemtoVal1;
   bool forwardMemtoVal2;
   bool forwardMemtoVal3;
@@ -37,12 +34,14 @@ struct ForwardReg {
 };
 
 struct FtoDC {
-  FtoDC() : pc(0), instruction(0x13), we(1) {}
+  FtoDC() : pc(0), instruction(0x13), compressed(0), bubble(0), we(1) {}
 //   ac_int<32, false> pc;          // PC where to fetch
   ap_uint<32> pc;          // PC where to fetch
   ap_uint<32> instruction; // Instruction to execute
-  ap_uint<32> nextPCFetch; // Next pc according to fetch
+  bool compressed;         // 16 bits instruction in instruction[15:0], decode expands it
+  ap_uint<32> nextPCFetch; // Next pc according to fetch, the link of jumps
   // Register for all stages
+  ap_uint<4> bubble; // why the stage is empty when we is 0 (see CycleClassNames)
   bool we;
 };
 
@@ -73,6 +72,7 @@ struct DCtoEx {
   ap_uint<5> rd; // rd     = instruction[11:7]
 
   // Register for all stages
+  ap_uint<4> bubble;
   bool we;
 };
 
@@ -90,16 +90,20 @@ struct ExtoMem {
   ap_uint<3> funct3; // datasize and sign extension bit
 
   ap_int<32> datac; // data to be stored in memory or csr result
+  bool isCsrWrite;  // datac has to be written in the csr
+  ap_uint<12> csr;
 
   // For branch unit
   ap_uint<32> nextPC;
   bool isBranch;
 
   // Register for all stages
+  ap_uint<4> bubble;
   bool we;
 };
 
 struct MemtoWB {
+  ap_uint<32> pc;     // only used by the host-side profiler
   ap_uint<32> result; // Result to be written back
   ap_uint<5> rd;      // destination register
   bool useRd;
@@ -109,8 +113,17 @@ struct MemtoWB {
   ap_uint<4> byteEnable;
   bool isStore;
   bool isLoad;
+  bool isFence; // FENCE: waits until the stores buffered by the data memory are done
+  bool isSyscall; // ecall, handled by the top level when it retires
+  bool isReserve;     // LR: load which takes the reservation
+  bool isConditional; // SC: store which needs the reservation, result is 0 when it succeeds
+  bool isAmo;         // atomic operation, done by the memory
+  ap_uint<5> funct5;
+  bool isCustom; // custom-0/1, done by the accelerator with rs1 in address and rs2 in valueToWrite
+  ap_uint<32> instruction; // decoded by the accelerator
 
   // Register for all stages
+  ap_uint<4> bubble;
   bool we;
 };
 
@@ -118,6 +131,8 @@ struct WBOut {
   ap_uint<32> value;
   ap_uint<5> rd;
   bool useRd;
+  bool isSyscall;
+  ap_uint<4> bubble;
   bool we;
 };
 
@@ -0,0 +1,412 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef __PIPELINE_TRACE_H__
+#define __PIPELINE_TRACE_H__
+
+// Host-side per-cycle trace of the pipeline (the CycleTrace filled by doCycle),
+// read back by pipelineView. Records are encoded by the simulator thread into a
+// buffer, full buffers are compressed and written by a background thread.
+//
+// Trace format: the 4 bytes "CPTR", a version byte and a compression byte, then
+// the stream of records, compressed as a single zstd frame when the compression
+// byte is PIPELINE_TRACE_ZSTD. Each record is encoded against the previous one:
+//   - two bytes (little endian): a PcCode per stage in bits [9:0], then
+//     bit 10: valid follows, bit 11: stalls, branches and cycle class follow,
+//     bit 12: forwards follow (each only when it changed), bit 13: memory request follows
+//   - valid, one byte
+//   - stalls, one byte, then branches | cycleClass << 2, one byte
+//   - forwards, two bytes
+//   - memory request: opType | mask << 3, one byte, then the difference with the
+//     previous address, zigzag encoded as a LEB128 varint
+//   - for each stage with PC_EXPLICIT, the difference with its previous pc, as the address
+// The pc of a stage which does not hold an instruction is not recorded: the reader
+// returns the last recorded one. A cycle of a running pipeline takes two bytes.
+//
+// Compression needs libzstd: build with -DCOMET_TRACE_ZSTD -lzstd, otherwise
+// traces are written raw (and the reader only accepts raw traces).
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "core.h"
+#ifdef COMET_TRACE_ZSTD
+#include <zstd.h>
+#endif
+
+#define PIPELINE_TRACE_VERSION 1
+#define PIPELINE_TRACE_RAW     0
+#define PIPELINE_TRACE_ZSTD    1
+#define PIPELINE_TRACE_BUFFER  (1 << 20)
+#define PIPELINE_TRACE_RECORD  64 // larger than any encoded record
+
+#define PIPELINE_TRACE_VALID    (1 << 10)
+#define PIPELINE_TRACE_CONTROL  (1 << 11)
+#define PIPELINE_TRACE_FORWARDS (1 << 12)
+#define PIPELINE_TRACE_MEMORY   (1 << 13)
+
+// How the pc of a stage is obtained from the previous record
+enum PcCode { PC_SAME = 0, PC_ADVANCED = 1, PC_NEXT = 2, PC_EXPLICIT = 3 };
+// PC_SAME: unchanged, PC_ADVANCED: pc of the previous stage, PC_NEXT: pc + 4
+
+class PipelineTraceWriter {
+public:
+  PipelineTraceWriter(const char* path)
+  {
+    traceFile = fopen(path, "wb");
+    if (traceFile == NULL) {
+      fprintf(stderr, "Failed to open trace file %s\n", path);
+      exit(-1);
+    }
+#ifdef COMET_TRACE_ZSTD
+    const unsigned char compression = PIPELINE_TRACE_ZSTD;
+    context                         = ZSTD_createCCtx();
+    ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, 1);
+    compressed.resize(ZSTD_CStreamOutSize());
+#else
+    const unsigned char compression = PIPELINE_TRACE_RAW;
+#endif
+    const unsigned char header[6] = {'C', 'P', 'T', 'R', PIPELINE_TRACE_VERSION, compression};
+    fwrite(header, 1, 6, traceFile);
+
+    current  = new unsigned char[PIPELINE_TRACE_BUFFER + PIPELINE_TRACE_RECORD];
+    pending  = new unsigned char[PIPELINE_TRACE_BUFFER + PIPELINE_TRACE_RECORD];
+    position = 0;
+    previous = CycleTrace();
+
+    numberCycles = 0;
+    numberBytes  = 0;
+    pendingSize  = 0;
+    pendingFull  = false;
+    done         = false;
+    writerThread = std::thread(&PipelineTraceWriter::writerLoop, this);
+  }
+
+  // Writes the last buffer and waits for the background thread
+  ~PipelineTraceWriter()
+  {
+    handOver(true);
+    writerThread.join();
+#ifdef COMET_TRACE_ZSTD
+    ZSTD_freeCCtx(context);
+#endif
+    fclose(traceFile);
+    delete[] current;
+    delete[] pending;
+  }
+
+  void write(const CycleTrace& cycle)
+  {
+    unsigned char* record = current + position;
+    int size              = 2;
+    unsigned int flags    = 0;
+
+    if (cycle.valid != previous.valid) {
+      flags |= PIPELINE_TRACE_VALID;
+      record[size++]  = cycle.valid;
+      previous.valid = cycle.valid;
+    }
+    if (cycle.stalls != previous.stalls || cycle.branches != previous.branches ||
+        cycle.cycleClass != previous.cycleClass) {
+      flags |= PIPELINE_TRACE_CONTROL;
+      record[size++]       = cycle.stalls;
+      record[size++]       = cycle.branches | (cycle.cycleClass << 2);
+      previous.stalls     = cycle.stalls;
+      previous.branches   = cycle.branches;
+      previous.cycleClass = cycle.cycleClass;
+    }
+    if (cycle.forwards != previous.forwards) {
+      flags |= PIPELINE_TRACE_FORWARDS;
+      record[size++]     = cycle.forwards;
+      record[size++]     = cycle.forwards >> 8;
+      previous.forwards = cycle.forwards;
+    }
+    if (cycle.memOpType != NONE) {
+      flags |= PIPELINE_TRACE_MEMORY;
+      record[size++] = cycle.memOpType | (cycle.memMask << 3);
+      size += writeDelta(record + size, cycle.memAddr - previous.memAddr);
+      previous.memAddr = cycle.memAddr;
+    }
+
+    // Stages are encoded from writeback to fetch, so that PC_ADVANCED refers to the
+    // previous pc of the stage before
+    for (int stage = 4; stage >= 0; stage--) {
+      const unsigned int pc = cycle.pc[stage];
+      unsigned int code;
+      if (!(cycle.valid & (1 << stage)) || pc == previous.pc[stage])
+        code = PC_SAME;
+      else if (stage > 0 && pc == previous.pc[stage - 1])
+        code = PC_ADVANCED;
+      else if (pc == previous.pc[stage] + 4)
+        code = PC_NEXT;
+      else {
+        code = PC_EXPLICIT;
+        size += writeDelta(record + size, pc - previous.pc[stage]);
+      }
+      if (code != PC_SAME)
+        previous.pc[stage] = pc;
+      flags |= code << (2 * stage);
+    }
+
+    record[0] = flags;
+    record[1] = flags >> 8;
+    position += size;
+    numberCycles++;
+    if (position >= PIPELINE_TRACE_BUFFER)
+      handOver(false);
+  }
+
+  unsigned long numberCycles;
+  unsigned long numberBytes; // before compression
+
+private:
+  FILE* traceFile;
+  CycleTrace previous;
+
+  // The simulator thread fills current while the writer thread writes pending
+  unsigned char* current;
+  unsigned char* pending;
+  int position, pendingSize;
+  bool pendingFull, done;
+  std::mutex lock;
+  std::condition_variable changed;
+  std::thread writerThread;
+
+#ifdef COMET_TRACE_ZSTD
+  ZSTD_CCtx* context;
+  std::vector<unsigned char> compressed;
+#endif
+
+  static int writeDelta(unsigned char* out, const unsigned int difference)
+  {
+    const int delta     = difference;
+    unsigned int zigzag = ((unsigned int)delta << 1) ^ (delta >> 31);
+    int size            = 0;
+    while (zigzag >= 0x80) {
+      out[size++] = zigzag | 0x80;
+      zigzag >>= 7;
+    }
+    out[size++] = zigzag;
+    return size;
+  }
+
+  // Swaps the buffers once the writer thread is done with the previous one
+  void handOver(const bool last)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this]() { return !pendingFull; });
+    std::swap(current, pending);
+    pendingSize = position;
+    pendingFull = true;
+    done        = last;
+    numberBytes += position;
+    position = 0;
+    changed.notify_all();
+  }
+
+  void writerLoop()
+  {
+    bool last = false;
+    while (!last) {
+      std::unique_lock<std::mutex> guard(lock);
+      changed.wait(guard, [this]() { return pendingFull; });
+      last = done;
+      guard.unlock();
+
+#ifdef COMET_TRACE_ZSTD
+      ZSTD_inBuffer input = {pending, (size_t)pendingSize, 0};
+      size_t remaining;
+      do {
+        ZSTD_outBuffer output = {compressed.data(), compressed.size(), 0};
+        remaining             = ZSTD_compressStream2(context, &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+        fwrite(compressed.data(), 1, output.pos, traceFile);
+      } while (last ? remaining != 0 : input.pos != input.size);
+#else
+      fwrite(pending, 1, pendingSize, traceFile);
+#endif
+
+      guard.lock();
+      pendingFull = false;
+      changed.notify_all();
+    }
+  }
+};
+
+class PipelineTraceReader {
+public:
+  // Exits with an error message if the file is not a pipeline trace
+  PipelineTraceReader(const char* path) : path(path)
+  {
+    traceFile = fopen(path, "rb");
+    unsigned char header[6];
+    if (traceFile == NULL || fread(header, 1, 6, traceFile) != 6 || header[0] != 'C' || header[1] != 'P' ||
+        header[2] != 'T' || header[3] != 'R' || header[4] != PIPELINE_TRACE_VERSION) {
+      fprintf(stderr, "%s is not a pipeline trace\n", path);
+      exit(-1);
+    }
+    compression = header[5];
+#ifdef COMET_TRACE_ZSTD
+    if (compression == PIPELINE_TRACE_ZSTD) {
+      context = ZSTD_createDCtx();
+      compressed.resize(ZSTD_DStreamInSize());
+      input = {compressed.data(), 0, 0};
+    }
+#endif
+    if (compression != PIPELINE_TRACE_RAW && compression != PIPELINE_TRACE_ZSTD) {
+      fprintf(stderr, "%s: unknown compression %d\n", path, compression);
+      exit(-1);
+    }
+#ifndef COMET_TRACE_ZSTD
+    if (compression == PIPELINE_TRACE_ZSTD) {
+      fprintf(stderr, "%s is compressed, rebuild with -DCOMET_TRACE_ZSTD -lzstd\n", path);
+      exit(-1);
+    }
+#endif
+
+    buffer.resize(PIPELINE_TRACE_BUFFER);
+    position = 0;
+    end      = 0;
+    current  = CycleTrace();
+  }
+
+  ~PipelineTraceReader()
+  {
+#ifdef COMET_TRACE_ZSTD
+    if (compression == PIPELINE_TRACE_ZSTD)
+      ZSTD_freeDCtx(context);
+#endif
+    fclose(traceFile);
+  }
+
+  // Returns false at the end of the trace
+  bool read(CycleTrace& cycle)
+  {
+    int byte = nextByte();
+    if (byte < 0)
+      return false;
+    const unsigned int flags = byte | (requiredByte() << 8);
+
+    if (flags & PIPELINE_TRACE_VALID)
+      current.valid = requiredByte();
+    if (flags & PIPELINE_TRACE_CONTROL) {
+      current.stalls           = requiredByte();
+      const unsigned char both = requiredByte();
+      current.branches         = both & 0x3;
+      current.cycleClass       = both >> 2;
+    }
+    if (flags & PIPELINE_TRACE_FORWARDS) {
+      // Two statements: the order of the calls in one expression is unspecified
+      const unsigned int low  = requiredByte();
+      const unsigned int high = requiredByte();
+      current.forwards        = low | (high << 8);
+    }
+    if (flags & PIPELINE_TRACE_MEMORY) {
+      const unsigned char both = requiredByte();
+      current.memOpType        = both & 0x7;
+      current.memMask          = both >> 3;
+      current.memAddr += readDelta();
+    } else
+      current.memOpType = NONE;
+
+    for (int stage = 4; stage >= 0; stage--) {
+      switch ((flags >> (2 * stage)) & 0x3) {
+        case PC_ADVANCED:
+          current.pc[stage] = current.pc[stage - 1];
+          break;
+        case PC_NEXT:
+          current.pc[stage] += 4;
+          break;
+        case PC_EXPLICIT:
+          current.pc[stage] += readDelta();
+          break;
+      }
+    }
+
+    cycle = current;
+    return true;
+  }
+
+private:
+  const char* path;
+  FILE* traceFile;
+  unsigned char compression;
+  CycleTrace current;
+
+  std::vector<unsigned char> buffer; // decompressed bytes
+  size_t position, end;
+
+#ifdef COMET_TRACE_ZSTD
+  ZSTD_DCtx* context;
+  std::vector<unsigned char> compressed;
+  ZSTD_inBuffer input;
+#endif
+
+  // Next byte of the records, or -1 at the end of the file
+  int nextByte()
+  {
+    while (position == end) {
+      position = 0;
+#ifdef COMET_TRACE_ZSTD
+      if (compression == PIPELINE_TRACE_ZSTD) {
+        if (input.pos == input.size) {
+          input.size = fread(compressed.data(), 1, compressed.size(), traceFile);
+          input.pos  = 0;
+          if (input.size == 0)
+            return -1;
+        }
+        ZSTD_outBuffer output = {buffer.data(), buffer.size(), 0};
+        if (ZSTD_isError(ZSTD_decompressStream(context, &output, &input))) {
+          fprintf(stderr, "%s is corrupted\n", path);
+          exit(-1);
+        }
+        end = output.pos;
+        continue;
+      }
+#endif
+      end = fread(buffer.data(), 1, buffer.size(), traceFile);
+      if (end == 0)
+        return -1;
+    }
+    return buffer[position++];
+  }
+
+  unsigned char requiredByte()
+  {
+    const int byte = nextByte();
+    if (byte < 0) {
+      fprintf(stderr, "%s is truncated\n", path);
+      exit(-1);
+    }
+    return byte;
+  }
+
+  unsigned int readDelta()
+  {
+    unsigned int zigzag = 0;
+    int shift           = 0;
+    unsigned char byte;
+    do {
+      byte = requiredByte();
+      zigzag |= (byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    return (zigzag >> 1) ^ -(zigzag & 1);
+  }
+};
+
+#endif // __PIPELINE_TRACE_H__
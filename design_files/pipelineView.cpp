@@ -0,0 +1,203 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// Reads a pipeline trace (simulator -r) and prints the pipeline diagram of a
+// window of cycles: one line per instruction, one column per cycle, with the
+// stage it occupies (F, D, E, M, W), '-' while it stays in the same stage and
+// 'x' when it is flushed. The last line gives the cycle class (see core.h):
+// blank when an instruction retires, '~' for a bubble, then I and D for memory
+// stalls, L for load-use, B and X for branches taken in decode and execute, G
+// for the global stall and S for decode waiting behind a csr write or an ecall.
+// With -c, prints the content of each cycle instead.
+//
+// g++ -O2 -I<vitis>/include pipelineView.cpp riscvISA.cpp elfFile.cpp [-DCOMET_TRACE_ZSTD -lzstd]
+// pipelineView trace [-s firstCycle] [-n cycles] [-e program.elf] [-c]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include "elfFile.h"
+#include "pipelineTrace.h"
+
+static const char stageNames[5]       = {'F', 'D', 'E', 'M', 'W'};
+static const char cycleClassNames[10] = "~ IDLBXGS"; // indexed by CycleClassNames, retire is blank
+
+struct Row {
+  unsigned int pc;
+  std::string stages;
+  int lastStage;
+};
+
+// Disassembly of the instruction at pc, read from the program when it is given
+static const char* instructionText(const ElfFile* elf, const unsigned int pc, char buffer[RISCV_DISASSEMBLY_SIZE])
+{
+  if (elf == NULL)
+    return "";
+  for (const ElfSection& section : elf->sectionTable) {
+    const unsigned char* code = elf->getSectionCode(section);
+    if (code != NULL && (section.flags & ELF_SHF_ALLOC) && pc >= section.address &&
+        pc + 2 <= section.address + section.size) {
+      const unsigned char* bytes = code + (pc - section.address);
+      unsigned int instruction   = bytes[0] | (bytes[1] << 8);
+      if (RISCV_IS_COMPRESSED(instruction))
+        instruction = expandCompressed(instruction);
+      else if (pc + 4 <= section.address + section.size)
+        instruction |= (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+      else
+        return "";
+      disassembleRISCV(instruction, pc, buffer);
+      return buffer;
+    }
+  }
+  return "";
+}
+
+static void printCycle(const unsigned long cycle, const CycleTrace& trace)
+{
+  printf("%10lu", cycle);
+  for (int stage = 0; stage < 5; stage++) {
+    if (trace.valid & (1 << stage))
+      printf("  %c %08x", stageNames[stage], trace.pc[stage]);
+    else
+      printf("  %c --------", stageNames[stage]);
+  }
+
+  // Stalls, forwards and branches, as the letter of the stage or signal when set
+  printf("  stall ");
+  for (int stage = 0; stage < 5; stage++)
+    putchar((trace.stalls & (1 << stage)) ? stageNames[stage] : '.');
+  putchar((trace.stalls & 0x20) ? 'I' : '.');
+  putchar((trace.stalls & 0x40) ? 'D' : '.');
+  putchar((trace.stalls & 0x80) ? 'G' : '.');
+  printf("  fwd ");
+  for (int source = 0; source < 3; source++) {
+    for (int operand = 0; operand < 3; operand++)
+      putchar((trace.forwards & (1 << (3 * source + operand))) ? "EMW"[source] : '.');
+  }
+  printf("  br %c%c  %c", (trace.branches & 1) ? 'D' : '.', (trace.branches & 2) ? 'E' : '.',
+         cycleClassNames[trace.cycleClass]);
+  if (trace.memOpType != NONE)
+    printf("  %s %08x", trace.memOpType == LOAD ? "ld" : trace.memOpType == STORE ? "st" : "fl", trace.memAddr);
+  putchar('\n');
+}
+
+int main(int argc, char** argv)
+{
+  const char* tracePath      = NULL;
+  const char* elfPath        = NULL;
+  unsigned long first        = 0;
+  unsigned long numberCycles = 64;
+  bool listCycles            = false;
+
+  for (int oneArg = 1; oneArg < argc; oneArg++) {
+    if (!strcmp(argv[oneArg], "-s") && oneArg + 1 < argc)
+      first = strtoul(argv[++oneArg], NULL, 0);
+    else if (!strcmp(argv[oneArg], "-n") && oneArg + 1 < argc)
+      numberCycles = strtoul(argv[++oneArg], NULL, 0);
+    else if (!strcmp(argv[oneArg], "-e") && oneArg + 1 < argc)
+      elfPath = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-c"))
+      listCycles = true;
+    else if (tracePath == NULL && argv[oneArg][0] != '-')
+      tracePath = argv[oneArg];
+    else {
+      fprintf(stderr, "Usage: %s trace [-s firstCycle] [-n cycles] [-e program.elf] [-c]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (tracePath == NULL || numberCycles == 0) {
+    fprintf(stderr, "Usage: %s trace [-s firstCycle] [-n cycles] [-e program.elf] [-c]\n", argv[0]);
+    return -1;
+  }
+
+  ElfFile* elf = (elfPath != NULL) ? new ElfFile(elfPath) : NULL;
+  PipelineTraceReader reader(tracePath);
+
+  // Instructions are followed from stage to stage with the stall signals, every
+  // fetch which moves to decode creates a new instruction
+  long stages[5] = {-1, -1, -1, -1, -1};
+  long nextId    = 0;
+  std::map<long, Row> rows;
+  std::string classes;
+
+  CycleTrace trace;
+  unsigned long cycle = 0;
+  while (cycle < first + numberCycles && reader.read(trace)) {
+    // The instructions present at reset come first
+    for (int stage = (cycle == 0) ? 4 : 0; stage >= 0; stage--) {
+      if (stages[stage] < 0 && (stage == 0 || (trace.valid & (1 << stage))))
+        stages[stage] = nextId++;
+    }
+
+    const bool inWindow = cycle >= first;
+    for (int stage = 0; stage < 5; stage++) {
+      if (stages[stage] < 0)
+        continue;
+      if (!(trace.valid & (1 << stage))) {
+        // Flushed by a branch
+        if (inWindow && rows.count(stages[stage]))
+          rows[stages[stage]].stages[cycle - first] = 'x';
+        stages[stage] = -1;
+        continue;
+      }
+      if (!inWindow)
+        continue;
+      if (!rows.count(stages[stage]))
+        rows[stages[stage]] = {trace.pc[stage], std::string(numberCycles, ' '), -1};
+      Row& row                  = rows[stages[stage]];
+      row.stages[cycle - first] = (row.lastStage == stage) ? '-' : stageNames[stage];
+      row.lastStage             = stage;
+    }
+    if (inWindow) {
+      classes += cycleClassNames[trace.cycleClass];
+      if (listCycles)
+        printCycle(cycle, trace);
+    }
+
+    // Same commit conditions as doCycle, nothing moves while the pipeline is frozen
+    if (!(trace.stalls & 0xe0)) {
+      if (!(trace.stalls & (1 << STALL_MEMORY)))
+        stages[4] = stages[3];
+      if (!(trace.stalls & (1 << STALL_EXECUTE)))
+        stages[3] = stages[2];
+      if (!(trace.stalls & (1 << STALL_DECODE)))
+        stages[2] = stages[1];
+      else if (!(trace.stalls & (1 << STALL_EXECUTE)))
+        stages[2] = -1; // load-use bubble
+      if (!(trace.stalls & (1 << STALL_FETCH))) {
+        stages[1] = stages[0];
+        stages[0] = -1;
+      }
+    }
+    cycle++;
+  }
+
+  if (listCycles)
+    return 0;
+
+  printf("%-8s %-20s  ", "pc", elf != NULL ? "instruction" : "");
+  for (unsigned long column = 0; column < numberCycles; column += 10)
+    printf("%-10lu", first + column);
+  putchar('\n');
+  char disassembly[RISCV_DISASSEMBLY_SIZE];
+  for (auto& oneRow : rows)
+    printf("%08x %-20s  %s\n", oneRow.second.pc, instructionText(elf, oneRow.second.pc, disassembly),
+           oneRow.second.stages.c_str());
+  printf("%-8s %-20s  %s\n", "class", "", classes.c_str());
+  delete elf;
+  return 0;
+}
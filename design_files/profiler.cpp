@@ -0,0 +1,162 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#include <algorithm>
+#include "profiler.h"
+#include "riscvISA.h"
+
+// Deeper stacks (runaway recursion) are folded into their last frame
+#define PROFILER_MAX_DEPTH 256
+
+Profiler::Profiler(const ElfFile& elf)
+{
+  functions            = elf.getFunctions();
+  pendingCycles        = 0;
+  totalCycles          = 0;
+  currentStackCounter  = NULL;
+  currentFunctionStart = 0;
+  currentFunctionEnd   = 0;
+  callStack.push_back(-1);
+}
+
+void Profiler::cycle(const bool retired, const unsigned int pc, const unsigned int instruction)
+{
+  pendingCycles++;
+  totalCycles++;
+  if (!retired)
+    return;
+
+  // The current function only changes when the pc leaves its range
+  if (pc < currentFunctionStart || pc >= currentFunctionEnd) {
+    const int function = findFunction(pc);
+    if (function < 0) {
+      currentFunctionStart = pc;
+      currentFunctionEnd   = pc + 4;
+    } else {
+      currentFunctionStart = functions[function].value;
+      currentFunctionEnd   = (functions[function].size != 0) ? functions[function].value + functions[function].size
+                           : (function + 1 < (int)functions.size()) ? functions[function + 1].value
+                                                                    : 0xffffffff;
+    }
+    if (function != callStack.back()) {
+      callStack.back()    = function;
+      currentStackCounter = NULL;
+    }
+  }
+
+  if (currentStackCounter == NULL)
+    currentStackCounter = &stackCounters[callStack];
+  *currentStackCounter += pendingCycles;
+
+  PcCounters& counters = pcCounters[pc];
+  counters.cycles += pendingCycles;
+  counters.instructions++;
+  counters.instruction = instruction;
+  pendingCycles        = 0;
+
+  // Calling convention: a call links in ra (or t0), a return jumps to it
+  const unsigned int opCode = instruction & 0x7f;
+  const unsigned int rd     = (instruction >> 7) & 0x1f;
+  const unsigned int rs1    = (instruction >> 15) & 0x1f;
+  const bool isLinkRd       = (rd == 1 || rd == 5);
+  const bool isLinkRs1      = (rs1 == 1 || rs1 == 5);
+
+  if ((opCode == RISCV_JAL || opCode == RISCV_JALR) && isLinkRd) {
+    if (callStack.size() < PROFILER_MAX_DEPTH) {
+      callStack.push_back(callStack.back());
+      currentStackCounter = NULL;
+    }
+  } else if (opCode == RISCV_JALR && rd == 0 && isLinkRs1 && callStack.size() > 1) {
+    callStack.pop_back();
+    currentStackCounter  = NULL;
+    currentFunctionStart = 0;
+    currentFunctionEnd   = 0;
+  }
+}
+
+void Profiler::printFlat(FILE* out, const int maxLines) const
+{
+  // Self cycles and instructions of each function
+  std::map<int, std::pair<unsigned long, unsigned long> > functionCounters;
+  for (const auto& onePc : pcCounters) {
+    std::pair<unsigned long, unsigned long>& counters = functionCounters[findFunction(onePc.first)];
+    counters.first += onePc.second.cycles;
+    counters.second += onePc.second.instructions;
+  }
+
+  std::vector<std::pair<unsigned long, int> > sortedFunctions;
+  for (const auto& oneFunction : functionCounters)
+    sortedFunctions.push_back(std::make_pair(oneFunction.second.first, oneFunction.first));
+  std::sort(sortedFunctions.rbegin(), sortedFunctions.rend());
+
+  fprintf(out, "Flat profile, %lu cycles\n", totalCycles);
+  fprintf(out, "  %%time        cycles  instructions     CPI  function\n");
+  for (int oneLine = 0; oneLine < (int)sortedFunctions.size() && oneLine < maxLines; oneLine++) {
+    const unsigned long cycles       = sortedFunctions[oneLine].first;
+    const int function               = sortedFunctions[oneLine].second;
+    const unsigned long instructions = functionCounters.at(function).second;
+    fprintf(out, "%6.2f %14lu %13lu %7.2f  %s\n", 100.0 * cycles / totalCycles, cycles, instructions,
+            (double)cycles / instructions, functionName(function));
+  }
+
+  // Hottest instructions, with their disassembly
+  std::vector<std::pair<unsigned long, unsigned int> > sortedPcs;
+  for (const auto& onePc : pcCounters)
+    sortedPcs.push_back(std::make_pair(onePc.second.cycles, onePc.first));
+  std::sort(sortedPcs.rbegin(), sortedPcs.rend());
+
+  fprintf(out, "\nHottest instructions\n");
+  fprintf(out, "  %%time        cycles        pc  function+offset  instruction\n");
+  for (int oneLine = 0; oneLine < (int)sortedPcs.size() && oneLine < maxLines; oneLine++) {
+    const unsigned int pc      = sortedPcs[oneLine].second;
+    const int function         = findFunction(pc);
+    const unsigned int offset  = (function < 0) ? 0 : pc - functions[function].value;
+    const PcCounters& counters = pcCounters.at(pc);
+    char disassembly[RISCV_DISASSEMBLY_SIZE];
+    disassembleRISCV(counters.instruction, pc, disassembly);
+    fprintf(out, "%6.2f %14lu  %08x  %s+0x%x  %s\n", 100.0 * counters.cycles / totalCycles, counters.cycles, pc,
+            functionName(function), offset, disassembly);
+  }
+}
+
+void Profiler::printFolded(FILE* out) const
+{
+  for (const auto& oneStack : stackCounters) {
+    if (oneStack.second == 0)
+      continue;
+    for (unsigned int oneFrame = 0; oneFrame < oneStack.first.size(); oneFrame++)
+      fprintf(out, "%s%s", (oneFrame == 0) ? "" : ";", functionName(oneStack.first[oneFrame]));
+    fprintf(out, " %lu\n", oneStack.second);
+  }
+}
+
+int Profiler::findFunction(const unsigned int pc) const
+{
+  // Last function starting at or before pc
+  auto next = std::upper_bound(functions.begin(), functions.end(), pc,
+                               [](const unsigned int value, const ElfSymbol& symbol) { return value < symbol.value; });
+  if (next == functions.begin())
+    return -1;
+
+  const int function = (next - functions.begin()) - 1;
+  if (functions[function].size != 0 && pc >= functions[function].value + functions[function].size)
+    return -1;
+  return function;
+}
+
+const char* Profiler::functionName(const int function) const
+{
+  return (function >= 0) ? functions[function].name.c_str() : "[unknown]";
+}
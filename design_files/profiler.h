@@ -0,0 +1,65 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+// Host-side profiler of the guest program. Every cycle of doCycle is charged to
+// an instruction: the one frozen in writeback during a stall, or, when writeback
+// receives a bubble, the next instruction to retire (the one which waited).
+// Calls and returns are tracked on retired JAL/JALR to rebuild call stacks.
+
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "elfFile.h"
+
+class Profiler {
+public:
+  Profiler(const ElfFile& elf);
+
+  // Called once per cycle. retired is true when the instruction at pc leaves writeback
+  void cycle(const bool retired, const unsigned int pc, const unsigned int instruction);
+
+  // Functions sorted by self cycles, followed by the hottest instructions
+  void printFlat(FILE* out, const int maxLines) const;
+
+  // One line per call stack, "main;foo;bar cycles", as read by flamegraph.pl or speedscope
+  void printFolded(FILE* out) const;
+
+private:
+  struct PcCounters {
+    unsigned long cycles;
+    unsigned long instructions;
+    unsigned int instruction;
+  };
+
+  std::vector<ElfSymbol> functions;
+  std::unordered_map<unsigned int, PcCounters> pcCounters;
+  std::map<std::vector<int>, unsigned long> stackCounters;
+
+  unsigned long pendingCycles;
+  unsigned long totalCycles;
+
+  std::vector<int> callStack; // callers, then the current function as last element
+  unsigned long* currentStackCounter;
+  unsigned int currentFunctionStart, currentFunctionEnd;
+
+  int findFunction(const unsigned int pc) const;
+  const char* functionName(const int function) const;
+};
+
+#endif // __PROFILER_H__
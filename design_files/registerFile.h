@@ -0,0 +1,118 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+#ifndef INCLUDE_REGISTERFILE_H_
+#define INCLUDE_REGISTERFILE_H_
+
+#include "ap_int.h"
+
+/************************************************************************
+ * 	Register file of a hart, with two read ports and one write port.
+ * 	Each read port has its own copy of the registers, so that both copies
+ * 	map to a simple dual port LUTRAM (one read, one write), and the write
+ * 	port updates both.
+ * 	Writeback drives the write port at the beginning of the cycle (write),
+ * 	decode reads, and the write takes place at the end of the cycle
+ * 	(update). A read of the register being written returns the new value
+ * 	(write first): decode needs no forwarding from writeback.
+ * 	x0 is never written (writeback does not drive it).
+ * 	a0-a3 and a7 also have a copy in registers, kept by every write: the
+ * 	syscalls read them in the cycle where the pipeline uses the ports.
+ ************************************************************************/
+class RegisterFile {
+public:
+  ap_int<32> bank1[32]; // read port 1 (rs1)
+  ap_int<32> bank2[32]; // read port 2 (rs2, which is also rs3)
+
+  // Arguments of the syscalls
+  ap_int<32> a0, a1, a2, a3, a7;
+
+  // Write port
+  bool writeEnable;
+  ap_uint<5> writeAddress;
+  ap_int<32> writeValue;
+
+  RegisterFile()
+  {
+    for (int oneRegister = 0; oneRegister < 32; oneRegister++) {
+      bank1[oneRegister] = 0;
+      bank2[oneRegister] = 0;
+    }
+    a0           = 0;
+    a1           = 0;
+    a2           = 0;
+    a3           = 0;
+    a7           = 0;
+    writeEnable  = false;
+    writeAddress = 0;
+    writeValue   = 0;
+  }
+
+  void write(const bool enable, const ap_uint<5> address, const ap_int<32> value)
+  {
+    writeEnable  = enable;
+    writeAddress = address;
+    writeValue   = value;
+  }
+
+  bool bypassed(const ap_uint<5> address) const { return writeEnable && writeAddress == address; }
+
+  ap_int<32> read1(const ap_uint<5> address) const { return bypassed(address) ? writeValue : bank1[address]; }
+  ap_int<32> read2(const ap_uint<5> address) const { return bypassed(address) ? writeValue : bank2[address]; }
+
+  // End of the cycle: the write is dropped when the pipeline is frozen
+  void update(const bool commit)
+  {
+    if (writeEnable && commit) {
+      bank1[writeAddress] = writeValue;
+      bank2[writeAddress] = writeValue;
+      copyArgument(writeAddress, writeValue);
+    }
+    writeEnable = false;
+  }
+
+  // Outside of the pipeline (reset, syscalls, host)
+  ap_int<32> operator[](const int address) const { return bank1[address]; }
+  void set(const int address, const ap_int<32> value)
+  {
+    bank1[address] = value;
+    bank2[address] = value;
+    copyArgument(address, value);
+  }
+
+private:
+  void copyArgument(const ap_uint<5> address, const ap_int<32> value)
+  {
+    switch (address) {
+      case 10:
+        a0 = value;
+        break;
+      case 11:
+        a1 = value;
+        break;
+      case 12:
+        a2 = value;
+        break;
+      case 13:
+        a3 = value;
+        break;
+      case 17:
+        a7 = value;
+        break;
+    }
+  }
+};
+
+#endif /* INCLUDE_REGISTERFILE_H_ */
@@ -13,174 +13,355 @@
 
 
 
-#include <sstream>
 #include <string>
 #include "riscvISA.h"
 
-const char* riscvNamesOP[8]   = {"ADD", "SLL", "CMPLT", "CMPLTU", "XOR", "", "OR", "AND"};
-const char* riscvNamesOPI[8]  = {"ADDi", "SLLi", "SLTi", "CMPLTUi", "XORi", "SRLi", "ORi", "ANDi"};
-const char* riscvNamesOPW[8]  = {"ADDW", "SLLW", "", "", "", "SRW", "", ""};
-const char* riscvNamesOPIW[8] = {"ADDWi", "SLLWi", "", "", "", "SRi", "", ""};
-const char* riscvNamesLD[8]   = {"LDB", "LDH", "LDW", "LDD", "LDBU", "LDHU", "LDWU"};
-const char* riscvNamesST[8]   = {"STB", "STH", "STW", "STD"};
-const char* riscvNamesBR[8]   = {"BEQ", "BNE", "", "", "BLT", "BGE", "BLTU", "BGEU"};
-const char* riscvNamesMUL[8]  = {"MPYLO", "MPYHI", "MPYHI", "MPYHI", "DIVHI", "DIVHI", "DIVLO", "DIVLO"};
+#ifndef __HLS__
+// Mnemonics, indexed by funct3 (and funct7 for the R-type variants). NULL is an invalid encoding
+// in RV32: the RV64 loads, stores and W instructions are not decoded
+static const char* const riscvNamesOP[8]    = {"add", "sll", "slt", "sltu", "xor", "srl", "or", "and"};
+static const char* const riscvNamesOPAlt[8] = {"sub", NULL, NULL, NULL, NULL, "sra", NULL, NULL}; // funct7 = 0x20
+static const char* const riscvNamesM[8]     = {"mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu"};
+static const char* const riscvNamesOPI[8]   = {"addi", "slli", "slti", "sltiu", "xori", "srli", "ori", "andi"};
+static const char* const riscvNamesLD[8]    = {"lb", "lh", "lw", NULL, "lbu", "lhu", NULL, NULL};
+static const char* const riscvNamesST[8]    = {"sb", "sh", "sw", NULL, NULL, NULL, NULL, NULL};
+static const char* const riscvNamesBR[8]    = {"beq", "bne", NULL, NULL, "blt", "bge", "bltu", "bgeu"};
+static const char* const riscvNamesCSR[8]   = {NULL, "csrrw", "csrrs", "csrrc", NULL, "csrrwi", "csrrsi", "csrrci"};
 
-std::string printDecodedInstrRISCV(unsigned int oneInstruction)
+// Indexed by funct7[6:2]
+static const char* const riscvNamesAtomic[32] = {
+    "amoadd.w", "amoswap.w", "lr.w", "sc.w", "amoxor.w",  NULL, NULL, NULL, "amoor.w",  NULL, NULL,
+    NULL,       "amoand.w",  NULL,   NULL,   NULL,        "amomin.w", NULL, NULL, NULL, "amomax.w", NULL,
+    NULL,       NULL,        "amominu.w", NULL, NULL,     NULL,       "amomaxu.w", NULL, NULL, NULL};
+static const char* const riscvNamesOrdering[4] = {"", ".rl", ".aq", ".aqrl"};
+
+// Predecessor and successor sets of fence, indexed by the iorw bits
+static const char* const riscvNamesFenceSets[16] = {"0",  "w",  "r",   "rw",  "o",  "ow",  "or",  "orw",
+                                                    "i",  "iw", "ir",  "irw", "io", "iow", "ior", "iorw"};
+
+static const char* const riscvNamesRegisters[32] = {
+    "zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6",   "a7", "s2", "s3", "s4",  "s5",  "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+struct CsrName {
+  unsigned short number;
+  const char* name;
+};
+
+// The hpm counters and events are numbered, they are not in this table
+static const CsrName riscvNamesCsrs[] = {
+    {RISCV_CSR_MVENDORID, "mvendorid"},
+    {RISCV_CSR_MARCHID, "marchid"},
+    {RISCV_CSR_MIMPID, "mimpid"},
+    {RISCV_CSR_MHARTID, "mhartid"},
+    {RISCV_CSR_MSTATUS, "mstatus"},
+    {RISCV_CSR_MISA, "misa"},
+    {RISCV_CSR_MEDELEG, "medeleg"},
+    {RISCV_CSR_MIDELEG, "mideleg"},
+    {RISCV_CSR_MIE, "mie"},
+    {RISCV_CSR_MTVEC, "mtvec"},
+    {RISCV_CSR_MCOUNTEREN, "mcounteren"},
+    {RISCV_CSR_MCOUNTINHIBIT, "mcountinhibit"},
+    {RISCV_CSR_MSCRATCH, "mscratch"},
+    {RISCV_CSR_MEPC, "mepc"},
+    {RISCV_CSR_MCAUSE, "mcause"},
+    {RISCV_CSR_MTVAL, "mtval"},
+    {RISCV_CSR_MIP, "mip"},
+    {RISCV_CSR_MCYCLE, "mcycle"},
+    {RISCV_CSR_MINSTRET, "minstret"},
+    {RISCV_CSR_MCYCLEH, "mcycleh"},
+    {RISCV_CSR_MINSTRETH, "minstreth"},
+    {RISCV_CSR_CYCLE, "cycle"},
+    {0xC01, "time"},
+    {RISCV_CSR_INSTRET, "instret"},
+    {RISCV_CSR_CYCLEH, "cycleh"},
+    {0xC81, "timeh"},
+    {RISCV_CSR_INSTRETH, "instreth"},
+};
+
+// Helpers appending to the output, they return the new end of the text
+static char* appendText(char* out, const char* text)
 {
-  char opcode         = oneInstruction & 0x7f;
-  char rs1            = ((oneInstruction >> 15) & 0x1f);
-  char rs2            = ((oneInstruction >> 20) & 0x1f);
-  char rs3            = ((oneInstruction >> 27) & 0x1f);
-  char rd             = ((oneInstruction >> 7) & 0x1f);
-  char funct7         = ((oneInstruction >> 25) & 0x7f);
-  char funct7_smaller = funct7 & 0x3e;
+  while (*text)
+    *out++ = *text++;
+  return out;
+}
 
-  char funct3            = ((oneInstruction >> 12) & 0x7);
-  unsigned short imm12_I = ((oneInstruction >> 20) & 0xfff);
-  unsigned short imm12_S = ((oneInstruction >> 20) & 0xfe0) + ((oneInstruction >> 7) & 0x1f);
+static char* appendUnsigned(char* out, unsigned int value)
+{
+  char digits[10];
+  int size = 0;
+  do {
+    digits[size++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  while (size > 0)
+    *out++ = digits[--size];
+  return out;
+}
 
-  short imm12_I_signed = (imm12_I >= 2048) ? imm12_I - 4096 : imm12_I;
-  short imm12_S_signed = (imm12_S >= 2048) ? imm12_S - 4096 : imm12_S;
+static char* appendSigned(char* out, const int value)
+{
+  if (value < 0) {
+    *out++ = '-';
+    return appendUnsigned(out, -(unsigned int)value);
+  }
+  return appendUnsigned(out, value);
+}
 
-  short imm13 = ((oneInstruction >> 19) & 0x1000) + ((oneInstruction >> 20) & 0x7e0) + ((oneInstruction >> 7) & 0x1e) +
-                ((oneInstruction << 4) & 0x800);
-  short imm13_signed = (imm13 >= 4096) ? imm13 - 8192 : imm13;
+static char* appendHex(char* out, const unsigned int value)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+  int shift                     = 28;
+  while (shift > 0 && (value >> shift) == 0)
+    shift -= 4;
+  for (; shift >= 0; shift -= 4)
+    *out++ = hexDigits[(value >> shift) & 0xf];
+  return out;
+}
 
-  unsigned int imm31_12 = oneInstruction & 0xfffff000;
-  int imm31_12_signed   = imm31_12;
+static char* appendRegister(char* out, const unsigned int reg)
+{
+  return appendText(out, riscvNamesRegisters[reg & 0x1f]);
+}
 
-  unsigned int imm21_1 = (oneInstruction & 0xff000) + ((oneInstruction >> 9) & 0x800) +
-                         ((oneInstruction >> 20) & 0x7fe) + ((oneInstruction >> 11) & 0x100000);
-  int imm21_1_signed = (imm21_1 >= 1048576) ? imm21_1 - 2097152 : imm21_1;
+// Three registers separated by commas, as in "rd,rs1,rs2"
+static char* appendRegisters(char* out, const unsigned int rd, const unsigned int rs1, const unsigned int rs2)
+{
+  out    = appendRegister(out, rd);
+  *out++ = ',';
+  out    = appendRegister(out, rs1);
+  *out++ = ',';
+  return appendRegister(out, rs2);
+}
 
-  char shamt = ((oneInstruction >> 20) & 0x3f);
+static char* appendCsr(char* out, const unsigned int csr)
+{
+  for (const CsrName& oneCsr : riscvNamesCsrs) {
+    if (oneCsr.number == csr)
+      return appendText(out, oneCsr.name);
+  }
+  const unsigned int group = csr & 0xfe0;
+  const char* prefix       = NULL;
+  if (group == 0xB00 || group == 0xB80)
+    prefix = "mhpmcounter";
+  else if (group == 0xC00 || group == 0xC80)
+    prefix = "hpmcounter";
+  else if (group == 0x320)
+    prefix = "mhpmevent";
+  if (prefix != NULL && (csr & 0x1f) >= 3) {
+    out = appendUnsigned(appendText(out, prefix), csr & 0x1f);
+    if (group & 0x80)
+      *out++ = 'h';
+    return out;
+  }
+  return appendHex(appendText(out, "0x"), csr);
+}
 
-  if (opcode == RISCV_OPIW) // If we are on opiw, shamt only have 5bits
-    shamt = rs2;
+int disassembleRISCV(const unsigned int oneInstruction, const unsigned int pc, char buffer[RISCV_DISASSEMBLY_SIZE])
+{
+  const unsigned int opcode = oneInstruction & 0x7f;
+  const unsigned int rd     = (oneInstruction >> 7) & 0x1f;
+  const unsigned int funct3 = (oneInstruction >> 12) & 0x7;
+  const unsigned int rs1    = (oneInstruction >> 15) & 0x1f;
+  const unsigned int rs2    = (oneInstruction >> 20) & 0x1f;
+  const unsigned int funct7 = oneInstruction >> 25;
 
-  // In case of immediate shift instr, as shamt needs one more bit the lower bit
-  // of funct7 has to be set to 0
-  if (opcode == RISCV_OPI && (funct3 == RISCV_OPI_SLLI || funct3 == RISCV_OPI_SRI))
-    funct7 = funct7 & 0x3f;
+  const int immI = (int)oneInstruction >> 20;
+  const int immS = (((int)oneInstruction >> 20) & ~0x1f) | rd;
+  const int immB = (((int)oneInstruction >> 19) & ~0xfff) | ((oneInstruction << 4) & 0x800) |
+                   ((oneInstruction >> 20) & 0x7e0) | ((oneInstruction >> 7) & 0x1e);
+  const int immJ = (((int)oneInstruction >> 11) & ~0xfffff) | (oneInstruction & 0xff000) |
+                   ((oneInstruction >> 9) & 0x800) | ((oneInstruction >> 20) & 0x7fe);
 
-  std::stringstream stream;
+  const char* name = NULL;
+  char* out        = buffer;
 
   switch (opcode) {
     case RISCV_LUI:
-      stream << "LUI r" << (int)rd << " " << imm31_12;
-      break;
     case RISCV_AUIPC:
-      stream << "AUIPC r" << (int)rd << " " << imm31_12;
+      out = appendText(out, opcode == RISCV_LUI ? "lui " : "auipc ");
+      out = appendRegister(out, rd);
+      out = appendText(out, ",0x");
+      out = appendHex(out, oneInstruction >> 12);
       break;
     case RISCV_JAL:
-      if (rd == 0)
-        stream << "J " << imm31_12;
-      else
-        stream << "JAL " << imm31_12;
+      out    = appendText(out, "jal ");
+      out    = appendRegister(out, rd);
+      *out++ = ',';
+      out    = appendHex(out, pc + immJ);
       break;
     case RISCV_JALR:
-      if (rd == 0)
-        stream << "JR r" << (int)rs1 << " << " << imm12_I_signed;
-      else
-        stream << "JALR r" << (int)rd << " r" << (int)rs1 << " " << imm12_I_signed;
+      if (funct3 != 0)
+        break;
+      out    = appendText(out, "jalr ");
+      out    = appendRegister(out, rd);
+      *out++ = ',';
+      out    = appendSigned(out, immI);
+      *out++ = '(';
+      out    = appendRegister(out, rs1);
+      *out++ = ')';
       break;
     case RISCV_BR:
-      stream << riscvNamesBR[funct3];
-      stream << " r" << (int)rs1 << " r" << (int)rs2 << " " << imm13_signed;
+      if ((name = riscvNamesBR[funct3]) == NULL)
+        break;
+      out    = appendText(out, name);
+      *out++ = ' ';
+      out    = appendRegister(out, rs1);
+      *out++ = ',';
+      out    = appendRegister(out, rs2);
+      *out++ = ',';
+      out    = appendHex(out, pc + immB);
       break;
     case RISCV_LD:
-      stream << riscvNamesLD[funct3];
-      stream << " r" << (int)rd << " = " << imm12_I_signed << " (r" << (int)rs1 << ")";
-      break;
     case RISCV_ST:
-      stream << riscvNamesST[funct3];
-      stream << " r" << (int)rs2 << " = " << imm12_S_signed << " (r" << (int)rs1 << ")";
+      if ((name = (opcode == RISCV_LD ? riscvNamesLD : riscvNamesST)[funct3]) == NULL)
+        break;
+      out    = appendText(out, name);
+      *out++ = ' ';
+      out    = appendRegister(out, opcode == RISCV_LD ? rd : rs2);
+      *out++ = ',';
+      out    = appendSigned(out, opcode == RISCV_LD ? immI : immS);
+      *out++ = '(';
+      out    = appendRegister(out, rs1);
+      *out++ = ')';
       break;
-    case RISCV_OPI:
-      if (funct3 == RISCV_OPI_SRI)
-        if (funct7 == RISCV_OPI_SRI_SRLI)
-          stream << "SRLi r" << (int)rd << " = r" << (int)rs1 << ", " << shamt;
-        else // SRAI
-          stream << "SRAi r" << (int)rd << " = r" << (int)rs1 << ", " << shamt;
-      else if (funct3 == RISCV_OPI_SLLI) {
-        stream << riscvNamesOPI[funct3];
-        stream << " r" << rd << " = r" << (int)rs1 << ", " << shamt;
-      } else {
-        stream << riscvNamesOPI[funct3];
-        stream << " r" << (int)rd << " = r" << (int)rs1 << ", " << imm12_I_signed;
-      }
+    case RISCV_OPI: {
+      // The shift amount takes 5 bits, the other bits of funct7 only select srai
+      const bool isShift = funct3 == RISCV_OPI_SLLI || funct3 == RISCV_OPI_SRI;
+      name               = riscvNamesOPI[funct3];
+      if (isShift && funct3 == RISCV_OPI_SRI && funct7 == RISCV_OPI_SRI_SRAI)
+        name = "srai";
+      else if (isShift && funct7 != 0)
+        break;
+      out    = appendText(out, name);
+      *out++ = ' ';
+      out    = appendRegister(out, rd);
+      *out++ = ',';
+      out    = appendRegister(out, rs1);
+      *out++ = ',';
+      if (isShift)
+        out = appendHex(appendText(out, "0x"), rs2);
+      else
+        out = appendSigned(out, immI);
       break;
+    }
     case RISCV_OP:
-      if (funct7 == 1) {
-        stream << riscvNamesMUL[funct3];
-        stream << " r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-      } else {
-        if (funct3 == RISCV_OP_ADD)
-          if (funct7 == RISCV_OP_ADD_ADD)
-            stream << "ADD r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-          else
-            stream << "SUB r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-        else if (funct3 == RISCV_OP_SR)
-          if (funct7 == RISCV_OP_SR_SRL)
-            stream << "SRL r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-          else // SRA
-            stream << "SRA r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-        else {
-          stream << riscvNamesOP[funct3];
-          stream << " r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-        }
-      }
+      if (funct7 == RISCV_OP_M)
+        name = riscvNamesM[funct3];
+      else if (funct7 == 0)
+        name = riscvNamesOP[funct3];
+      else if (funct7 == 0x20)
+        name = riscvNamesOPAlt[funct3];
+      if (name == NULL)
+        break;
+      out    = appendText(out, name);
+      *out++ = ' ';
+      out    = appendRegisters(out, rd, rs1, rs2);
       break;
-    case RISCV_OPIW:
-      if (funct3 == RISCV_OPIW_SRW)
-        if (funct7 == RISCV_OPIW_SRW_SRLIW)
-          stream << "SRLWi r" << (int)rd << " = r" << (int)rs1 << ", " << (int)rs2;
-        else // SRAI
-          stream << "SRAWi r" << (int)rd << " = r" << (int)rs1 << ", " << (int)rs2;
-      else if (funct3 == RISCV_OPIW_SLLIW) {
-        stream << riscvNamesOPI[funct3];
-        stream << " r" << (int)rd << " = r" << (int)rs1 << ", " << (int)rs2;
-      } else {
-        stream << riscvNamesOPIW[funct3];
-        stream << " r" << (int)rd << " = r" << (int)rs1 << ", " << imm12_I_signed;
+    case RISCV_ATOMIC:
+      if (funct3 != 2 || (name = riscvNamesAtomic[funct7 >> 2]) == NULL ||
+          ((funct7 >> 2) == RISCV_ATOMIC_LR && rs2 != 0))
+        break;
+      out    = appendText(out, name);
+      out    = appendText(out, riscvNamesOrdering[funct7 & 0x3]);
+      *out++ = ' ';
+      out    = appendRegister(out, rd);
+      *out++ = ',';
+      if ((funct7 >> 2) != RISCV_ATOMIC_LR) {
+        out    = appendRegister(out, rs2);
+        *out++ = ',';
       }
+      *out++ = '(';
+      out    = appendRegister(out, rs1);
+      *out++ = ')';
       break;
-    case RISCV_OPW:
-      if (funct7 == 1) {
-        stream << riscvNamesMUL[funct3];
-        stream << "W r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-      } else {
-        if (funct3 == RISCV_OP_ADD)
-          if (funct7 == RISCV_OPW_ADDSUBW_ADDW)
-            stream << "ADDW r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-          else
-            stream << "SUBW r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-        else if (funct3 == RISCV_OPW_SRW)
-          if (funct7 == RISCV_OPW_SRW_SRLW)
-            stream << "SRLW r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-          else // SRAW
-            stream << "SRAW r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-        else {
-          stream << riscvNamesOPW[funct3];
-          stream << " r" << (int)rd << " = r" << (int)rs1 << ", r" << (int)rs2;
-        }
+    case RISCV_CUSTOM0:
+    case RISCV_CUSTOM1:
+      // In the syntax of the assembler: .insn r opcode,funct3,funct7,rd,rs1,rs2
+      out    = appendText(out, ".insn r 0x");
+      out    = appendHex(out, opcode);
+      *out++ = ',';
+      out    = appendUnsigned(out, funct3);
+      *out++ = ',';
+      out    = appendUnsigned(out, funct7);
+      *out++ = ',';
+      out    = appendRegisters(out, rd, rs1, rs2);
+      break;
+    case RISCV_MISC_MEM: {
+      // fm takes the upper 4 bits of the immediate, only 0 and fence.tso are defined
+      const unsigned int fm          = oneInstruction >> 28;
+      const unsigned int predecessor = (oneInstruction >> 24) & 0xf;
+      const unsigned int successor   = (oneInstruction >> 20) & 0xf;
+      if (rd != 0 || rs1 != 0)
+        break;
+      if (funct3 == 0 && fm == 0x8 && predecessor == 0x3 && successor == 0x3) {
+        out = appendText(out, "fence.tso");
+      } else if (funct3 == 0 && fm == 0) {
+        out    = appendText(out, "fence ");
+        out    = appendText(out, riscvNamesFenceSets[predecessor]);
+        *out++ = ',';
+        out    = appendText(out, riscvNamesFenceSets[successor]);
+      } else if (funct3 == 1 && immI == 0) {
+        out = appendText(out, "fence.i");
       }
       break;
+    }
     case RISCV_SYSTEM:
-      stream << "SYSTEM";
-      break;
-    default:
-      stream << "??? ";
+      if (funct3 == RISCV_SYSTEM_ENV) {
+        switch (oneInstruction >> 7) {
+          case 0x000000:
+            name = "ecall";
+            break;
+          case 0x002000:
+            name = "ebreak";
+            break;
+          case 0x604000:
+            name = "mret";
+            break;
+          case 0x20a000:
+            name = "wfi";
+            break;
+        }
+        if (name != NULL)
+          out = appendText(out, name);
+        break;
+      }
+      if ((name = riscvNamesCSR[funct3]) == NULL)
+        break;
+      out    = appendText(out, name);
+      *out++ = ' ';
+      out    = appendRegister(out, rd);
+      *out++ = ',';
+      out    = appendCsr(out, oneInstruction >> 20);
+      *out++ = ',';
+      if (funct3 >= RISCV_SYSTEM_CSRRWI)
+        out = appendUnsigned(out, rs1);
+      else
+        out = appendRegister(out, rs1);
       break;
   }
 
-  std::string result(stream.str());
-  for (int addedSpace = result.size(); addedSpace < 20; addedSpace++)
-    result.append(" ");
+  if (out == buffer) {
+    out = appendText(out, "unknown 0x");
+    for (int shift = 28; shift >= 0; shift -= 4)
+      *out++ = "0123456789abcdef"[(oneInstruction >> shift) & 0xf];
+  }
+  *out = 0;
+  return out - buffer;
+}
+
+std::string printDecodedInstrRISCV(unsigned int oneInstruction)
+{
+  char buffer[RISCV_DISASSEMBLY_SIZE];
+  const int size = disassembleRISCV(oneInstruction, 0, buffer);
 
+  std::string result(buffer, size);
+  if (size < 20)
+    result.append(20 - size, ' ');
   return result;
 }
+#endif
 
 // bool isRecognized(ac_int<32, false> instruction){
 //   const ac_int<3, false> funct3 = instruction.slc<3>(12);
@@ -298,3 +479,224 @@ bool isRecognized(ap_uint<32> instruction){
   }
   return true;
 }
+
+// Fields of the 32 bits formats, immediates are given unshifted
+static ap_uint<32> encodeR(const ap_uint<7> funct7, const ap_uint<5> rs2, const ap_uint<5> rs1,
+                           const ap_uint<3> funct3, const ap_uint<5> rd, const ap_uint<7> opCode)
+{
+#pragma HLS INLINE
+  ap_uint<32> instruction   = 0;
+  instruction.range(31, 25) = funct7;
+  instruction.range(24, 20) = rs2;
+  instruction.range(19, 15) = rs1;
+  instruction.range(14, 12) = funct3;
+  instruction.range(11, 7)  = rd;
+  instruction.range(6, 0)   = opCode;
+  return instruction;
+}
+
+static ap_uint<32> encodeI(const ap_int<32> imm, const ap_uint<5> rs1, const ap_uint<3> funct3, const ap_uint<5> rd,
+                           const ap_uint<7> opCode)
+{
+#pragma HLS INLINE
+  ap_uint<32> instruction   = 0;
+  instruction.range(31, 20) = imm.range(11, 0);
+  instruction.range(19, 15) = rs1;
+  instruction.range(14, 12) = funct3;
+  instruction.range(11, 7)  = rd;
+  instruction.range(6, 0)   = opCode;
+  return instruction;
+}
+
+static ap_uint<32> encodeS(const ap_int<32> imm, const ap_uint<5> rs2, const ap_uint<5> rs1, const ap_uint<3> funct3)
+{
+#pragma HLS INLINE
+  ap_uint<32> instruction   = 0;
+  instruction.range(31, 25) = imm.range(11, 5);
+  instruction.range(24, 20) = rs2;
+  instruction.range(19, 15) = rs1;
+  instruction.range(14, 12) = funct3;
+  instruction.range(11, 7)  = imm.range(4, 0);
+  instruction.range(6, 0)   = RISCV_ST;
+  return instruction;
+}
+
+static ap_uint<32> encodeB(const ap_int<32> imm, const ap_uint<5> rs1, const ap_uint<3> funct3)
+{
+#pragma HLS INLINE
+  ap_uint<32> instruction   = 0;
+  instruction[31]           = imm[12];
+  instruction.range(30, 25) = imm.range(10, 5);
+  instruction.range(19, 15) = rs1; // rs2 is x0
+  instruction.range(14, 12) = funct3;
+  instruction.range(11, 8)  = imm.range(4, 1);
+  instruction[7]            = imm[11];
+  instruction.range(6, 0)   = RISCV_BR;
+  return instruction;
+}
+
+static ap_uint<32> encodeJ(const ap_int<32> imm, const ap_uint<5> rd)
+{
+#pragma HLS INLINE
+  ap_uint<32> instruction   = 0;
+  instruction[31]           = imm[20];
+  instruction.range(30, 21) = imm.range(10, 1);
+  instruction[20]           = imm[11];
+  instruction.range(19, 12) = imm.range(19, 12);
+  instruction.range(11, 7)  = rd;
+  instruction.range(6, 0)   = RISCV_JAL;
+  return instruction;
+}
+
+// Bits hi to lo of a compressed instruction, moved to position at of an immediate
+static ap_uint<32> field(const ap_uint<16> instruction, const int hi, const int lo, const int at)
+{
+#pragma HLS INLINE
+  return ((ap_uint<32>)instruction.range(hi, lo)) << at;
+}
+
+// Immediate whose sign is bit sign
+static ap_int<32> signExtend(const ap_uint<32> imm, const int sign)
+{
+#pragma HLS INLINE
+  return ((ap_int<32>)(imm << (31 - sign))) >> (31 - sign);
+}
+
+ap_uint<32> expandCompressed(const ap_uint<16> instruction)
+{
+#pragma HLS INLINE
+  const ap_uint<2> quadrant = instruction.range(1, 0);
+  const ap_uint<3> funct3   = instruction.range(15, 13);
+  // Full register fields, and the 3 bits ones which name x8 to x15
+  const ap_uint<5> rd       = instruction.range(11, 7);
+  const ap_uint<5> rs2      = instruction.range(6, 2);
+  const ap_uint<5> rdShort  = 8 + instruction.range(4, 2);
+  const ap_uint<5> rs1Short = 8 + instruction.range(9, 7);
+
+  // Immediates of the formats
+  const ap_int<32> immCI   = signExtend(field(instruction, 12, 12, 5) | field(instruction, 6, 2, 0), 5);
+  const ap_uint<32> offCL  = field(instruction, 5, 5, 6) | field(instruction, 12, 10, 3) | field(instruction, 6, 6, 2);
+  const ap_int<32> offCJ   = signExtend(field(instruction, 12, 12, 11) | field(instruction, 11, 11, 4) |
+                                          field(instruction, 10, 9, 8) | field(instruction, 8, 8, 10) |
+                                          field(instruction, 7, 7, 6) | field(instruction, 6, 6, 7) |
+                                          field(instruction, 5, 3, 1) | field(instruction, 2, 2, 5),
+                                      11);
+  const ap_int<32> offCB   = signExtend(field(instruction, 12, 12, 8) | field(instruction, 11, 10, 3) |
+                                          field(instruction, 6, 5, 6) | field(instruction, 4, 3, 1) |
+                                          field(instruction, 2, 2, 5),
+                                      8);
+
+  switch (quadrant) {
+    case 0:
+      switch (funct3) {
+        case 0: { // c.addi4spn
+          const ap_uint<32> imm = field(instruction, 12, 11, 4) | field(instruction, 10, 7, 6) |
+                                  field(instruction, 6, 6, 2) | field(instruction, 5, 5, 3);
+          if (imm != 0)
+            return encodeI(imm, 2, RISCV_OPI_ADDI, rdShort, RISCV_OPI);
+          break;
+        }
+        case 2: // c.lw
+          return encodeI(offCL, rs1Short, RISCV_LD_LW, rdShort, RISCV_LD);
+        case 6: // c.sw
+          return encodeS(offCL, rdShort, rs1Short, RISCV_ST_STW);
+      }
+      break;
+
+    case 1:
+      switch (funct3) {
+        case 0: // c.addi, c.nop
+          return encodeI(immCI, rd, RISCV_OPI_ADDI, rd, RISCV_OPI);
+        case 1: // c.jal
+          return encodeJ(offCJ, 1);
+        case 2: // c.li
+          return encodeI(immCI, 0, RISCV_OPI_ADDI, rd, RISCV_OPI);
+        case 3:
+          if (rd == 2) { // c.addi16sp
+            const ap_int<32> imm = signExtend(field(instruction, 12, 12, 9) | field(instruction, 6, 6, 4) |
+                                                  field(instruction, 5, 5, 6) | field(instruction, 4, 3, 7) |
+                                                  field(instruction, 2, 2, 5),
+                                              9);
+            if (imm != 0)
+              return encodeI(imm, 2, RISCV_OPI_ADDI, 2, RISCV_OPI);
+          } else if (immCI != 0) { // c.lui
+            ap_uint<32> expanded     = 0;
+            expanded.range(31, 12)   = ((ap_uint<32>)immCI).range(19, 0);
+            expanded.range(11, 7)    = rd;
+            expanded.range(6, 0)     = RISCV_LUI;
+            return expanded;
+          }
+          break;
+        case 4:
+          switch (instruction.range(11, 10)) {
+            case 0: // c.srli, the shift amount has 5 bits on RV32
+              if (!instruction[12])
+                return encodeI(immCI & 0x1f, rs1Short, RISCV_OPI_SRI, rs1Short, RISCV_OPI);
+              break;
+            case 1: // c.srai
+              if (!instruction[12])
+                return encodeI((immCI & 0x1f) | (RISCV_OPI_SRI_SRAI << 5), rs1Short, RISCV_OPI_SRI, rs1Short,
+                               RISCV_OPI);
+              break;
+            case 2: // c.andi
+              return encodeI(immCI, rs1Short, RISCV_OPI_ANDI, rs1Short, RISCV_OPI);
+            case 3:
+              if (!instruction[12]) {
+                switch (instruction.range(6, 5)) {
+                  case 0: // c.sub
+                    return encodeR(RISCV_OP_ADD_SUB, rdShort, rs1Short, RISCV_OP_ADD, rs1Short, RISCV_OP);
+                  case 1: // c.xor
+                    return encodeR(0, rdShort, rs1Short, RISCV_OP_XOR, rs1Short, RISCV_OP);
+                  case 2: // c.or
+                    return encodeR(0, rdShort, rs1Short, RISCV_OP_OR, rs1Short, RISCV_OP);
+                  case 3: // c.and
+                    return encodeR(0, rdShort, rs1Short, RISCV_OP_AND, rs1Short, RISCV_OP);
+                }
+              }
+              break;
+          }
+          break;
+        case 5: // c.j
+          return encodeJ(offCJ, 0);
+        case 6: // c.beqz
+          return encodeB(offCB, rs1Short, RISCV_BR_BEQ);
+        case 7: // c.bnez
+          return encodeB(offCB, rs1Short, RISCV_BR_BNE);
+      }
+      break;
+
+    case 2:
+      switch (funct3) {
+        case 0: // c.slli
+          if (!instruction[12])
+            return encodeI(immCI & 0x1f, rd, RISCV_OPI_SLLI, rd, RISCV_OPI);
+          break;
+        case 2: // c.lwsp
+          if (rd != 0)
+            return encodeI(field(instruction, 12, 12, 5) | field(instruction, 6, 4, 2) | field(instruction, 3, 2, 6), 2,
+                           RISCV_LD_LW, rd, RISCV_LD);
+          break;
+        case 4:
+          if (!instruction[12]) {
+            if (rs2 == 0) { // c.jr
+              if (rd != 0)
+                return encodeI(0, rd, 0, 0, RISCV_JALR);
+            } else { // c.mv
+              return encodeR(0, rs2, 0, RISCV_OP_ADD, rd, RISCV_OP);
+            }
+          } else {
+            if (rd == 0 && rs2 == 0) // c.ebreak
+              return encodeI(RISCV_SYSTEM_ENV_EBREAK, 0, RISCV_SYSTEM_ENV, 0, RISCV_SYSTEM);
+            else if (rs2 == 0) // c.jalr
+              return encodeI(0, rd, 0, 1, RISCV_JALR);
+            else // c.add
+              return encodeR(0, rs2, rd, RISCV_OP_ADD, rd, RISCV_OP);
+          }
+          break;
+        case 6: // c.swsp
+          return encodeS(field(instruction, 12, 9, 2) | field(instruction, 8, 7, 6), rs2, 2, RISCV_ST_STW);
+      }
+      break;
+  }
+  return 0;
+}
@@ -21,11 +21,26 @@
 #include "ap_int.h"
 
 #ifndef __HLS__
+// Host-side disassembler. It writes the instruction in the assembly syntax of
+// objdump -M no-aliases, with branch and jump targets computed from pc, and
+// returns the length of the text. It does not allocate, so that it can be used
+// on every instruction of a trace.
+#define RISCV_DISASSEMBLY_SIZE 48 // longest text, with the final 0
+int disassembleRISCV(const unsigned int oneInstruction, const unsigned int pc, char buffer[RISCV_DISASSEMBLY_SIZE]);
+
+// Same text (with targets relative to the instruction), padded to 20 characters
 std::string printDecodedInstrRISCV(unsigned int oneInstruction);
 #endif
 // bool isRecognized(ac_int<32, false> instruction);
 bool isRecognized(ap_int<32> instruction);
 
+// RV32C: instructions whose two low bits are not 11 are 16 bits long. They are
+// expanded into the 32 bits instruction they stand for, and into 0 (an opcode
+// which does nothing) when they are illegal or need an extension the core does
+// not have (floating point).
+#define RISCV_IS_COMPRESSED(half) ((half & 0x3) != 0x3)
+ap_uint<32> expandCompressed(const ap_uint<16> instruction);
+
 // Major opcodes
 #define RISCV_LUI 0x37      // 0x0D
 #define RISCV_AUIPC 0x17    // 0x05
@@ -39,6 +54,8 @@ bool isRecognized(ap_int<32> instruction);
 #define RISCV_MISC_MEM 0x0F // 0x03
 #define RISCV_OPIW 0x1B     // 0x06
 #define RISCV_OPW 0x3B      // 0x0E
+#define RISCV_CUSTOM0 0x0B  // 0x02, reserved for extensions (see customAccelerator.h)
+#define RISCV_CUSTOM1 0x2B  // 0x0A
 
 // funct3 or funct7
 #define RISCV_BR_BEQ 0x0
@@ -165,6 +182,17 @@ bool isRecognized(ap_int<32> instruction);
 #define RISCV_CSR_MINSTRET 0xB02  // MRW minstret Machine instructions-retired counter.
 #define RISCV_CSR_MCYCLEH 0xB80   // MRW mcycleh Upper 32 bits of mcycle, RV32I only.
 #define RISCV_CSR_MINSTRETH 0xB82 // MRW minstreth Upper 32 bits of minstret, RV32I only.
+#define RISCV_CSR_MHPMCOUNTER3 0xB03  // MRW mhpmcounter3 Machine performance-monitoring counter.
+#define RISCV_CSR_MHPMCOUNTER3H 0xB83 // MRW mhpmcounter3h Upper 32 bits of mhpmcounter3, RV32I only.
+#define RISCV_CSR_MCOUNTINHIBIT 0x320 // MRW mcountinhibit Machine counter-inhibit register.
+
+// User Counter/Timers (read-only shadows of the machine counters)
+#define RISCV_CSR_CYCLE 0xC00         // URO cycle Cycle counter for RDCYCLE instruction.
+#define RISCV_CSR_INSTRET 0xC02       // URO instret Instructions-retired counter for RDINSTRET instruction.
+#define RISCV_CSR_HPMCOUNTER3 0xC03   // URO hpmcounter3 Performance-monitoring counter.
+#define RISCV_CSR_CYCLEH 0xC80        // URO cycleh Upper 32 bits of cycle, RV32I only.
+#define RISCV_CSR_INSTRETH 0xC82      // URO instreth Upper 32 bits of instret, RV32I only.
+#define RISCV_CSR_HPMCOUNTER3H 0xC83  // URO hpmcounter3h Upper 32 bits of hpmcounter3, RV32I only.
 
 /******************************************************************************************************
  * Specification of the standard M extension
@@ -211,19 +239,6 @@ bool isRecognized(ap_int<32> instruction);
 #define RISCV_ATOMIC_MINU 0x18
 #define RISCV_ATOMIC_MAXU 0x1C
 
-#ifndef __CATAPULT
-#ifndef __NIOS
-// std::string printDecodedInstrRISCV(uint32 instruction);
-extern const char* riscvNamesOP[8];
-extern const char* riscvNamesOPI[8];
-extern const char* riscvNamesOPW[8];
-extern const char* riscvNamesOPIW[8];
-extern const char* riscvNamesLD[8];
-extern const char* riscvNamesST[8];
-extern const char* riscvNamesBR[8];
-extern const char* riscvNames[8];
-#endif
-#endif
 #define SYS_exit 93
 #define SYS_exit_group 94
 #define SYS_getpid 172
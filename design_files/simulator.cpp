@@ -0,0 +1,321 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*       http://www.apache.org/licenses/LICENSE-2.0
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+
+// Host-side simulator: runs a RISC-V ELF program on the core, cycle by cycle,
+// until it calls exit (ecall with a7 = 93) or reaches the cycle limit.
+//
+// g++ -O2 -pthread -I<vitis>/include simulator.cpp core.cpp riscvISA.cpp elfFile.cpp profiler.cpp
+// simulator -f program.elf [-m maxCycles] [-p profilePrefix] [-n profileLines] [-t tracePrefix]
+//           [-r pipelineTrace] [-s]
+//
+// With -p, profilePrefix.flat receives the flat profile and profilePrefix.folded
+// the folded call stacks (flamegraph.pl profilePrefix.folded > profile.svg).
+// With -t, the requests to the instruction and data memories are recorded in
+// tracePrefix.im and tracePrefix.dm, to be replayed by cacheSweep.
+// With -r, the state of the pipeline at every cycle is recorded in pipelineTrace,
+// to be displayed by pipelineView (see pipelineTrace.h for compression).
+// With -s, the detailed statistics of the caches are printed: 3C miss classes,
+// accesses per set and the profileLines PCs with most misses. The coherent data
+// caches only have their counters.
+// With -DNB_CORES=N, the program can start the other harts (see threadSyscalls in
+// core.cpp). It ends when hart 0 calls exit. The profile and the traces follow hart 0.
+// With -DBARREL_CORE=1 as well, the harts are the threads of the barrel core and
+// the CPI stack is the one of its pipeline.
+// With -DDATAFLOW_CORE=1, the hart runs on the dataflow core.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "core.h"
+#include "elfFile.h"
+#include "memoryTrace.h"
+#include "pipelineTrace.h"
+#include "profiler.h"
+
+#define MEMORY_WORDS (1 << 24)
+#define STACK_INIT   ((MEMORY_WORDS << 2) - 16) // top of the data memory
+
+// The barrel core has a single pair of memory interfaces for all its harts
+#define NB_PORTS (BARREL_CORE ? 1 : NB_CORES)
+
+static ap_uint<32> imData[MEMORY_WORDS];
+static ap_uint<32> dmData[MEMORY_WORDS];
+
+const char* cycleClassNames[NB_CYCLE_CLASSES] = {"bubble",   "retire",      "im stall",    "dm stall",
+                                                 "load-use", "branch (DC)", "branch (EX)", "global stall",
+                                                 "serialize"};
+
+static void loadElf(const ElfFile& elf)
+{
+  for (const ElfSection& section : elf.sectionTable) {
+    const unsigned char* code = elf.getSectionCode(section);
+    if (!(section.flags & ELF_SHF_ALLOC) || code == NULL)
+      continue;
+
+    if (((unsigned long)section.address + section.size) > (MEMORY_WORDS << 2)) {
+      fprintf(stderr, "Section %s does not fit in the simulated memory\n", section.name.c_str());
+      exit(-1);
+    }
+
+    for (unsigned int oneByte = 0; oneByte < section.size; oneByte++) {
+      const unsigned int address = section.address + oneByte;
+      const int offset           = (address & 0x3) << 3;
+      imData[address >> 2].range(offset + 7, offset) = code[oneByte];
+      dmData[address >> 2].range(offset + 7, offset) = code[oneByte];
+    }
+  }
+}
+
+// Instruction at pc for the profiler, in its 32 bits form when it is compressed
+static unsigned int instructionAt(const unsigned int pc)
+{
+  const unsigned int word  = (pc >> 2) & (MEMORY_WORDS - 1);
+  unsigned int instruction = imData[word];
+  if (pc & 0x2)
+    instruction = (instruction >> 16) | ((unsigned int)imData[(word + 1) & (MEMORY_WORDS - 1)].range(15, 0) << 16);
+  if (RISCV_IS_COMPRESSED(instruction))
+    instruction = expandCompressed(instruction & 0xffff);
+  return instruction;
+}
+
+int main(int argc, char** argv)
+{
+  const char* elfPath       = NULL;
+  const char* profilePrefix = NULL;
+  const char* tracePrefix   = NULL;
+  const char* pipelinePath  = NULL;
+  unsigned long maxCycles   = -1;
+  int profileLines          = 20;
+  bool cacheStats           = false;
+
+  for (int oneArg = 1; oneArg < argc; oneArg++) {
+    if (!strcmp(argv[oneArg], "-f") && oneArg + 1 < argc)
+      elfPath = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-m") && oneArg + 1 < argc)
+      maxCycles = strtoul(argv[++oneArg], NULL, 0);
+    else if (!strcmp(argv[oneArg], "-p") && oneArg + 1 < argc)
+      profilePrefix = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-n") && oneArg + 1 < argc)
+      profileLines = atoi(argv[++oneArg]);
+    else if (!strcmp(argv[oneArg], "-t") && oneArg + 1 < argc)
+      tracePrefix = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-r") && oneArg + 1 < argc)
+      pipelinePath = argv[++oneArg];
+    else if (!strcmp(argv[oneArg], "-s"))
+      cacheStats = true;
+    else {
+      fprintf(stderr, "Usage: %s -f program.elf [-m maxCycles] [-p profilePrefix] [-n profileLines] [-t tracePrefix] "
+                      "[-r pipelineTrace] [-s]\n",
+              argv[0]);
+      return -1;
+    }
+  }
+  if (elfPath == NULL) {
+    fprintf(stderr, "Usage: %s -f program.elf [-m maxCycles] [-p profilePrefix] [-n profileLines] [-t tracePrefix] "
+                    "[-r pipelineTrace] [-s]\n",
+            argv[0]);
+    return -1;
+  }
+
+  ElfFile elf(elfPath);
+  loadElf(elf);
+  Profiler* profiler = (profilePrefix != NULL) ? new Profiler(elf) : NULL;
+
+  MEMORY_INTERFACE<4> imInterface = MEMORY_INTERFACE<4>(imData);
+  MEMORY_INTERFACE<4> dmInterface = MEMORY_INTERFACE<4>(dmData);
+
+  static Core cores[NB_CORES];
+  bool running[NB_CORES];
+  MemoryInterface<4>* imPorts[NB_PORTS];
+  MemoryInterface<4>* dmPorts[NB_PORTS];
+#if ICACHE_SETS
+  CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE>* imCaches[NB_PORTS];
+#endif
+#if DCACHE_SETS && DCACHE_COHERENT
+  SnoopBus<4, DCACHE_LINE_SIZE, DCACHE_SETS, NB_CORES> dmBus(&dmInterface);
+  CoherentCacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, NB_CORES>* dmCaches[NB_PORTS];
+#elif DCACHE_SETS
+  CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE>* dmCaches[NB_PORTS];
+#endif
+
+  for (int onePort = 0; onePort < NB_PORTS; onePort++) {
+    // Every hart has its own interfaces on the shared memories
+    imPorts[onePort] = (onePort == 0) ? &imInterface : new MEMORY_INTERFACE<4>(imData);
+    dmPorts[onePort] = (onePort == 0) ? &dmInterface : new MEMORY_INTERFACE<4>(dmData);
+#if ICACHE_SETS
+    imCaches[onePort] = new CacheMemory<4, ICACHE_LINE_SIZE, ICACHE_SETS, ICACHE_VICTIM_SIZE>(imPorts[onePort], false);
+    imPorts[onePort]  = imCaches[onePort];
+#endif
+#if DCACHE_SETS && DCACHE_COHERENT
+    dmCaches[onePort] = new CoherentCacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, NB_CORES>();
+    dmCaches[onePort]->attach(&dmBus, onePort);
+    dmPorts[onePort] = dmCaches[onePort];
+#elif DCACHE_SETS
+    dmCaches[onePort] = new CacheMemory<4, DCACHE_LINE_SIZE, DCACHE_SETS, DCACHE_VICTIM_SIZE>(dmPorts[onePort], false);
+    dmPorts[onePort]  = dmCaches[onePort];
+#endif
+  }
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++) {
+    initCore(cores[oneCore], oneCore, elf.entry);
+    running[oneCore] = (oneCore == 0);
+  }
+  Core& core = cores[0];
+
+  // Traces record the requests of the core, before the caches
+  TracingMemory<4>* imTrace = NULL;
+  TracingMemory<4>* dmTrace = NULL;
+  if (tracePrefix != NULL) {
+    imTrace    = new TracingMemory<4>(imPorts[0], (std::string(tracePrefix) + ".im").c_str());
+    dmTrace    = new TracingMemory<4>(dmPorts[0], (std::string(tracePrefix) + ".dm").c_str());
+    imPorts[0] = imTrace;
+    dmPorts[0] = dmTrace;
+  }
+
+#if BARREL_CORE
+  static BarrelCore barrel;
+  barrel.im = imPorts[0];
+  barrel.dm = dmPorts[0];
+  initBarrel(barrel);
+#elif DATAFLOW_CORE
+  static DataflowCore dataflow;
+  dataflow.im = imPorts[0];
+  dataflow.dm = dmPorts[0];
+  initDataflow(dataflow);
+#else
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++) {
+    cores[oneCore].im = imPorts[oneCore];
+    cores[oneCore].dm = dmPorts[oneCore];
+  }
+#endif
+
+  PipelineTraceWriter* pipelineTrace = (pipelinePath != NULL) ? new PipelineTraceWriter(pipelinePath) : NULL;
+
+  core.regFile.set(2, STACK_INIT);
+
+  int exitCode = 0;
+  bool exited  = false;
+  while (core.cycle < maxCycles) {
+    // The instruction in writeback retires at the end of the cycle unless the pipeline is frozen
+#if BARREL_CORE
+    const struct MemtoWB inWriteback = barrel.memtoWB;
+    const bool inHart0               = (barrel.threadWB == 0);
+    doBarrel(barrel, cores, running, false);
+    const bool retired                  = inWriteback.we && inHart0 && !barrel.stallDm;
+    const struct CycleTrace& cycleTrace = barrel.lastCycle;
+    const unsigned int retiredPc        = inWriteback.pc;
+#elif DATAFLOW_CORE
+    doDataflow(dataflow, core, running);
+    const bool retired                  = dataflow.retired;
+    const unsigned int retiredPc        = dataflow.retiredPc;
+    const struct CycleTrace& cycleTrace = core.lastCycle;
+#else
+    const struct MemtoWB inWriteback = core.memtoWB;
+    doHarts(cores, running, false);
+    const bool retired                  = inWriteback.we && !core.stallIm && !core.stallDm;
+    const struct CycleTrace& cycleTrace = core.lastCycle;
+    const unsigned int retiredPc        = inWriteback.pc;
+#endif
+    const unsigned int instruction = instructionAt(retiredPc);
+
+    if (pipelineTrace != NULL)
+      pipelineTrace->write(cycleTrace);
+    if (profiler != NULL)
+      profiler->cycle(retired, retiredPc, instruction);
+
+    // Hart 0 called exit
+    if (!running[0]) {
+      exitCode = core.regFile[10];
+      exited   = true;
+      break;
+    }
+  }
+
+  if (!exited)
+    fprintf(stderr, "Cycle limit reached at pc %08x\n", (unsigned int)core.pc);
+
+  fprintf(stderr, "%lu cycles, %lu instructions, CPI %.3f\n", core.cycle, (unsigned long)core.csr.minstret,
+          (double)core.cycle / (unsigned long)core.csr.minstret);
+#if BARREL_CORE
+  // The CPI stack is the one of the pipeline, shared by all the harts
+  unsigned long pipelineInstructions = 0;
+  for (int oneCore = 0; oneCore < NB_CORES; oneCore++)
+    pipelineInstructions += cores[oneCore].csr.minstret;
+  fprintf(stderr, "pipeline: %lu instructions, IPC %.3f, %lu thread switches\n", pipelineInstructions,
+          (double)pipelineInstructions / barrel.cycle, barrel.numberSwitches);
+  const ap_uint<64>* cycleClasses = barrel.cycleClasses;
+#else
+  const ap_uint<64>* cycleClasses = core.cycleClasses;
+#endif
+  for (int oneClass = 0; oneClass < NB_CYCLE_CLASSES; oneClass++)
+    fprintf(stderr, "  %-14s %14lu  %6.2f%%\n", cycleClassNames[oneClass], (unsigned long)cycleClasses[oneClass],
+            100.0 * (unsigned long)cycleClasses[oneClass] / core.cycle);
+
+  for (int oneCore = 1; oneCore < NB_CORES; oneCore++)
+    fprintf(stderr, "hart %d: %lu cycles, %lu instructions\n", oneCore, cores[oneCore].cycle,
+            (unsigned long)cores[oneCore].csr.minstret);
+
+  for (int onePort = 0; onePort < NB_PORTS; onePort++) {
+#if ICACHE_SETS
+    fprintf(stderr, "icache %d: %lu accesses, %lu misses\n", onePort, imCaches[onePort]->numberAccess,
+            imCaches[onePort]->numberMiss);
+#endif
+#if DCACHE_SETS
+    fprintf(stderr, "dcache %d: %lu accesses, %lu misses, %lu writebacks\n", onePort, dmCaches[onePort]->numberAccess,
+            dmCaches[onePort]->numberMiss, dmCaches[onePort]->numberWriteback);
+#endif
+  }
+#if DCACHE_SETS && DCACHE_COHERENT
+  fprintf(stderr, "coherence: %lu BusRd, %lu BusRdX, %lu BusUpgr, %lu invalidations, %lu interventions, "
+                  "%lu bus wait cycles\n",
+          dmBus.numberBusRead, dmBus.numberBusReadExclusive, dmBus.numberBusUpgrade, dmBus.numberInvalidation,
+          dmBus.numberIntervention, dmBus.numberWaitCycles);
+#endif
+
+  if (cacheStats) {
+    for (int onePort = 0; onePort < NB_PORTS; onePort++) {
+#if ICACHE_SETS
+      fprintf(stderr, "\nicache %d statistics: ", onePort);
+      imCaches[onePort]->printStats(stderr, profileLines);
+#endif
+#if DCACHE_SETS && !DCACHE_COHERENT
+      fprintf(stderr, "\ndcache %d statistics: ", onePort);
+      dmCaches[onePort]->printStats(stderr, profileLines);
+#endif
+    }
+  }
+
+  // Closes the trace files
+  delete imTrace;
+  delete dmTrace;
+  delete pipelineTrace;
+
+  if (profiler != NULL) {
+    const std::string prefix(profilePrefix);
+    FILE* flatFile   = fopen((prefix + ".flat").c_str(), "w");
+    FILE* foldedFile = fopen((prefix + ".folded").c_str(), "w");
+    if (flatFile == NULL || foldedFile == NULL) {
+      fprintf(stderr, "Failed to open the profile files %s.*\n", profilePrefix);
+      return -1;
+    }
+    profiler->printFlat(flatFile, profileLines);
+    profiler->printFolded(foldedFile);
+    fclose(flatFile);
+    fclose(foldedFile);
+    delete profiler;
+  }
+
+  return exitCode;
+}